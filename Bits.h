@@ -0,0 +1,54 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+
+#include <stdint.h>
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+FTL_NAMESPACE_BEGIN
+
+// value must be non-zero
+inline uint32_t BitsCountTrailingZeros( uint32_t value )
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward( &index, value );
+  return index;
+#else
+  return __builtin_ctz( value );
+#endif
+}
+
+// value must be non-zero
+inline uint32_t BitsCountLeadingZeros( uint64_t value )
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanReverse64( &index, value );
+  return 63 - index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if ( _BitScanReverse( &index, uint32_t( value >> 32 ) ) )
+    return 31 - index;
+  _BitScanReverse( &index, uint32_t( value ) );
+  return 63 - index;
+#else
+  return __builtin_clzll( value );
+#endif
+}
+
+inline uint32_t BitsCountOnes( uint32_t value )
+{
+  value -= ( value >> 1 ) & 0x55555555;
+  value = ( value & 0x33333333 ) + ( ( value >> 2 ) & 0x33333333 );
+  value = ( value + ( value >> 4 ) ) & 0x0F0F0F0F;
+  return ( value * 0x01010101 ) >> 24;
+}
+
+FTL_NAMESPACE_END
@@ -0,0 +1,129 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+#include <FTL/StrRef.h>
+
+#include <limits>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+//
+// Constants shared by CBOREnc and CBORDec, which read and write CBOR
+// (RFC 8949), a binary encoding of the JSON data model.  Typed numeric
+// arrays are written as RFC 8746 typed arrays, so they are stored (and
+// decoded) as packed little-endian bytes rather than element by element.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// The top three bits of the first byte of every item
+enum CBORMajor
+{
+  CBORMajor_UInt,
+  CBORMajor_NegInt,
+  CBORMajor_Bytes,
+  CBORMajor_Text,
+  CBORMajor_Array,
+  CBORMajor_Map,
+  CBORMajor_Tag,
+  CBORMajor_Simple
+};
+
+// The low five bits of the first byte: values below CBORInfo_UInt8 are
+// stored inline, the next four are followed by a 1, 2, 4 or 8 byte
+// big-endian argument
+static const uint8_t CBORInfo_UInt8 = 24;
+static const uint8_t CBORInfo_UInt16 = 25;
+static const uint8_t CBORInfo_UInt32 = 26;
+static const uint8_t CBORInfo_UInt64 = 27;
+static const uint8_t CBORInfo_Indefinite = 31;
+
+// Complete first bytes of major type 7
+static const uint8_t CBORFalse = 0xF4;
+static const uint8_t CBORTrue = 0xF5;
+static const uint8_t CBORNull = 0xF6;
+static const uint8_t CBORUndefined = 0xF7;
+static const uint8_t CBORFloat16 = 0xF9;
+static const uint8_t CBORFloat32 = 0xFA;
+static const uint8_t CBORFloat64 = 0xFB;
+static const uint8_t CBORBreak = 0xFF;
+
+// Typed array tags are 0b010fsell: f (float), s (signed), e (little
+// endian) and ll, the log2 of the element size (or, for floats, of the
+// element size in 16-bit units).
+static const uint64_t CBORTag_TypedArrayFirst = 64;
+static const uint64_t CBORTag_TypedArrayLast = 87;
+static const uint64_t CBORTag_SInt32LEArray = 78;
+static const uint64_t CBORTag_Float32LEArray = 85;
+static const uint64_t CBORTag_Float64LEArray = 86;
+
+// Self-described CBOR: a tag that may prefix any document and whose
+// encoding, "\xD9\xD9\xF7", identifies it as CBOR rather than text
+static const uint64_t CBORTag_SelfDescribe = 55799;
+
+inline StrRef CBORSelfDescribeStr()
+  { return FTL_STR("\xD9\xD9\xF7"); }
+
+inline bool CBORIsSelfDescribed( StrRef str )
+  { return str.startswith( CBORSelfDescribeStr() ); }
+
+// Exact conversion from single to half precision: returns false unless
+// the value (or a NaN) can be stored without loss
+inline bool CBORFloat32ToFloat16( float value, uint16_t &half )
+{
+  uint32_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  uint16_t const sign = uint16_t( ( bits >> 16 ) & 0x8000 );
+  uint32_t const exp = ( bits >> 23 ) & 0xFF;
+  uint32_t const mant = bits & 0x7FFFFF;
+  if ( exp == 0xFF )
+  {
+    half = uint16_t( sign | 0x7C00 | ( mant? 0x200: 0 ) );
+    return true;
+  }
+  if ( exp == 0 && mant == 0 )
+  {
+    half = sign;
+    return true;
+  }
+  int32_t const e = int32_t( exp ) - 127;
+  if ( e > 15 || e < -24 )
+    return false;
+  if ( e >= -14 )
+  {
+    if ( mant & 0x1FFF )
+      return false;
+    half = uint16_t( sign | uint32_t( e + 15 ) << 10 | mant >> 13 );
+    return true;
+  }
+  // Subnormal: a multiple of 2^-24
+  uint32_t const full = 0x800000 | mant;
+  uint32_t const shift = uint32_t( -e - 1 );
+  if ( full & ( ( 1u << shift ) - 1 ) )
+    return false;
+  half = uint16_t( sign | full >> shift );
+  return true;
+}
+
+inline double CBORFloat16ToFloat64( uint16_t half )
+{
+  uint32_t const exp = ( half >> 10 ) & 0x1F;
+  uint32_t const mant = half & 0x3FF;
+  double value;
+  if ( exp == 0 )
+    value = ldexp( double( mant ), -24 );
+  else if ( exp != 31 )
+    value = ldexp( double( mant + 1024 ), int( exp ) - 25 );
+  else if ( mant == 0 )
+    value = std::numeric_limits<double>::infinity();
+  else
+    value = std::numeric_limits<double>::quiet_NaN();
+  return ( half & 0x8000 )? -value: value;
+}
+
+FTL_NAMESPACE_END
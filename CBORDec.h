@@ -0,0 +1,894 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/CBOR.h>
+#include <FTL/JSONException.h>
+#include <FTL/StrRef.h>
+
+#include <assert.h>
+#include <vector>
+
+//
+// Usage mirrors JSONDec:
+//
+// CBORStrWithLoc ds( cbor );
+// CBORDec dec( ds );
+// CBOREnt ent;
+// while ( dec.getNext( ent ) )
+// {
+//   if ( ent.isObject() )
+//   {
+//     CBORObjectDec objectDec( ent );
+//     CBOREnt keyEnt, valueEnt;
+//     while ( objectDec.getNext( keyEnt, valueEnt ) )
+//       ...
+//   }
+// }
+//
+// Nothing is copied: string values and typed array elements refer into
+// the input.  Tags other than RFC 8746 typed arrays, such as the
+// self-describe tag, are skipped over.
+//
+
+FTL_NAMESPACE_BEGIN
+
+class CBORMalformedException : public JSONException
+{
+public:
+
+  CBORMalformedException(
+    size_t offset,
+    StrRef desc
+    )
+    : m_offset( offset )
+  {
+    append( FTL_STR("offset ") );
+    appendSize( offset );
+    append( FTL_STR(": ") );
+    append( desc );
+  }
+
+  size_t getOffset() const
+    { return m_offset; }
+
+private:
+
+  size_t m_offset;
+};
+
+// Input bytes, along with the offset of the first in the document
+struct CBORStrWithLoc
+{
+  StrRef str;
+  size_t offset;
+
+  CBORStrWithLoc()
+    : offset( 0 ) {}
+
+  CBORStrWithLoc( StrRef theStr, size_t theOffset = 0 )
+    : str( theStr )
+    , offset( theOffset ) {}
+
+  bool empty() const
+    { return str.empty(); }
+
+  size_t size() const
+    { return str.size(); }
+
+  char const *data() const
+    { return str.data(); }
+
+  uint8_t front() const
+    { return uint8_t( str.front() ); }
+
+  void drop( size_t count = 1 )
+  {
+    str = str.drop_front( count );
+    offset += count;
+  }
+};
+
+template<typename Ty1, typename Ty2>
+struct CBORSameType
+  { static const bool Value = false; };
+
+template<typename Ty>
+struct CBORSameType<Ty, Ty>
+  { static const bool Value = true; };
+
+class CBORDec;
+class CBORObjectDec;
+class CBORArrayDec;
+
+class CBOREnt
+{
+  friend class CBORDec;
+  friend class CBORObjectDec;
+  friend class CBORArrayDec;
+
+public:
+
+  enum Type
+  {
+    Type_Undefined,
+    Type_Null,
+    Type_Boolean,
+    Type_SInt64,
+    Type_UInt64,
+    Type_Float64,
+    Type_String,
+    Type_Bytes,
+    Type_Object,
+    Type_Array,
+    Type_TypedArray
+  };
+
+  enum EleType
+  {
+    EleType_UInt8,
+    EleType_SInt8,
+    EleType_UInt16,
+    EleType_SInt16,
+    EleType_UInt32,
+    EleType_SInt32,
+    EleType_UInt64,
+    EleType_SInt64,
+    EleType_Float16,
+    EleType_Float32,
+    EleType_Float64
+  };
+
+  CBOREnt()
+    : type( Type_Undefined ) {}
+
+  Type getType() const
+    { return type; }
+
+  // The whole item, including any tags
+  StrRef getRawStr() const
+    { return raw.str; }
+
+  size_t getOffset() const
+    { return raw.offset; }
+
+  bool isUndefined() const
+    { return type == Type_Undefined; }
+
+  operator bool () const
+    { return !isUndefined(); }
+
+  bool operator !() const
+    { return isUndefined(); }
+
+  // Also CBOR's undefined
+  bool isNull() const
+    { return type == Type_Null; }
+
+  bool isBoolean() const
+    { return type == Type_Boolean; }
+
+  bool booleanValue() const
+  {
+    assert( isBoolean() );
+    return value.boolean;
+  }
+
+  // Integers that fit an int64_t...
+  bool isSInt64() const
+    { return type == Type_SInt64; }
+
+  int64_t sint64Value() const
+  {
+    assert( isSInt64() );
+    return value.sint64;
+  }
+
+  // ...and those above INT64_MAX
+  bool isUInt64() const
+    { return type == Type_UInt64; }
+
+  uint64_t uint64Value() const
+  {
+    assert( isUInt64() );
+    return value.uint64;
+  }
+
+  // Half, single or double precision
+  bool isFloat64() const
+    { return type == Type_Float64; }
+
+  double float64Value() const
+  {
+    assert( isFloat64() );
+    return value.float64;
+  }
+
+  // Text strings may be sent in chunks (with an indefinite length), in
+  // which case only stringAppendTo can be used.
+  bool isString() const
+    { return type == Type_String; }
+
+  bool stringIsChunked() const
+  {
+    assert( isString() );
+    return chunked;
+  }
+
+  StrRef stringValue() const
+  {
+    assert( isString() && !chunked );
+    return body.str;
+  }
+
+  template<typename StringTy>
+  void stringAppendTo( StringTy &string ) const
+  {
+    assert( isString() );
+    appendChunksTo( string );
+  }
+
+  bool isBytes() const
+    { return type == Type_Bytes; }
+
+  bool bytesIsChunked() const
+  {
+    assert( isBytes() );
+    return chunked;
+  }
+
+  StrRef bytesValue() const
+  {
+    assert( isBytes() && !chunked );
+    return body.str;
+  }
+
+  template<typename StringTy>
+  void bytesAppendTo( StringTy &string ) const
+  {
+    assert( isBytes() );
+    appendChunksTo( string );
+  }
+
+  bool isObject() const
+    { return type == Type_Object; }
+
+  size_t objectSize() const
+  {
+    assert( isObject() );
+    return count;
+  }
+
+  bool isArray() const
+    { return type == Type_Array; }
+
+  size_t arraySize() const
+  {
+    assert( isArray() );
+    return count;
+  }
+
+  bool isTypedArray() const
+    { return type == Type_TypedArray; }
+
+  EleType typedArrayEleType() const
+  {
+    assert( isTypedArray() );
+    return eleType;
+  }
+
+  size_t typedArraySize() const
+  {
+    assert( isTypedArray() );
+    return count;
+  }
+
+  // The packed elements, in the byte order given by the tag
+  StrRef typedArrayBytes() const
+  {
+    assert( isTypedArray() );
+    return body.str;
+  }
+
+  // Converts all typedArraySize() elements to EleTy, which should be
+  // able to represent them; a straight copy when the type and byte order
+  // match.
+  template<typename EleTy>
+  void typedArrayGetValues( EleTy *values ) const
+  {
+    assert( isTypedArray() );
+    uint8_t const *p = reinterpret_cast<uint8_t const *>( body.data() );
+    switch ( eleType )
+    {
+      case EleType_UInt8:
+        GetValues<EleTy, uint8_t, uint8_t>( p, count, littleEndian, values );
+        break;
+      case EleType_SInt8:
+        GetValues<EleTy, int8_t, uint8_t>( p, count, littleEndian, values );
+        break;
+      case EleType_UInt16:
+        GetValues<EleTy, uint16_t, uint16_t>( p, count, littleEndian, values );
+        break;
+      case EleType_SInt16:
+        GetValues<EleTy, int16_t, uint16_t>( p, count, littleEndian, values );
+        break;
+      case EleType_UInt32:
+        GetValues<EleTy, uint32_t, uint32_t>( p, count, littleEndian, values );
+        break;
+      case EleType_SInt32:
+        GetValues<EleTy, int32_t, uint32_t>( p, count, littleEndian, values );
+        break;
+      case EleType_UInt64:
+        GetValues<EleTy, uint64_t, uint64_t>( p, count, littleEndian, values );
+        break;
+      case EleType_SInt64:
+        GetValues<EleTy, int64_t, uint64_t>( p, count, littleEndian, values );
+        break;
+      case EleType_Float16:
+        for ( size_t i = 0; i < count; ++i, p += 2 )
+          values[i] = EleTy(
+            CBORFloat16ToFloat64( LoadUInt<uint16_t>( p, littleEndian ) )
+            );
+        break;
+      case EleType_Float32:
+        GetValues<EleTy, float, uint32_t>( p, count, littleEndian, values );
+        break;
+      case EleType_Float64:
+        GetValues<EleTy, double, uint64_t>( p, count, littleEndian, values );
+        break;
+    }
+  }
+
+protected:
+
+  template<typename StringTy>
+  void appendChunksTo( StringTy &string ) const
+  {
+    if ( !chunked )
+    {
+      string.append( body.data(), body.size() );
+      return;
+    }
+    // Chunks were validated by ConsumeItem
+    CBORStrWithLoc ds( body );
+    while ( !ds.empty() )
+    {
+      uint8_t major;
+      uint64_t arg;
+      bool indefinite;
+      ConsumeHead( ds, major, arg, indefinite );
+      string.append( ds.data(), size_t( arg ) );
+      ds.drop( size_t( arg ) );
+    }
+  }
+
+  static const uint64_t SInt64Max = ~uint64_t( 0 ) >> 1;
+
+  static void ThrowTruncated( CBORStrWithLoc const &ds )
+  {
+    throw CBORMalformedException(
+      ds.offset + ds.size(),
+      FTL_STR("unexpected end of input")
+      );
+  }
+
+  // Reads the first byte of an item and its argument.  indefinite is set
+  // for an indefinite length (or, for major type 7, a break).
+  static void ConsumeHead(
+    CBORStrWithLoc &ds,
+    uint8_t &major,
+    uint64_t &arg,
+    bool &indefinite
+    )
+  {
+    if ( ds.empty() )
+      ThrowTruncated( ds );
+    uint8_t const initial = ds.front();
+    major = initial >> 5;
+    uint8_t const info = initial & 0x1F;
+    indefinite = false;
+    if ( info < CBORInfo_UInt8 )
+    {
+      arg = info;
+      ds.drop();
+    }
+    else if ( info <= CBORInfo_UInt64 )
+    {
+      size_t const size = size_t( 1 ) << ( info - CBORInfo_UInt8 );
+      if ( ds.size() <= size )
+        ThrowTruncated( ds );
+      uint8_t const *p = reinterpret_cast<uint8_t const *>( ds.data() );
+      arg = 0;
+      for ( size_t i = 1; i <= size; ++i )
+        arg = arg << 8 | p[i];
+      ds.drop( 1 + size );
+    }
+    else if ( info == CBORInfo_Indefinite
+      && major != CBORMajor_UInt
+      && major != CBORMajor_NegInt
+      && major != CBORMajor_Tag )
+    {
+      arg = 0;
+      indefinite = true;
+      ds.drop();
+    }
+    else
+      throw CBORMalformedException(
+        ds.offset,
+        FTL_STR("invalid additional information")
+        );
+  }
+
+  // Skips over count complete items, iteratively so that deep nesting
+  // cannot exhaust the stack
+  static void SkipItems( CBORStrWithLoc &ds, uint64_t count )
+  {
+    // Each item takes at least a byte, so count never exceeds the bytes
+    // left; outer holds the counts of enclosing definite lists while
+    // inside an indefinite one
+    std::vector<uint64_t> outer;
+    uint64_t left = count;
+    for (;;)
+    {
+      if ( left == 0 )
+      {
+        if ( outer.empty() )
+          return;
+        if ( ds.empty() )
+          ThrowTruncated( ds );
+        if ( ds.front() == CBORBreak )
+        {
+          ds.drop();
+          left = outer.back();
+          outer.pop_back();
+          continue;
+        }
+        left = 1;
+      }
+
+      size_t const offset = ds.offset;
+      uint8_t major;
+      uint64_t arg;
+      bool indefinite;
+      ConsumeHead( ds, major, arg, indefinite );
+      --left;
+      switch ( major )
+      {
+        case CBORMajor_Bytes:
+        case CBORMajor_Text:
+          if ( indefinite )
+          {
+            outer.push_back( left );
+            left = 0;
+          }
+          else
+          {
+            if ( arg > ds.size() )
+              ThrowTruncated( ds );
+            ds.drop( size_t( arg ) );
+          }
+          break;
+
+        case CBORMajor_Array:
+        case CBORMajor_Map:
+          if ( indefinite )
+          {
+            outer.push_back( left );
+            left = 0;
+          }
+          else
+          {
+            uint64_t const itemsPerEntry = major == CBORMajor_Map? 2: 1;
+            if ( left > ds.size()
+              || arg > ( ds.size() - left ) / itemsPerEntry )
+              ThrowTruncated( ds );
+            left += arg * itemsPerEntry;
+          }
+          break;
+
+        case CBORMajor_Tag:
+          // The tagged item follows
+          ++left;
+          break;
+
+        case CBORMajor_Simple:
+          if ( indefinite )
+            throw CBORMalformedException( offset, FTL_STR("unexpected break") );
+          break;
+
+        default:
+          break;
+      }
+    }
+  }
+
+  static void ConsumeTypedArray(
+    CBORStrWithLoc &ds,
+    size_t offset,
+    uint64_t tag,
+    CBOREnt &ent
+    )
+  {
+    bool const isFloat = ( tag >> 4 ) & 1;
+    bool const isSigned = ( tag >> 3 ) & 1;
+    uint32_t const log2Size = uint32_t( tag & 3 );
+    // Tag 76 (little-endian signed bytes) is reserved, as are 128-bit
+    // floats, which have no C++ type
+    if ( isFloat? log2Size == 3: isSigned && log2Size == 0 && ( tag & 4 ) )
+      throw CBORMalformedException(
+        offset,
+        FTL_STR("unsupported typed array")
+        );
+    ent.type = Type_TypedArray;
+    ent.littleEndian = ( tag >> 2 ) & 1;
+    size_t eleSize;
+    if ( isFloat )
+    {
+      ent.eleType = EleType( EleType_Float16 + log2Size );
+      eleSize = size_t( 2 ) << log2Size;
+    }
+    else
+    {
+      ent.eleType = EleType( 2 * log2Size + ( isSigned? 1: 0 ) );
+      eleSize = size_t( 1 ) << log2Size;
+    }
+
+    size_t const bytesOffset = ds.offset;
+    uint8_t major;
+    uint64_t arg;
+    bool indefinite;
+    ConsumeHead( ds, major, arg, indefinite );
+    if ( major != CBORMajor_Bytes || indefinite )
+      throw CBORMalformedException(
+        bytesOffset,
+        FTL_STR("typed array must be a definite length byte string")
+        );
+    if ( arg > ds.size() )
+      ThrowTruncated( ds );
+    if ( arg % eleSize != 0 )
+      throw CBORMalformedException(
+        bytesOffset,
+        FTL_STR("typed array length is not a multiple of the element size")
+        );
+    ent.body = CBORStrWithLoc( StrRef( ds.data(), size_t( arg ) ), ds.offset );
+    ent.count = size_t( arg ) / eleSize;
+    ds.drop( size_t( arg ) );
+  }
+
+  static void ConsumeItem( CBORStrWithLoc &ds, CBOREnt &ent )
+  {
+    CBORStrWithLoc const start = ds;
+    ent.chunked = false;
+    ent.count = 0;
+
+    size_t offset;
+    uint8_t initial;
+    uint8_t major;
+    uint64_t arg;
+    bool indefinite;
+    for (;;)
+    {
+      if ( ds.empty() )
+        ThrowTruncated( ds );
+      offset = ds.offset;
+      initial = ds.front();
+      ConsumeHead( ds, major, arg, indefinite );
+      if ( major != CBORMajor_Tag )
+        break;
+      if ( arg >= CBORTag_TypedArrayFirst && arg <= CBORTag_TypedArrayLast )
+      {
+        ConsumeTypedArray( ds, offset, arg, ent );
+        ent.raw = CBORStrWithLoc(
+          StrRef( start.data(), ds.offset - start.offset ),
+          start.offset
+          );
+        return;
+      }
+    }
+
+    CBORStrWithLoc const bodyStart = ds;
+    switch ( major )
+    {
+      case CBORMajor_UInt:
+        if ( arg <= SInt64Max )
+        {
+          ent.type = Type_SInt64;
+          ent.value.sint64 = int64_t( arg );
+        }
+        else
+        {
+          ent.type = Type_UInt64;
+          ent.value.uint64 = arg;
+        }
+        break;
+
+      case CBORMajor_NegInt:
+        if ( arg > SInt64Max )
+          throw CBORMalformedException(
+            offset,
+            FTL_STR("integer out of range")
+            );
+        ent.type = Type_SInt64;
+        ent.value.sint64 = -1 - int64_t( arg );
+        break;
+
+      case CBORMajor_Bytes:
+      case CBORMajor_Text:
+        ent.type = major == CBORMajor_Text? Type_String: Type_Bytes;
+        if ( !indefinite )
+        {
+          if ( arg > ds.size() )
+            ThrowTruncated( ds );
+          ds.drop( size_t( arg ) );
+          ent.body = CBORStrWithLoc(
+            StrRef( bodyStart.data(), size_t( arg ) ),
+            bodyStart.offset
+            );
+          break;
+        }
+        ent.chunked = true;
+        for (;;)
+        {
+          if ( ds.empty() )
+            ThrowTruncated( ds );
+          if ( ds.front() == CBORBreak )
+            break;
+          size_t const chunkOffset = ds.offset;
+          uint8_t chunkMajor;
+          bool chunkIndefinite;
+          ConsumeHead( ds, chunkMajor, arg, chunkIndefinite );
+          if ( chunkMajor != major || chunkIndefinite )
+            throw CBORMalformedException(
+              chunkOffset,
+              FTL_STR("invalid string chunk")
+              );
+          if ( arg > ds.size() )
+            ThrowTruncated( ds );
+          ds.drop( size_t( arg ) );
+        }
+        ent.body = CBORStrWithLoc(
+          StrRef( bodyStart.data(), ds.offset - bodyStart.offset ),
+          bodyStart.offset
+          );
+        ds.drop();
+        break;
+
+      case CBORMajor_Array:
+      case CBORMajor_Map:
+      {
+        ent.type = major == CBORMajor_Map? Type_Object: Type_Array;
+        uint64_t const itemsPerEntry = major == CBORMajor_Map? 2: 1;
+        if ( !indefinite )
+        {
+          if ( arg > ds.size() / itemsPerEntry )
+            ThrowTruncated( ds );
+          SkipItems( ds, arg * itemsPerEntry );
+          ent.count = size_t( arg );
+          ent.body = CBORStrWithLoc(
+            StrRef( bodyStart.data(), ds.offset - bodyStart.offset ),
+            bodyStart.offset
+            );
+          break;
+        }
+        for (;;)
+        {
+          if ( ds.empty() )
+            ThrowTruncated( ds );
+          if ( ds.front() == CBORBreak )
+            break;
+          SkipItems( ds, 1 );
+          if ( itemsPerEntry == 2 )
+          {
+            if ( !ds.empty() && ds.front() == CBORBreak )
+              throw CBORMalformedException(
+                ds.offset,
+                FTL_STR("missing value")
+                );
+            SkipItems( ds, 1 );
+          }
+          ++ent.count;
+        }
+        ent.body = CBORStrWithLoc(
+          StrRef( bodyStart.data(), ds.offset - bodyStart.offset ),
+          bodyStart.offset
+          );
+        ds.drop();
+      }
+      break;
+
+      case CBORMajor_Simple:
+        if ( indefinite )
+          throw CBORMalformedException( offset, FTL_STR("unexpected break") );
+        switch ( initial )
+        {
+          case CBORFalse:
+          case CBORTrue:
+            ent.type = Type_Boolean;
+            ent.value.boolean = initial == CBORTrue;
+            break;
+
+          case CBORNull:
+          case CBORUndefined:
+            ent.type = Type_Null;
+            break;
+
+          case CBORFloat16:
+            ent.type = Type_Float64;
+            ent.value.float64 = CBORFloat16ToFloat64( uint16_t( arg ) );
+            break;
+
+          case CBORFloat32:
+          {
+            uint32_t const bits = uint32_t( arg );
+            float float32;
+            memcpy( &float32, &bits, sizeof( float32 ) );
+            ent.type = Type_Float64;
+            ent.value.float64 = float32;
+          }
+          break;
+
+          case CBORFloat64:
+            ent.type = Type_Float64;
+            memcpy( &ent.value.float64, &arg, sizeof( arg ) );
+            break;
+
+          default:
+            throw CBORMalformedException(
+              offset,
+              FTL_STR("unsupported simple value")
+              );
+        }
+        break;
+    }
+
+    ent.raw = CBORStrWithLoc(
+      StrRef( start.data(), ds.offset - start.offset ),
+      start.offset
+      );
+  }
+
+  template<typename UIntTy>
+  static UIntTy LoadUInt( uint8_t const *p, bool littleEndian )
+  {
+    UIntTy value = 0;
+    if ( littleEndian )
+    {
+      for ( size_t i = sizeof( UIntTy ); i-- > 0; )
+        value = UIntTy( value << 8 | p[i] );
+    }
+    else
+    {
+      for ( size_t i = 0; i < sizeof( UIntTy ); ++i )
+        value = UIntTy( value << 8 | p[i] );
+    }
+    return value;
+  }
+
+  template<typename EleTy, typename RawTy, typename UIntTy>
+  static void GetValues(
+    uint8_t const *p,
+    size_t count,
+    bool littleEndian,
+    EleTy *values
+    )
+  {
+#if defined(FTL_LITTLE_ENDIAN)
+    if ( ( littleEndian || sizeof( RawTy ) == 1 )
+      && CBORSameType<EleTy, RawTy>::Value )
+    {
+      if ( count > 0 )
+        memcpy( values, p, count * sizeof( EleTy ) );
+      return;
+    }
+#endif
+    for ( size_t i = 0; i < count; ++i, p += sizeof( UIntTy ) )
+    {
+      UIntTy const bits = LoadUInt<UIntTy>( p, littleEndian );
+      RawTy raw;
+      memcpy( &raw, &bits, sizeof( raw ) );
+      values[i] = EleTy( raw );
+    }
+  }
+
+private:
+
+  CBORStrWithLoc raw;
+  CBORStrWithLoc body;
+  Type type;
+  EleType eleType;
+  size_t count;
+  bool chunked;
+  bool littleEndian;
+  union
+  {
+    bool boolean;
+    int64_t sint64;
+    uint64_t uint64;
+    double float64;
+  } value;
+};
+
+class CBORDec
+{
+public:
+
+  CBORDec( CBORStrWithLoc &ds )
+    : m_ds( ds ) {}
+
+  bool getNext( CBOREnt &ent )
+  {
+    if ( m_ds.empty() )
+      return false;
+
+    CBOREnt::ConsumeItem( m_ds, ent );
+
+    return true;
+  }
+
+private:
+
+  CBORStrWithLoc &m_ds;
+};
+
+class CBORObjectDec
+{
+public:
+
+  CBORObjectDec( CBOREnt const &objectEnt )
+    : m_ds( objectEnt.body )
+  {
+    if ( !objectEnt.isObject() )
+      throw CBORMalformedException(
+        objectEnt.getOffset(),
+        FTL_STR("expected map")
+        );
+  }
+
+  bool getNext( CBOREnt &key, CBOREnt &value )
+  {
+    if ( m_ds.empty() )
+      return false;
+
+    CBOREnt::ConsumeItem( m_ds, key );
+    CBOREnt::ConsumeItem( m_ds, value );
+
+    return true;
+  }
+
+private:
+
+  CBORStrWithLoc m_ds;
+};
+
+class CBORArrayDec
+{
+public:
+
+  CBORArrayDec( CBOREnt const &arrayEnt )
+    : m_ds( arrayEnt.body )
+  {
+    if ( !arrayEnt.isArray() )
+      throw CBORMalformedException(
+        arrayEnt.getOffset(),
+        FTL_STR("expected array")
+        );
+  }
+
+  bool getNext( CBOREnt &element )
+  {
+    if ( m_ds.empty() )
+      return false;
+
+    CBOREnt::ConsumeItem( m_ds, element );
+
+    return true;
+  }
+
+private:
+
+  CBORStrWithLoc m_ds;
+};
+
+FTL_NAMESPACE_END
@@ -0,0 +1,513 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/ArrayRef.h>
+#include <FTL/CBOR.h>
+#include <FTL/JSONException.h>
+
+#include <assert.h>
+#include <float.h>
+#include <string>
+
+//
+// Usage mirrors JSONEnc:
+//
+// std::string string;
+// {
+//   CBOREnc enc( string );
+//   CBORObjectEnc objectEnc( enc );
+//   CBOREnc memberEnc( objectEnc, FTL_STR("key") );
+//   CBORArrayEnc arrayEnc( memberEnc );
+//   CBOREnc elementEnc( arrayEnc );
+//   CBORSInt32Enc( elementEnc, 42 );
+// }
+//
+// Objects and arrays are written with an indefinite length and closed
+// by their destructors, unless their size is passed up front, in which
+// case exactly that many members or elements must follow.  StringTy can
+// be any of the JSONEncSink output sinks.
+//
+
+FTL_NAMESPACE_BEGIN
+
+template<typename StringTy = std::string>
+class CBORElementEnc;
+
+template<typename StringTy = std::string>
+class CBORNullEnc;
+
+template<typename StringTy = std::string>
+class CBORBooleanEnc;
+
+template<typename StringTy = std::string>
+class CBORSInt32Enc;
+
+template<typename StringTy = std::string>
+class CBORSInt64Enc;
+
+template<typename StringTy = std::string>
+class CBORUInt64Enc;
+
+template<typename StringTy = std::string>
+class CBORFloat64Enc;
+
+template<typename StringTy = std::string>
+class CBORStringEnc;
+
+template<typename StringTy = std::string>
+class CBORBytesEnc;
+
+template<typename StringTy = std::string>
+class CBORTypedArrayEnc;
+
+template<typename StringTy = std::string>
+class CBORListEnc;
+
+template<typename StringTy = std::string>
+class CBORObjectEnc;
+
+template<typename StringTy = std::string>
+class CBORArrayEnc;
+
+template<typename StringTy = std::string>
+class CBOREnc
+{
+  friend class CBORElementEnc<StringTy>;
+  friend class CBORNullEnc<StringTy>;
+  friend class CBORBooleanEnc<StringTy>;
+  friend class CBORSInt32Enc<StringTy>;
+  friend class CBORSInt64Enc<StringTy>;
+  friend class CBORUInt64Enc<StringTy>;
+  friend class CBORFloat64Enc<StringTy>;
+  friend class CBORStringEnc<StringTy>;
+  friend class CBORBytesEnc<StringTy>;
+  friend class CBORTypedArrayEnc<StringTy>;
+  friend class CBORListEnc<StringTy>;
+  friend class CBORObjectEnc<StringTy>;
+  friend class CBORArrayEnc<StringTy>;
+
+  CBOREnc( CBOREnc const &that );
+  CBOREnc &operator=( CBOREnc const &that );
+
+public:
+
+  CBOREnc( StringTy &string )
+    : m_string( string )
+    , m_used( false )
+  {
+  }
+
+  CBOREnc( CBORObjectEnc<StringTy> &objectEnc, StrRef key )
+    : m_string( objectEnc.getEnc().m_string )
+    , m_used( false )
+  {
+    objectEnc.inc();
+    appendHead( CBORMajor_Text, key.size() );
+    append( key );
+  }
+
+  CBOREnc( CBORArrayEnc<StringTy> &arrayEnc )
+    : m_string( arrayEnc.getEnc().m_string )
+    , m_used( false )
+  {
+    arrayEnc.inc();
+  }
+
+  ~CBOREnc() {}
+
+protected:
+
+  void use()
+  {
+    if ( m_used )
+      throw JSONEncodingErrorException();
+    m_used = true;
+  }
+
+  void append( char ch )
+    { m_string += ch; }
+
+  void append( StrRef str )
+    { m_string += str; }
+
+  // The first byte of an item and its argument, using the shortest
+  // encoding of the argument
+  void appendHead( CBORMajor major, uint64_t arg )
+  {
+    char buf[9];
+    uint8_t const mt = uint8_t( major << 5 );
+    size_t size;
+    if ( arg < CBORInfo_UInt8 )
+    {
+      buf[0] = char( mt | arg );
+      size = 1;
+    }
+    else if ( arg <= 0xFF )
+    {
+      buf[0] = char( mt | CBORInfo_UInt8 );
+      size = 2;
+    }
+    else if ( arg <= 0xFFFF )
+    {
+      buf[0] = char( mt | CBORInfo_UInt16 );
+      size = 3;
+    }
+    else if ( arg <= 0xFFFFFFFF )
+    {
+      buf[0] = char( mt | CBORInfo_UInt32 );
+      size = 5;
+    }
+    else
+    {
+      buf[0] = char( mt | CBORInfo_UInt64 );
+      size = 9;
+    }
+    for ( size_t i = size - 1; i > 0; --i, arg >>= 8 )
+      buf[i] = char( arg & 0xFF );
+    append( StrRef( buf, size ) );
+  }
+
+  void appendIndefinite( CBORMajor major )
+    { append( char( major << 5 | CBORInfo_Indefinite ) ); }
+
+  // Stores the bytes of values in little-endian order
+  template<typename EleTy>
+  void appendLE( ArrayRef<EleTy> values )
+  {
+#if defined(FTL_LITTLE_ENDIAN)
+    append(
+      StrRef(
+        reinterpret_cast<char const *>( values.data() ),
+        values.size() * sizeof( EleTy )
+        )
+      );
+#else
+    for ( size_t i = 0; i < values.size(); ++i )
+    {
+      char bytes[sizeof( EleTy )];
+      memcpy( bytes, &values[i], sizeof( EleTy ) );
+      for ( size_t j = sizeof( EleTy ); j-- > 0; )
+        append( bytes[j] );
+    }
+#endif
+  }
+
+private:
+
+  StringTy &m_string;
+  bool m_used;
+};
+
+template<typename StringTy>
+class CBORElementEnc
+{
+  CBORElementEnc( CBORElementEnc const &that );
+  CBORElementEnc &operator=( CBORElementEnc const &that );
+
+protected:
+
+  CBORElementEnc( CBOREnc<StringTy> &enc )
+    { enc.use(); }
+};
+
+template<typename StringTy>
+class CBORNullEnc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORNullEnc( CBOREnc<StringTy> &enc )
+    : CBORElementEnc<StringTy>( enc )
+    { enc.append( char( CBORNull ) ); }
+};
+
+template<typename StringTy>
+class CBORBooleanEnc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORBooleanEnc(
+    CBOREnc<StringTy> &enc,
+    bool value
+    )
+    : CBORElementEnc<StringTy>( enc )
+    { enc.append( char( value? CBORTrue: CBORFalse ) ); }
+};
+
+template<typename StringTy>
+class CBORSInt64Enc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORSInt64Enc(
+    CBOREnc<StringTy> &enc,
+    int64_t value
+    )
+    : CBORElementEnc<StringTy>( enc )
+  {
+    // Negative n is stored as -1 - n, which for int64_t is ~n
+    if ( value < 0 )
+      enc.appendHead( CBORMajor_NegInt, ~uint64_t( value ) );
+    else
+      enc.appendHead( CBORMajor_UInt, uint64_t( value ) );
+  }
+};
+
+template<typename StringTy>
+class CBORSInt32Enc : public CBORSInt64Enc<StringTy>
+{
+public:
+
+  CBORSInt32Enc(
+    CBOREnc<StringTy> &enc,
+    int32_t value
+    )
+    : CBORSInt64Enc<StringTy>( enc, value ) {}
+};
+
+template<typename StringTy>
+class CBORUInt64Enc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORUInt64Enc(
+    CBOREnc<StringTy> &enc,
+    uint64_t value
+    )
+    : CBORElementEnc<StringTy>( enc )
+    { enc.appendHead( CBORMajor_UInt, value ); }
+};
+
+// Uses the shortest of half, single and double precision that holds
+// value exactly, so decoding always gives back the same double.
+template<typename StringTy>
+class CBORFloat64Enc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORFloat64Enc(
+    CBOREnc<StringTy> &enc,
+    double value
+    )
+    : CBORElementEnc<StringTy>( enc )
+  {
+    char buf[9];
+    size_t size;
+    // Finite values beyond FLT_MAX are not convertible to float
+    double const magnitude = value < 0? -value: value;
+    bool const inFloat32Range = magnitude <= FLT_MAX
+      || magnitude == std::numeric_limits<double>::infinity();
+    float const float32 = inFloat32Range? float( value ): 0.0f;
+    uint16_t float16;
+    if ( value != value )
+    {
+      buf[0] = char( CBORFloat16 );
+      buf[1] = char( 0x7E );
+      buf[2] = char( 0x00 );
+      size = 3;
+    }
+    else if ( !inFloat32Range || double( float32 ) != value )
+    {
+      uint64_t bits;
+      memcpy( &bits, &value, sizeof( bits ) );
+      buf[0] = char( CBORFloat64 );
+      for ( size_t i = 8; i > 0; --i, bits >>= 8 )
+        buf[i] = char( bits & 0xFF );
+      size = 9;
+    }
+    else if ( !CBORFloat32ToFloat16( float32, float16 ) )
+    {
+      uint32_t bits;
+      memcpy( &bits, &float32, sizeof( bits ) );
+      buf[0] = char( CBORFloat32 );
+      for ( size_t i = 4; i > 0; --i, bits >>= 8 )
+        buf[i] = char( bits & 0xFF );
+      size = 5;
+    }
+    else
+    {
+      buf[0] = char( CBORFloat16 );
+      buf[1] = char( float16 >> 8 );
+      buf[2] = char( float16 & 0xFF );
+      size = 3;
+    }
+    enc.append( StrRef( buf, size ) );
+  }
+};
+
+// Writes the concatenation of strs, separated by delim, as one UTF-8
+// text string
+template<typename StringTy>
+class CBORStringEnc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORStringEnc(
+    CBOREnc<StringTy> &enc,
+    ArrayRef<StrRef> strs,
+    StrRef delim = StrRef()
+    )
+    : CBORElementEnc<StringTy>( enc )
+  {
+    size_t size = 0;
+    ArrayRef<StrRef>::IT const itBegin = strs.begin();
+    ArrayRef<StrRef>::IT const itEnd = strs.end();
+    for ( ArrayRef<StrRef>::IT it = itBegin; it != itEnd; ++it )
+    {
+      if ( it != itBegin )
+        size += delim.size();
+      size += it->size();
+    }
+    enc.appendHead( CBORMajor_Text, size );
+    for ( ArrayRef<StrRef>::IT it = itBegin; it != itEnd; ++it )
+    {
+      if ( it != itBegin )
+        enc.append( delim );
+      enc.append( *it );
+    }
+  }
+};
+
+template<typename StringTy>
+class CBORBytesEnc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORBytesEnc(
+    CBOREnc<StringTy> &enc,
+    StrRef bytes
+    )
+    : CBORElementEnc<StringTy>( enc )
+  {
+    enc.appendHead( CBORMajor_Bytes, bytes.size() );
+    enc.append( bytes );
+  }
+};
+
+// Writes a whole numeric array at once, as an RFC 8746 typed array: a
+// tag for the element type followed by the elements as packed
+// little-endian bytes
+template<typename StringTy>
+class CBORTypedArrayEnc : public CBORElementEnc<StringTy>
+{
+public:
+
+  CBORTypedArrayEnc(
+    CBOREnc<StringTy> &enc,
+    ArrayRef<int32_t> values
+    )
+    : CBORElementEnc<StringTy>( enc )
+    { append( enc, CBORTag_SInt32LEArray, values ); }
+
+  CBORTypedArrayEnc(
+    CBOREnc<StringTy> &enc,
+    ArrayRef<float> values
+    )
+    : CBORElementEnc<StringTy>( enc )
+    { append( enc, CBORTag_Float32LEArray, values ); }
+
+  CBORTypedArrayEnc(
+    CBOREnc<StringTy> &enc,
+    ArrayRef<double> values
+    )
+    : CBORElementEnc<StringTy>( enc )
+    { append( enc, CBORTag_Float64LEArray, values ); }
+
+private:
+
+  template<typename EleTy>
+  static void append(
+    CBOREnc<StringTy> &enc,
+    uint64_t tag,
+    ArrayRef<EleTy> values
+    )
+  {
+    enc.appendHead( CBORMajor_Tag, tag );
+    enc.appendHead( CBORMajor_Bytes, values.size() * sizeof( EleTy ) );
+    enc.appendLE( values );
+  }
+};
+
+template<typename StringTy>
+class CBORListEnc : public CBORElementEnc<StringTy>
+{
+  friend class CBOREnc<StringTy>;
+
+protected:
+
+  static const uint64_t Indefinite = ~uint64_t( 0 );
+
+  CBORListEnc( CBOREnc<StringTy> &enc, uint64_t size )
+    : CBORElementEnc<StringTy>( enc )
+    , m_enc( enc )
+    , m_count( 0 )
+    , m_size( size )
+    {}
+
+  CBOREnc<StringTy> &getEnc()
+    { return m_enc; }
+
+  void inc()
+    { ++m_count; }
+
+  // Writes the head of the list, given the major type
+  void begin( CBORMajor major )
+  {
+    if ( m_size == Indefinite )
+      m_enc.appendIndefinite( major );
+    else
+      m_enc.appendHead( major, m_size );
+  }
+
+  void fin()
+  {
+    if ( m_size == Indefinite )
+      m_enc.append( char( CBORBreak ) );
+    else
+      assert( m_count == m_size );
+  }
+
+private:
+
+  CBOREnc<StringTy> &m_enc;
+  uint64_t m_count;
+  uint64_t m_size;
+};
+
+template<typename StringTy>
+class CBORObjectEnc : public CBORListEnc<StringTy>
+{
+public:
+
+  CBORObjectEnc( CBOREnc<StringTy> &enc )
+    : CBORListEnc<StringTy>( enc, CBORListEnc<StringTy>::Indefinite )
+    { this->begin( CBORMajor_Map ); }
+
+  CBORObjectEnc( CBOREnc<StringTy> &enc, uint64_t size )
+    : CBORListEnc<StringTy>( enc, size )
+    { this->begin( CBORMajor_Map ); }
+
+  ~CBORObjectEnc()
+    { this->fin(); }
+};
+
+template<typename StringTy>
+class CBORArrayEnc : public CBORListEnc<StringTy>
+{
+public:
+
+  CBORArrayEnc( CBOREnc<StringTy> &enc )
+    : CBORListEnc<StringTy>( enc, CBORListEnc<StringTy>::Indefinite )
+    { this->begin( CBORMajor_Array ); }
+
+  CBORArrayEnc( CBOREnc<StringTy> &enc, uint64_t size )
+    : CBORListEnc<StringTy>( enc, size )
+    { this->begin( CBORMajor_Array ); }
+
+  ~CBORArrayEnc()
+    { this->fin(); }
+};
+
+FTL_NAMESPACE_END
@@ -0,0 +1,283 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/CBORDec.h>
+#include <FTL/CBOREnc.h>
+#include <FTL/JSONValue.h>
+
+#include <string>
+#include <vector>
+
+//
+// Conversion between JSONValue trees and CBOR.  Round trips are exact:
+// integers stay integers, doubles keep every bit, and typed arrays
+// (JSONSInt32Array, JSONFloat32Array and JSONFloat64Array) are stored as
+// RFC 8746 typed arrays and come back as the same typed arrays.
+//
+// std::string cbor = CBOREncodeValue( jsonValue );
+// OwnedPtr<JSONValue> copy( CBORDecodeValue( cbor ) );
+//
+// CBOR beyond the JSON data model is mapped onto it: integers that do
+// not fit an int32_t become doubles, byte strings become strings holding
+// the raw bytes, and typed arrays of other element types are widened to
+// int32_t (8 and 16-bit integers) or double.  Map keys must be strings.
+//
+
+FTL_NAMESPACE_BEGIN
+
+template<typename EleTy>
+inline JSONValue *CBORCreateTypedArray( CBOREnt const &ent )
+{
+  OwnedPtr< JSONTypedArray<EleTy> > result( new JSONTypedArray<EleTy> );
+  size_t const size = ent.typedArraySize();
+  if ( size != 0 )
+    ent.typedArrayGetValues( result->resizeValues( size ) );
+  return result.take();
+}
+
+inline JSONValue *CBORCreateValue(
+  CBOREnt const &ent,
+  JSONDecStats *stats = 0
+  )
+{
+  JSONValue *result;
+  switch ( ent.getType() )
+  {
+    case CBOREnt::Type_Null:
+      result = new JSONNull();
+      break;
+
+    case CBOREnt::Type_Boolean:
+      result = new JSONBoolean( ent.booleanValue() );
+      break;
+
+    case CBOREnt::Type_SInt64:
+    {
+      int64_t const value = ent.sint64Value();
+      if ( value == int64_t( int32_t( value ) ) )
+        result = new JSONSInt32( int32_t( value ) );
+      else
+        result = new JSONFloat64( double( value ) );
+    }
+    break;
+
+    case CBOREnt::Type_UInt64:
+      result = new JSONFloat64( double( ent.uint64Value() ) );
+      break;
+
+    case CBOREnt::Type_Float64:
+      result = new JSONFloat64( ent.float64Value() );
+      break;
+
+    case CBOREnt::Type_String:
+    case CBOREnt::Type_Bytes:
+    {
+      std::string string;
+      if ( ent.isString() )
+        ent.stringAppendTo( string );
+      else
+        ent.bytesAppendTo( string );
+      result = JSONString::CreateWithSwap( string );
+    }
+    break;
+
+    case CBOREnt::Type_Object:
+    {
+      OwnedPtr<JSONObject> object( new JSONObject() );
+      object->reserve( ent.objectSize() );
+
+      CBORObjectDec objectDec( ent );
+      CBOREnt keyEnt, valueEnt;
+      std::string chunkedKey;
+      while ( objectDec.getNext( keyEnt, valueEnt ) )
+      {
+        if ( !keyEnt.isString() )
+          throw CBORMalformedException(
+            keyEnt.getOffset(),
+            FTL_STR("map key is not a string")
+            );
+        StrRef key;
+        if ( !keyEnt.stringIsChunked() )
+          key = keyEnt.stringValue();
+        else
+        {
+          chunkedKey.clear();
+          keyEnt.stringAppendTo( chunkedKey );
+          key = chunkedKey;
+        }
+        JSONValue *value = CBORCreateValue( valueEnt, stats );
+        if ( !object->insert( key, value ) )
+        {
+          delete value;
+          throw CBORMalformedException(
+            keyEnt.getOffset(),
+            FTL_STR("duplicate key")
+            );
+        }
+      }
+
+      result = object.take();
+    }
+    break;
+
+    case CBOREnt::Type_Array:
+    {
+      OwnedPtr<JSONArray> array( new JSONArray() );
+      array->reserve( ent.arraySize() );
+
+      CBORArrayDec arrayDec( ent );
+      CBOREnt elementEnt;
+      while ( arrayDec.getNext( elementEnt ) )
+        array->push_back( CBORCreateValue( elementEnt, stats ) );
+
+      result = array.take();
+    }
+    break;
+
+    case CBOREnt::Type_TypedArray:
+      switch ( ent.typedArrayEleType() )
+      {
+        case CBOREnt::EleType_UInt8:
+        case CBOREnt::EleType_SInt8:
+        case CBOREnt::EleType_UInt16:
+        case CBOREnt::EleType_SInt16:
+        case CBOREnt::EleType_SInt32:
+          result = CBORCreateTypedArray<int32_t>( ent );
+          break;
+        case CBOREnt::EleType_Float16:
+        case CBOREnt::EleType_Float32:
+          result = CBORCreateTypedArray<float>( ent );
+          break;
+        default:
+          result = CBORCreateTypedArray<double>( ent );
+          break;
+      }
+      break;
+
+    default:
+      throw JSONInternalErrorException();
+      break;
+  }
+  if ( stats )
+    stats->addValue( result );
+  return result;
+}
+
+// Decodes the next item of ds, or returns 0 at the end of the input
+inline JSONValue *CBORDecodeValue(
+  CBORStrWithLoc &ds,
+  JSONDecStats *stats = 0
+  )
+{
+  CBORDec dec( ds );
+  CBOREnt ent;
+  OwnedPtr<JSONValue> result;
+  if ( dec.getNext( ent ) )
+    result = CBORCreateValue( ent, stats );
+  return result.take();
+}
+
+inline JSONValue *CBORDecodeValue(
+  StrRef str,
+  JSONDecStats *stats = 0
+  )
+{
+  CBORStrWithLoc ds( str );
+  return CBORDecodeValue( ds, stats );
+}
+
+// A JSONVisit handler; objects and arrays are written with their sizes
+// up front.
+template<typename StringTy>
+class CBORValueEnc
+{
+public:
+
+  CBORValueEnc( CBOREnc<StringTy> &enc )
+    : m_enc( enc ) {}
+
+  void operator()( JSONNull const & )
+    { CBORNullEnc<StringTy> nullEnc( m_enc ); }
+
+  void operator()( JSONBoolean const &jsonBoolean )
+    { CBORBooleanEnc<StringTy> booleanEnc( m_enc, jsonBoolean.getValue() ); }
+
+  void operator()( JSONSInt32 const &jsonSInt32 )
+    { CBORSInt32Enc<StringTy> sint32Enc( m_enc, jsonSInt32.getValue() ); }
+
+  void operator()( JSONFloat64 const &jsonFloat64 )
+    { CBORFloat64Enc<StringTy> float64Enc( m_enc, jsonFloat64.getValue() ); }
+
+  void operator()( JSONString const &jsonString )
+  {
+    CBORStringEnc<StringTy> stringEnc(
+      m_enc, StrRef( jsonString.getValue() )
+      );
+  }
+
+  template<typename EleTy>
+  void operator()( JSONTypedArray<EleTy> const &jsonArray )
+  {
+    CBORTypedArrayEnc<StringTy> typedArrayEnc(
+      m_enc, jsonArray.getValues()
+      );
+  }
+
+  void operator()( JSONArray const &jsonArray )
+  {
+    CBORArrayEnc<StringTy> arrayEnc( m_enc, jsonArray.size() );
+    for ( JSONArray::const_iterator it = jsonArray.begin();
+      it != jsonArray.end(); ++it )
+    {
+      CBOREnc<StringTy> elementEnc( arrayEnc );
+      CBORValueEnc<StringTy> elementValueEnc( elementEnc );
+      JSONVisit( *it, elementValueEnc );
+    }
+  }
+
+  void operator()( JSONObject const &jsonObject )
+  {
+    CBORObjectEnc<StringTy> objectEnc( m_enc, jsonObject.size() );
+    for ( JSONObject::const_iterator it = jsonObject.begin();
+      it != jsonObject.end(); ++it )
+    {
+      CBOREnc<StringTy> memberEnc( objectEnc, it->first );
+      CBORValueEnc<StringTy> memberValueEnc( memberEnc );
+      JSONVisit( it->second, memberValueEnc );
+    }
+  }
+
+private:
+
+  CBOREnc<StringTy> &m_enc;
+};
+
+template<typename StringTy>
+inline void CBOREncodeValue(
+  JSONValue const *jsonValue,
+  CBOREnc<StringTy> &enc
+  )
+{
+  CBORValueEnc<StringTy> valueEnc( enc );
+  JSONVisit( jsonValue, valueEnc );
+}
+
+// With selfDescribe, the output starts with CBORSelfDescribeStr(), which
+// marks it as CBOR (see CBORIsSelfDescribed)
+inline std::string CBOREncodeValue(
+  JSONValue const *jsonValue,
+  bool selfDescribe = false
+  )
+{
+  std::string result;
+  if ( selfDescribe )
+    result += CBORSelfDescribeStr();
+  CBOREnc<std::string> enc( result );
+  CBOREncodeValue( jsonValue, enc );
+  return result;
+}
+
+FTL_NAMESPACE_END
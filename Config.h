@@ -60,6 +60,23 @@ inline float roundf( float x ) { return floorf(x+0.5f); }
 # error "Unsupported platform"
 #endif
 
+// SIMD support
+#if defined(__SSE2__) \
+  || defined(_M_X64) \
+  || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+# define FTL_SSE2
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+# define FTL_SSSE3
+#endif
+
+// Byte order
+#if defined(FTL_PLATFORM_WINDOWS) \
+  || defined(__x86_64) || defined(__i386__) \
+  || ( defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ )
+# define FTL_LITTLE_ENDIAN
+#endif
+
 // Build settings
 #if defined(NDEBUG)
 # define FTL_BUILD_RELEASE
@@ -0,0 +1,783 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Bits.h>
+
+#include <stdint.h>
+#include <string.h>
+
+FTL_NAMESPACE_BEGIN
+
+// Buffer size needed by FmtFloat64
+static const uint32_t FmtFloat64MaxLength = 32;
+
+// A "do-it-yourself" floating point number f * 2^e, as used by Grisu
+struct FmtFloat64DiyFp
+{
+  uint64_t f;
+  int e;
+
+  FmtFloat64DiyFp() {}
+  FmtFloat64DiyFp( uint64_t theF, int theE )
+    : f( theF ), e( theE ) {}
+
+  FmtFloat64DiyFp operator-( FmtFloat64DiyFp const &that ) const
+    { return FmtFloat64DiyFp( f - that.f, e ); }
+
+  // The upper 64 bits of the 128-bit product, rounded
+  FmtFloat64DiyFp operator*( FmtFloat64DiyFp const &that ) const
+  {
+    uint64_t const M32 = 0xFFFFFFFFu;
+    uint64_t a = f >> 32, b = f & M32;
+    uint64_t c = that.f >> 32, d = that.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = ( bd >> 32 ) + ( ad & M32 ) + ( bc & M32 );
+    tmp += uint64_t( 1 ) << 31;
+    return FmtFloat64DiyFp(
+      ac + ( ad >> 32 ) + ( bc >> 32 ) + ( tmp >> 32 ),
+      e + that.e + 64
+      );
+  }
+
+  FmtFloat64DiyFp normalized() const
+  {
+    uint32_t shift = BitsCountLeadingZeros( f );
+    return FmtFloat64DiyFp( f << shift, e - int( shift ) );
+  }
+
+  // The cached power 10^-k whose product with a number of binary
+  // exponent e has a binary exponent in [-60, -32]
+  static FmtFloat64DiyFp CachedPower( int e, int &k )
+  {
+    static uint64_t const fs[] =
+    {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76),
+    UINT64_C(0x8b16fb203055ac76), UINT64_C(0xcf42894a5dce35ea),
+    UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+    UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f),
+    UINT64_C(0xbe5691ef416bd60c), UINT64_C(0x8dd01fad907ffc3c),
+    UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d),
+    UINT64_C(0x823c12795db6ce57), UINT64_C(0xc21094364dfb5637),
+    UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+    UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5),
+    UINT64_C(0xb23867fb2a35b28e), UINT64_C(0x84c8d4dfd2c63f3b),
+    UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6),
+    UINT64_C(0xf3e2f893dec3f126), UINT64_C(0xb5b5ada8aaff80b8),
+    UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+    UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd),
+    UINT64_C(0xa6dfbd9fb8e5b88f), UINT64_C(0xf8a95fcf88747d94),
+    UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac),
+    UINT64_C(0xe45c10c42a2b3b06), UINT64_C(0xaa242499697392d3),
+    UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+    UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c),
+    UINT64_C(0x9c40000000000000), UINT64_C(0xe8d4a51000000000),
+    UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70),
+    UINT64_C(0xd5d238a4abe98068), UINT64_C(0x9f4f2726179a2245),
+    UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+    UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a),
+    UINT64_C(0x924d692ca61be758), UINT64_C(0xda01ee641a708dea),
+    UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2),
+    UINT64_C(0xc83553c5c8965d3d), UINT64_C(0x952ab45cfa97a0b3),
+    UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+    UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece),
+    UINT64_C(0x88fcf317f22241e2), UINT64_C(0xcc20ce9bd35c78a5),
+    UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c),
+    UINT64_C(0xbb764c4ca7a44410), UINT64_C(0x8bab8eefb6409c1a),
+    UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+    UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429),
+    UINT64_C(0x80444b5e7aa7cf85), UINT64_C(0xbf21e44003acdd2d),
+    UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9),
+    UINT64_C(0xaf87023b9bf0ee6b)
+    };
+    static int16_t const es[] =
+    {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+    };
+
+    // ceil( ( -61 - e ) * log10( 2 ) ), offset by 348 to stay positive
+    double dk = ( -61 - e ) * 0.30102999566398114 + 347;
+    int ik = int( dk );
+    if ( dk - ik > 0.0 )
+      ++ik;
+    uint32_t index = uint32_t( ( ik >> 3 ) + 1 );
+    k = -( -348 + int( index << 3 ) );
+    return FmtFloat64DiyFp( fs[index], es[index] );
+  }
+};
+
+// Moves the last digit down while that brings the digits closer to w,
+// then checks that they are certainly the closest to w that lie within
+// the rounding interval (Grisu3's round_weed).  Fails when the error of
+// the scaled values, which is within unit, leaves a doubt.
+inline bool FmtFloat64GrisuRoundWeed(
+  char *digits,
+  uint32_t count,
+  uint64_t distanceTooHighW,
+  uint64_t unsafeInterval,
+  uint64_t rest,
+  uint64_t tenKappa,
+  uint64_t unit
+  )
+{
+  uint64_t const smallDistance = distanceTooHighW - unit;
+  uint64_t const bigDistance = distanceTooHighW + unit;
+  while ( rest < smallDistance && unsafeInterval - rest >= tenKappa
+    && ( rest + tenKappa < smallDistance
+      || smallDistance - rest >= rest + tenKappa - smallDistance ) )
+  {
+    --digits[count - 1];
+    rest += tenKappa;
+  }
+  if ( rest < bigDistance && unsafeInterval - rest >= tenKappa
+    && ( rest + tenKappa < bigDistance
+      || bigDistance - rest > rest + tenKappa - bigDistance ) )
+    return false;
+  return 2 * unit <= rest && rest <= unsafeInterval - 4 * unit;
+}
+
+// Generates the shortest digits within the interval between low and
+// high, which lies around w (Grisu3); adds the power of ten they are
+// scaled by to k.  Fails, for about 0.5% of doubles, when the digits
+// might not be the shortest or the closest.
+inline bool FmtFloat64GrisuDigits(
+  FmtFloat64DiyFp const &low,
+  FmtFloat64DiyFp const &w,
+  FmtFloat64DiyFp const &high,
+  char *digits,
+  uint32_t &count,
+  int &k
+  )
+{
+  static uint64_t const pow10[] =
+  {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+    UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+    UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000)
+  };
+
+  // low, w and high are each within one unit of the exact values, so
+  // digits within the unsafe interval might not read back while digits
+  // within the interval shrunk by two units certainly do
+  uint64_t unit = 1;
+  FmtFloat64DiyFp const tooLow( low.f - unit, low.e );
+  FmtFloat64DiyFp const tooHigh( high.f + unit, high.e );
+  uint64_t unsafeInterval = ( tooHigh - tooLow ).f;
+  FmtFloat64DiyFp const one( uint64_t( 1 ) << -w.e, w.e );
+  uint32_t p1 = uint32_t( tooHigh.f >> -one.e );
+  uint64_t p2 = tooHigh.f & ( one.f - 1 );
+  count = 0;
+
+  int kappa = 1;
+  while ( kappa < 10 && p1 >= pow10[kappa] )
+    ++kappa;
+
+  while ( kappa > 0 )
+  {
+    uint32_t div = uint32_t( pow10[kappa - 1] );
+    uint32_t d = p1 / div;
+    p1 %= div;
+    if ( d || count )
+      digits[count++] = char( '0' + d );
+    --kappa;
+    uint64_t rest = ( uint64_t( p1 ) << -one.e ) + p2;
+    if ( rest < unsafeInterval )
+    {
+      k += kappa;
+      return FmtFloat64GrisuRoundWeed(
+        digits, count, ( tooHigh - w ).f, unsafeInterval, rest,
+        uint64_t( div ) << -one.e, unit
+        );
+    }
+  }
+
+  for (;;)
+  {
+    p2 *= 10;
+    unit *= 10;
+    unsafeInterval *= 10;
+    char d = char( p2 >> -one.e );
+    if ( d || count )
+      digits[count++] = char( '0' + d );
+    p2 &= one.f - 1;
+    --kappa;
+    if ( p2 < unsafeInterval )
+    {
+      k += kappa;
+      return FmtFloat64GrisuRoundWeed(
+        digits, count, ( tooHigh - w ).f * unit, unsafeInterval, p2,
+        one.f, unit
+        );
+    }
+  }
+}
+
+// An unsigned integer of up to 1280 bits, which holds the scaled values
+// of FmtFloat64Exact for any double
+struct FmtFloat64Bignum
+{
+  static const uint32_t MaxWords = 40;
+
+  // Least significant first
+  uint32_t words[MaxWords];
+  uint32_t size;
+
+  explicit FmtFloat64Bignum( uint64_t value )
+    : size( 0 )
+  {
+    while ( value )
+    {
+      words[size++] = uint32_t( value );
+      value >>= 32;
+    }
+  }
+
+  void mulSmall( uint32_t m )
+  {
+    uint64_t carry = 0;
+    for ( uint32_t i = 0; i < size; ++i )
+    {
+      carry += uint64_t( words[i] ) * m;
+      words[i] = uint32_t( carry );
+      carry >>= 32;
+    }
+    if ( carry )
+      words[size++] = uint32_t( carry );
+  }
+
+  void shiftLeft( uint32_t bits )
+  {
+    if ( size == 0 )
+      return;
+    uint32_t const wordShift = bits / 32, bitShift = bits % 32;
+    uint32_t top = bitShift? words[size - 1] >> ( 32 - bitShift ): 0;
+    for ( uint32_t i = size; i-- > 0; )
+    {
+      uint32_t word = words[i] << bitShift;
+      if ( bitShift && i > 0 )
+        word |= words[i - 1] >> ( 32 - bitShift );
+      words[i + wordShift] = word;
+    }
+    for ( uint32_t i = 0; i < wordShift; ++i )
+      words[i] = 0;
+    size += wordShift;
+    if ( top )
+      words[size++] = top;
+  }
+
+  void add( FmtFloat64Bignum const &that )
+  {
+    uint64_t carry = 0;
+    uint32_t i = 0;
+    for ( ; i < that.size; ++i )
+    {
+      carry += uint64_t( i < size? words[i]: 0 ) + that.words[i];
+      words[i] = uint32_t( carry );
+      carry >>= 32;
+    }
+    for ( ; carry && i < size; ++i )
+    {
+      carry += words[i];
+      words[i] = uint32_t( carry );
+      carry >>= 32;
+    }
+    if ( i > size )
+      size = i;
+    if ( carry )
+      words[size++] = uint32_t( carry );
+  }
+
+  // Requires *this >= that
+  void sub( FmtFloat64Bignum const &that )
+  {
+    uint64_t borrow = 0;
+    for ( uint32_t i = 0; i < size; ++i )
+    {
+      uint64_t diff = uint64_t( words[i] )
+        - ( i < that.size? that.words[i]: 0 ) - borrow;
+      words[i] = uint32_t( diff );
+      borrow = diff >> 63;
+    }
+    while ( size > 0 && words[size - 1] == 0 )
+      --size;
+  }
+
+  static int Compare( FmtFloat64Bignum const &a, FmtFloat64Bignum const &b )
+  {
+    if ( a.size != b.size )
+      return a.size < b.size? -1: 1;
+    for ( uint32_t i = a.size; i-- > 0; )
+      if ( a.words[i] != b.words[i] )
+        return a.words[i] < b.words[i]? -1: 1;
+    return 0;
+  }
+
+  // Compares a + b with c
+  static int ComparePlus(
+    FmtFloat64Bignum const &a,
+    FmtFloat64Bignum const &b,
+    FmtFloat64Bignum const &c
+    )
+  {
+    FmtFloat64Bignum sum( a );
+    sum.add( b );
+    return Compare( sum, c );
+  }
+};
+
+// Writes the shortest digits that read back as the positive, finite
+// value, the closest to it if there are several, using exact integer
+// arithmetic (Burger and Dybvig's free-format algorithm); the value is
+// then digits * 10^k.  Returns the digit count, at most 17.
+inline uint32_t FmtFloat64Exact( double value, char *digits, int &k )
+{
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  uint64_t const hiddenBit = UINT64_C(0x0010000000000000);
+  int biasedExponent = int( bits >> 52 ) & 0x7FF;
+  uint64_t f = bits & ( hiddenBit - 1 );
+  int e;
+  if ( biasedExponent != 0 )
+  {
+    f += hiddenBit;
+    e = biasedExponent - 1075;
+  }
+  else
+    e = -1074;
+  // Round-to-even reading accepts digits exactly halfway to a neighbour
+  bool const even = ( f & 1 ) == 0;
+  uint32_t const lowerCloser = f == hiddenBit && biasedExponent > 1;
+
+  // value = r / s, and the halfway points to the neighbouring doubles
+  // are ( r - mMinus ) / s and ( r + mPlus ) / s
+  FmtFloat64Bignum r( f ), s( 1 ), mPlus( 1 ), mMinus( 1 );
+  if ( e >= 0 )
+  {
+    r.shiftLeft( uint32_t( e ) + 1 + lowerCloser );
+    s.shiftLeft( 1 + lowerCloser );
+    mPlus.shiftLeft( uint32_t( e ) + lowerCloser );
+    mMinus.shiftLeft( uint32_t( e ) );
+  }
+  else
+  {
+    r.shiftLeft( 1 + lowerCloser );
+    s.shiftLeft( uint32_t( -e ) + 1 + lowerCloser );
+    mPlus.shiftLeft( lowerCloser );
+  }
+
+  // An estimate of ceil( log10( value ) ) that is at most one too low,
+  // raised until the upper halfway point is below 10^k
+  int const log2 = e + 63 - int( BitsCountLeadingZeros( f ) );
+  double dk = log2 * 0.30102999566398114 - 1e-10;
+  k = int( dk );
+  if ( dk - k > 0.0 )
+    ++k;
+  if ( k >= 0 )
+  {
+    for ( int i = 0; i < k; ++i )
+      s.mulSmall( 10 );
+  }
+  else
+  {
+    for ( int i = 0; i < -k; ++i )
+    {
+      r.mulSmall( 10 );
+      mPlus.mulSmall( 10 );
+      mMinus.mulSmall( 10 );
+    }
+  }
+  for (;;)
+  {
+    int c = FmtFloat64Bignum::ComparePlus( r, mPlus, s );
+    if ( even? c < 0: c <= 0 )
+      break;
+    s.mulSmall( 10 );
+    ++k;
+  }
+
+  uint32_t count = 0;
+  for (;;)
+  {
+    r.mulSmall( 10 );
+    mPlus.mulSmall( 10 );
+    mMinus.mulSmall( 10 );
+    char d = 0;
+    while ( FmtFloat64Bignum::Compare( r, s ) >= 0 )
+    {
+      r.sub( s );
+      ++d;
+    }
+    int cLow = FmtFloat64Bignum::Compare( r, mMinus );
+    int cHigh = FmtFloat64Bignum::ComparePlus( r, mPlus, s );
+    bool low = even? cLow <= 0: cLow < 0;
+    bool high = even? cHigh >= 0: cHigh > 0;
+    if ( !low && !high )
+    {
+      digits[count++] = char( '0' + d );
+      continue;
+    }
+    if ( low && high )
+    {
+      // Both d and d + 1 read back; take the closer, or the even one
+      r.shiftLeft( 1 );
+      int cHalf = FmtFloat64Bignum::Compare( r, s );
+      if ( cHalf > 0 || ( cHalf == 0 && ( d & 1 ) ) )
+        ++d;
+    }
+    else if ( high )
+      ++d;
+    digits[count++] = char( '0' + d );
+    break;
+  }
+  k -= int( count );
+  return count;
+}
+
+// Writes the positive, finite value's first precision (1 to 17)
+// significant digits, rounded from its exact binary value half to even as
+// printf does, using the exact integer arithmetic of FmtFloat64Exact; the
+// rounded value is then digits * 10^k.  Returns the digit count, which
+// is precision.
+inline uint32_t FmtFloat64ExactPrecision(
+  double value,
+  uint32_t precision,
+  char *digits,
+  int &k
+  )
+{
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  uint64_t const hiddenBit = UINT64_C(0x0010000000000000);
+  int biasedExponent = int( bits >> 52 ) & 0x7FF;
+  uint64_t f = bits & ( hiddenBit - 1 );
+  int e;
+  if ( biasedExponent != 0 )
+  {
+    f += hiddenBit;
+    e = biasedExponent - 1075;
+  }
+  else
+    e = -1074;
+
+  // value = r / s
+  FmtFloat64Bignum r( f ), s( 1 );
+  if ( e >= 0 )
+    r.shiftLeft( uint32_t( e ) );
+  else
+    s.shiftLeft( uint32_t( -e ) );
+
+  // An estimate of ceil( log10( value ) ) that is at most one too low,
+  // raised until value is below 10^k
+  int const log2 = e + 63 - int( BitsCountLeadingZeros( f ) );
+  double dk = log2 * 0.30102999566398114 - 1e-10;
+  k = int( dk );
+  if ( dk - k > 0.0 )
+    ++k;
+  if ( k >= 0 )
+  {
+    for ( int i = 0; i < k; ++i )
+      s.mulSmall( 10 );
+  }
+  else
+  {
+    for ( int i = 0; i < -k; ++i )
+      r.mulSmall( 10 );
+  }
+  while ( FmtFloat64Bignum::Compare( r, s ) >= 0 )
+  {
+    s.mulSmall( 10 );
+    ++k;
+  }
+
+  for ( uint32_t count = 0; count < precision; ++count )
+  {
+    r.mulSmall( 10 );
+    char d = 0;
+    while ( FmtFloat64Bignum::Compare( r, s ) >= 0 )
+    {
+      r.sub( s );
+      ++d;
+    }
+    digits[count] = char( '0' + d );
+  }
+  k -= int( precision );
+
+  // The remainder r / s is the fraction of a unit in the last digit
+  r.shiftLeft( 1 );
+  int cHalf = FmtFloat64Bignum::Compare( r, s );
+  if ( cHalf > 0 || ( cHalf == 0 && ( digits[precision - 1] & 1 ) ) )
+  {
+    uint32_t i = precision;
+    while ( i > 0 && digits[i - 1] == '9' )
+      digits[--i] = '0';
+    if ( i == 0 )
+    {
+      digits[0] = '1';
+      ++k;
+    }
+    else
+      ++digits[i - 1];
+  }
+  return precision;
+}
+
+// Writes the shortest digits that read back as the positive, finite
+// value, the closest to it if there are several, which is then
+// digits * 10^k; returns the digit count, at most 17.  Grisu3 gives the
+// digits, except in the rare cases it can't be sure of them, which fall
+// back on FmtFloat64Exact.
+inline uint32_t FmtFloat64Shortest( double value, char *digits, int &k )
+{
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  uint64_t const hiddenBit = UINT64_C(0x0010000000000000);
+  int biasedExponent = int( bits >> 52 ) & 0x7FF;
+  uint64_t significand = bits & ( hiddenBit - 1 );
+  FmtFloat64DiyFp v;
+  if ( biasedExponent != 0 )
+    v = FmtFloat64DiyFp( significand + hiddenBit, biasedExponent - 1075 );
+  else
+    v = FmtFloat64DiyFp( significand, -1074 );
+
+  // Halfway to the neighbouring doubles; the one below is closer when
+  // we are at a power of two
+  FmtFloat64DiyFp plus =
+    FmtFloat64DiyFp( ( v.f << 1 ) + 1, v.e - 1 ).normalized();
+  FmtFloat64DiyFp minus = v.f == hiddenBit && biasedExponent > 1
+    ? FmtFloat64DiyFp( ( v.f << 2 ) - 1, v.e - 2 )
+    : FmtFloat64DiyFp( ( v.f << 1 ) - 1, v.e - 1 );
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  FmtFloat64DiyFp const c = FmtFloat64DiyFp::CachedPower( plus.e, k );
+  FmtFloat64DiyFp const w = v.normalized() * c;
+  FmtFloat64DiyFp const wp = plus * c;
+  FmtFloat64DiyFp const wm = minus * c;
+  uint32_t count;
+  if ( FmtFloat64GrisuDigits( wm, w, wp, digits, count, k ) )
+    return count;
+  return FmtFloat64Exact( value, digits, k );
+}
+
+// Formats value as printf's %.16g does in the C locale, except that it
+// uses the fewest significant digits that read back as the same double,
+// or when precision is non-zero, exactly as %.<precision>g does; a
+// precision above 17, which is enough for any double to read back, is
+// taken as 17.  Writes at most FmtFloat64MaxLength characters to buf,
+// without a terminating null, and returns their count.
+inline uint32_t FmtFloat64(
+  double value,
+  char *buf,
+  uint32_t precision = 0
+  )
+{
+  char *p = buf;
+
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  if ( bits >> 63 )
+  {
+    *p++ = '-';
+    bits &= ~( uint64_t( 1 ) << 63 );
+    memcpy( &value, &bits, sizeof( bits ) );
+  }
+
+  if ( ( bits >> 52 ) == 0x7FF )
+  {
+    memcpy( p, ( bits << 12 )? "nan": "inf", 3 );
+    return uint32_t( p + 3 - buf );
+  }
+
+  if ( bits == 0 )
+  {
+    *p++ = '0';
+    return uint32_t( p - buf );
+  }
+
+  char digits[20];
+  int k;
+  if ( precision > 17 )
+    precision = 17;
+  uint32_t count = precision > 0
+    ? FmtFloat64ExactPrecision( value, precision, digits, k )
+    : FmtFloat64Shortest( value, digits, k );
+  while ( count > 1 && digits[count - 1] == '0' )
+  {
+    --count;
+    ++k;
+  }
+
+  // Decimal exponent of the leading digit
+  int exponent = k + int( count ) - 1;
+  int maxExponent = precision > 0? int( precision ): 16;
+  if ( exponent < -4 || exponent >= maxExponent )
+  {
+    *p++ = digits[0];
+    if ( count > 1 )
+    {
+      *p++ = '.';
+      memcpy( p, &digits[1], count - 1 );
+      p += count - 1;
+    }
+    *p++ = 'e';
+    if ( exponent < 0 )
+    {
+      *p++ = '-';
+      exponent = -exponent;
+    }
+    else
+      *p++ = '+';
+    if ( exponent >= 100 )
+    {
+      *p++ = char( '0' + exponent / 100 );
+      exponent %= 100;
+    }
+    *p++ = char( '0' + exponent / 10 );
+    *p++ = char( '0' + exponent % 10 );
+  }
+  else if ( exponent >= 0 )
+  {
+    uint32_t intCount = uint32_t( exponent ) + 1;
+    if ( count <= intCount )
+    {
+      memcpy( p, digits, count );
+      p += count;
+      memset( p, '0', intCount - count );
+      p += intCount - count;
+    }
+    else
+    {
+      memcpy( p, digits, intCount );
+      p += intCount;
+      *p++ = '.';
+      memcpy( p, &digits[intCount], count - intCount );
+      p += count - intCount;
+    }
+  }
+  else
+  {
+    *p++ = '0';
+    *p++ = '.';
+    memset( p, '0', uint32_t( -exponent - 1 ) );
+    p += -exponent - 1;
+    memcpy( p, digits, count );
+    p += count;
+  }
+
+  return uint32_t( p - buf );
+}
+
+// Formats value as ECMAScript's Number.prototype.toString does, which is
+// how RFC 8785 canonical JSON writes numbers: "5" rather than "5.0",
+// "1e+21", "1e-7", and "0" for -0.  Writes at most
+// FmtFloat64MaxLength characters to buf, without a terminating null, and
+// returns their count.
+inline uint32_t FmtFloat64JS( double value, char *buf )
+{
+  char *p = buf;
+
+  uint64_t bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  if ( ( bits << 1 ) == 0 )
+  {
+    *p++ = '0';
+    return uint32_t( p - buf );
+  }
+  if ( ( bits >> 52 & 0x7FF ) == 0x7FF && ( bits << 12 ) )
+  {
+    memcpy( p, "NaN", 3 );
+    return 3;
+  }
+  if ( bits >> 63 )
+  {
+    *p++ = '-';
+    bits &= ~( uint64_t( 1 ) << 63 );
+    memcpy( &value, &bits, sizeof( bits ) );
+  }
+  if ( ( bits >> 52 ) == 0x7FF )
+  {
+    memcpy( p, "Infinity", 8 );
+    return uint32_t( p + 8 - buf );
+  }
+
+  char digits[20];
+  int k;
+  int count = int( FmtFloat64Shortest( value, digits, k ) );
+  while ( count > 1 && digits[count - 1] == '0' )
+  {
+    --count;
+    ++k;
+  }
+
+  // The value is 0.digits * 10^n
+  int n = k + count;
+  if ( count <= n && n <= 21 )
+  {
+    memcpy( p, digits, size_t( count ) );
+    p += count;
+    memset( p, '0', size_t( n - count ) );
+    p += n - count;
+  }
+  else if ( 0 < n && n <= 21 )
+  {
+    memcpy( p, digits, size_t( n ) );
+    p += n;
+    *p++ = '.';
+    memcpy( p, &digits[n], size_t( count - n ) );
+    p += count - n;
+  }
+  else if ( -6 < n && n <= 0 )
+  {
+    *p++ = '0';
+    *p++ = '.';
+    memset( p, '0', size_t( -n ) );
+    p += -n;
+    memcpy( p, digits, size_t( count ) );
+    p += count;
+  }
+  else
+  {
+    *p++ = digits[0];
+    if ( count > 1 )
+    {
+      *p++ = '.';
+      memcpy( p, &digits[1], size_t( count - 1 ) );
+      p += count - 1;
+    }
+    *p++ = 'e';
+    int exponent = n - 1;
+    if ( exponent < 0 )
+    {
+      *p++ = '-';
+      exponent = -exponent;
+    }
+    else
+      *p++ = '+';
+    if ( exponent >= 100 )
+      *p++ = char( '0' + exponent / 100 );
+    if ( exponent >= 10 )
+      *p++ = char( '0' + exponent / 10 % 10 );
+    *p++ = char( '0' + exponent % 10 );
+  }
+
+  return uint32_t( p - buf );
+}
+
+FTL_NAMESPACE_END
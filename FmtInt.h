@@ -0,0 +1,107 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Bits.h>
+
+#include <stdint.h>
+#include <string.h>
+
+FTL_NAMESPACE_BEGIN
+
+// Buffer size needed by FmtSInt32, FmtSInt64 and FmtUInt64
+static const uint32_t FmtIntMaxLength = 20;
+
+inline uint32_t FmtUInt64DigitCount( uint64_t value )
+{
+  static uint64_t const pow10[] =
+  {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+    UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+    UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+    UINT64_C(10000000000), UINT64_C(100000000000),
+    UINT64_C(1000000000000), UINT64_C(10000000000000),
+    UINT64_C(100000000000000), UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000), UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+  };
+  // 1233 / 4096 approximates log10( 2 ); the estimate is exact or one
+  // low.  Or-ing in 1 makes zero one digit long without changing the
+  // others.
+  value |= 1;
+  uint32_t bitCount = 64 - BitsCountLeadingZeros( value );
+  uint32_t count = ( bitCount * 1233 ) >> 12;
+  return count + ( value >= pow10[count] );
+}
+
+// Writes the count decimal digits of value backwards from end, two at a
+// time
+inline void FmtUInt64Digits( uint64_t value, char *end )
+{
+  static char const pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+  while ( value >= UINT64_C(0x100000000) )
+  {
+    uint32_t pair = uint32_t( value % 100 ) * 2;
+    value /= 100;
+    end -= 2;
+    end[0] = pairs[pair];
+    end[1] = pairs[pair + 1];
+  }
+  // 32-bit division is much cheaper on 32-bit targets
+  uint32_t value32 = uint32_t( value );
+  while ( value32 >= 100 )
+  {
+    uint32_t pair = ( value32 % 100 ) * 2;
+    value32 /= 100;
+    end -= 2;
+    end[0] = pairs[pair];
+    end[1] = pairs[pair + 1];
+  }
+  if ( value32 >= 10 )
+  {
+    end -= 2;
+    end[0] = pairs[value32 * 2];
+    end[1] = pairs[value32 * 2 + 1];
+  }
+  else
+    *--end = char( '0' + value32 );
+}
+
+// Writes value in decimal to buf, which needs FmtIntMaxLength bytes,
+// without a terminating null; returns the length written.
+inline uint32_t FmtUInt64( uint64_t value, char *buf )
+{
+  uint32_t count = FmtUInt64DigitCount( value );
+  FmtUInt64Digits( value, buf + count );
+  return count;
+}
+
+inline uint32_t FmtSInt64( int64_t value, char *buf )
+{
+  if ( value < 0 )
+  {
+    *buf = '-';
+    return 1 + FmtUInt64( uint64_t( 0 ) - uint64_t( value ), buf + 1 );
+  }
+  return FmtUInt64( uint64_t( value ), buf );
+}
+
+inline uint32_t FmtSInt32( int32_t value, char *buf )
+{
+  return FmtSInt64( value, buf );
+}
+
+FTL_NAMESPACE_END
@@ -0,0 +1,104 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Hash64Bytes.h>
+#include <FTL/StrRef.h>
+
+#include <stdint.h>
+#include <string.h>
+
+FTL_NAMESPACE_BEGIN
+
+// XXH64: a fast, well-distributed 64-bit (non-cryptographic) hash, fed
+// incrementally.  Results match the reference XXH64 for the same seed and
+// are the same on every platform.
+//
+// Hash64 hash( seed );
+// hash.update( part1 );
+// hash.update( part2 );
+// uint64_t digest = hash.digest();
+//
+class Hash64
+{
+public:
+
+  Hash64( uint64_t seed = 0 )
+    : m_totalSize( 0 )
+    , m_bufferSize( 0 )
+  {
+    Hash64Core::InitAccs( seed, m_acc );
+  }
+
+  void update( char ch )
+  {
+    m_buffer[m_bufferSize++] = uint8_t( ch );
+    if ( m_bufferSize == 32 )
+    {
+      consumeStripe( m_buffer );
+      m_bufferSize = 0;
+    }
+    ++m_totalSize;
+  }
+
+  void update( StrRef str )
+  {
+    uint8_t const *p = reinterpret_cast<uint8_t const *>( str.data() );
+    size_t size = str.size();
+    m_totalSize += size;
+
+    if ( m_bufferSize > 0 )
+    {
+      size_t count = 32 - m_bufferSize;
+      if ( count > size )
+        count = size;
+      memcpy( m_buffer + m_bufferSize, p, count );
+      m_bufferSize += uint32_t( count );
+      p += count;
+      size -= count;
+      if ( m_bufferSize < 32 )
+        return;
+      consumeStripe( m_buffer );
+      m_bufferSize = 0;
+    }
+
+    for ( ; size >= 32; p += 32, size -= 32 )
+      consumeStripe( p );
+
+    if ( size > 0 )
+    {
+      memcpy( m_buffer, p, size );
+      m_bufferSize = uint32_t( size );
+    }
+  }
+
+  uint64_t digest() const
+  {
+    uint64_t h;
+    if ( m_totalSize >= 32 )
+      h = Hash64Core::MergeAccs( m_acc );
+    else
+      h = m_acc[2] + Hash64Core::Prime5;
+    h += m_totalSize;
+    return Hash64Core::Finish( h, m_buffer, m_buffer + m_bufferSize );
+  }
+
+private:
+
+  void consumeStripe( uint8_t const *p )
+    { Hash64Core::ConsumeStripe( m_acc, p ); }
+
+  uint64_t m_acc[4];
+  uint64_t m_totalSize;
+  uint8_t m_buffer[32];
+  uint32_t m_bufferSize;
+};
+
+inline uint64_t Hash64Str( StrRef str, uint64_t seed = 0 )
+{
+  return Hash64Bytes( str.data(), str.size(), seed );
+}
+
+FTL_NAMESPACE_END
@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+FTL_NAMESPACE_BEGIN
+
+// The XXH64 primitives, shared by Hash64Bytes and the incremental Hash64
+struct Hash64Core
+{
+  static const uint64_t Prime1 = UINT64_C(0x9E3779B185EBCA87);
+  static const uint64_t Prime2 = UINT64_C(0xC2B2AE3D27D4EB4F);
+  static const uint64_t Prime3 = UINT64_C(0x165667B19E3779F9);
+  static const uint64_t Prime4 = UINT64_C(0x85EBCA77C2B2AE63);
+  static const uint64_t Prime5 = UINT64_C(0x27D4EB2F165667C5);
+
+  static uint64_t Rotl( uint64_t value, uint32_t bits )
+    { return ( value << bits ) | ( value >> ( 64 - bits ) ); }
+
+  static uint64_t Round( uint64_t acc, uint64_t input )
+  {
+    acc += input * Prime2;
+    acc = Rotl( acc, 31 );
+    return acc * Prime1;
+  }
+
+  // Little-endian loads, so that digests do not depend on the platform
+  static uint64_t Read64( uint8_t const *p )
+  {
+#if defined(FTL_LITTLE_ENDIAN)
+    uint64_t value;
+    memcpy( &value, p, 8 );
+    return value;
+#else
+    return uint64_t( Read32( p ) ) | ( uint64_t( Read32( p + 4 ) ) << 32 );
+#endif
+  }
+
+  static uint32_t Read32( uint8_t const *p )
+  {
+#if defined(FTL_LITTLE_ENDIAN)
+    uint32_t value;
+    memcpy( &value, p, 4 );
+    return value;
+#else
+    return uint32_t( p[0] ) | ( uint32_t( p[1] ) << 8 )
+      | ( uint32_t( p[2] ) << 16 ) | ( uint32_t( p[3] ) << 24 );
+#endif
+  }
+
+  static void InitAccs( uint64_t seed, uint64_t acc[4] )
+  {
+    acc[0] = seed + Prime1 + Prime2;
+    acc[1] = seed + Prime2;
+    acc[2] = seed;
+    acc[3] = seed - Prime1;
+  }
+
+  static void ConsumeStripe( uint64_t acc[4], uint8_t const *p )
+  {
+    acc[0] = Round( acc[0], Read64( p ) );
+    acc[1] = Round( acc[1], Read64( p + 8 ) );
+    acc[2] = Round( acc[2], Read64( p + 16 ) );
+    acc[3] = Round( acc[3], Read64( p + 24 ) );
+  }
+
+  static uint64_t MergeAccs( uint64_t const acc[4] )
+  {
+    uint64_t h = Rotl( acc[0], 1 ) + Rotl( acc[1], 7 )
+      + Rotl( acc[2], 12 ) + Rotl( acc[3], 18 );
+    for ( uint32_t i = 0; i < 4; ++i )
+    {
+      h ^= Round( 0, acc[i] );
+      h = h * Prime1 + Prime4;
+    }
+    return h;
+  }
+
+  // Mixes in the last (fewer than 32) bytes, [p, pEnd), and avalanches
+  static uint64_t Finish( uint64_t h, uint8_t const *p, uint8_t const *pEnd )
+  {
+    for ( ; pEnd - p >= 8; p += 8 )
+    {
+      h ^= Round( 0, Read64( p ) );
+      h = Rotl( h, 27 ) * Prime1 + Prime4;
+    }
+    if ( pEnd - p >= 4 )
+    {
+      h ^= uint64_t( Read32( p ) ) * Prime1;
+      h = Rotl( h, 23 ) * Prime2 + Prime3;
+      p += 4;
+    }
+    for ( ; p != pEnd; ++p )
+    {
+      h ^= uint64_t( *p ) * Prime5;
+      h = Rotl( h, 11 ) * Prime1;
+    }
+
+    h ^= h >> 33;
+    h *= Prime2;
+    h ^= h >> 29;
+    h *= Prime3;
+    h ^= h >> 32;
+    return h;
+  }
+};
+
+// XXH64 of [data, data + size) in one call: the same digest as Hash64,
+// without its buffering, for short keys such as hash table lookups
+inline uint64_t Hash64Bytes(
+  void const *data,
+  size_t size,
+  uint64_t seed = 0
+  )
+{
+  uint8_t const *p = static_cast<uint8_t const *>( data );
+  uint8_t const *const pEnd = p + size;
+
+  uint64_t h;
+  if ( size >= 32 )
+  {
+    uint64_t acc[4];
+    Hash64Core::InitAccs( seed, acc );
+    for ( ; pEnd - p >= 32; p += 32 )
+      Hash64Core::ConsumeStripe( acc, p );
+    h = Hash64Core::MergeAccs( acc );
+  }
+  else
+    h = seed + Hash64Core::Prime5;
+  h += uint64_t( size );
+
+  return Hash64Core::Finish( h, p, pEnd );
+}
+
+FTL_NAMESPACE_END
@@ -4,13 +4,18 @@
 
 #pragma once
 
+#include <FTL/Bits.h>
 #include <FTL/Config.h>
 #include <FTL/JSONException.h>
 #include <FTL/StrRef.h>
+#include <FTL/StrToNum.h>
 
 #include <algorithm>
 #include <assert.h>
 #include <stdint.h>
+#if defined(FTL_SSE2)
+# include <emmintrin.h>
+#endif
 
 FTL_NAMESPACE_BEGIN
 
@@ -69,6 +74,13 @@ struct JSONStrWithLoc
     }
   }
 
+  // Drops count characters known to be ASCII and not newlines
+  void dropInLine( size_t count )
+  {
+    column += uint32_t( count );
+    str = str.drop_front( count );
+  }
+
   void drop_back( size_t count )
     { str = str.drop_back( count ); }
 };
@@ -76,12 +88,14 @@ struct JSONStrWithLoc
 class JSONDec;
 class JSONObjectDec;
 class JSONArrayDec;
+class JSONReformatter;
 
 class JSONEnt
 {
   friend class JSONDec;
   friend class JSONObjectDec;
   friend class JSONArrayDec;
+  friend class JSONReformatter;
 
 public:
 
@@ -300,6 +314,21 @@ protected:
     JSONEnt *ent
     );
 
+  static size_t CountDigits( char const *p, char const *pEnd );
+
+  static size_t ConsumeDigits(
+    JSONStrWithLoc &ds,
+    uint64_t &mantissa,
+    uint32_t &mantissaDigits
+    );
+
+  static bool ConsumeNumber(
+    JSONStrWithLoc &ds,
+    bool computeValue,
+    int32_t &int32Value,
+    double &float64Value
+    );
+
   static uint8_t ConsumeHex( JSONStrWithLoc &ds );
 
   static uint16_t ConsumeUCS2( JSONStrWithLoc &ds );
@@ -400,6 +429,7 @@ inline void JSONEnt::stringGetData_Long( char *data ) const
           str = str.drop_front();
           JSONStrWithLoc ds( str );
           data += UCS2ToUTF8( ConsumeUCS2( ds ), data );
+          str = str.drop_front( 4 );
         }
         break;
 
@@ -497,6 +527,7 @@ inline bool JSONEnt::stringIs_Long( StrRef thatStr ) const
           || memcmp( utf8, thatStr.data(), utf8Length ) != 0 )
           return false;
         thatStr = thatStr.drop_front( utf8Length );
+        str = str.drop_front( 4 );
       }
       break;
 
@@ -585,7 +616,7 @@ inline uint8_t JSONEnt::UCS2ToUTF8( uint16_t ucs2, char utf8[3] )
   else
   {
     utf8[0] = char(ucs2 >> 12) | char(0xE0);
-    utf8[1] = (char(ucs2 >> 6) & char(0x3F)) | char(0xE0);
+    utf8[1] = (char(ucs2 >> 6) & char(0x3F)) | char(0x80);
     utf8[2] = (char(ucs2) & char(0x3F)) | char(0x80);
     return 3;
   }
@@ -801,110 +832,25 @@ inline void JSONEnt::ConsumeEntity(
       if ( ent )
         ent->rawStrWithLoc = ds;
 
-      if ( !ds.empty() && ds.front() == '-' )
-      {
-        ds.drop();
-        if ( ds.empty() )
-          throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
-      }
-
-      switch ( ds.front() )
-      {
-        case '0':
-          ds.drop();
-          break;
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-          ds.drop();
-          while ( !ds.empty() && ds.front() >= '0' && ds.front() <= '9' )
-          {
-            ds.drop();
-          }
-          break;
-        default:
-          throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
-      }
-
-      if ( ds.empty()
-        || (ds.front() != '.' && ds.front() != 'e' && ds.front() != 'E') )
+      int32_t int32Value;
+      double float64Value;
+      if ( ConsumeNumber( ds, !!ent, int32Value, float64Value ) )
       {
         if ( ent )
         {
-          ent->type = JSONEnt::Type_Int32;
-
-          static const uint32_t maxIntegerLength = 15;
-          uint32_t length = ent->rawStrWithLoc.size() - ds.size();
-          if ( length > maxIntegerLength )
-            throw JSONMalformedException( ds.line, ds.column, FTL_STR("integer too long") );
-
-          char buf[maxIntegerLength+1];
-          memcpy( buf, ent->rawStrWithLoc.data(), length );
-          buf[length] = '\0';
-          ent->value.int32 = atoi( buf );
+          ent->type = JSONEnt::Type_Float64;
+          ent->value.float64 = float64Value;
         }
       }
       else
       {
         if ( ent )
-          ent->type = JSONEnt::Type_Float64;
-
-        if ( ds.front() == '.' )
         {
-          ds.drop();
-
-          if ( ds.empty() || ds.front() < '0' || ds.front() > '9' )
-            throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
-
-          while ( !ds.empty() && ds.front() >= '0' && ds.front() <= '9' )
-          {
-            ds.drop();
-          }
-        }
-
-        if ( !ds.empty() && (ds.front() == 'e' || ds.front() == 'E') )
-        {
-          ds.drop();
-
-          if ( !ds.empty() && (ds.front() == '-' || ds.front() == '+') )
-          {
-            ds.drop();
-          }
-
-          if ( ds.empty() || ds.front() < '0' || ds.front() > '9' )
-            throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
-
-          ds.drop();
-          while ( !ds.empty() && ds.front() >= '0' && ds.front() <= '9' )
-          {
-            ds.drop();
-          }
-        }
-
-        if ( ent )
-        {
-          static const uint32_t maxScalarLength = 31;
-          uint32_t length = ent->rawStrWithLoc.size() - ds.size();
-          if ( length > maxScalarLength )
-            throw JSONMalformedException( ds.line, ds.column, FTL_STR("floating point too long") );
-
-          char buf[maxScalarLength+1];
-          memcpy( buf, ent->rawStrWithLoc.data(), length );
-          buf[length] = '\0';
-
-          char const *oldlocale = setlocale( LC_NUMERIC, "C" );
-          ent->value.float64 = atof( buf );
-          if ( oldlocale )
-            setlocale( LC_NUMERIC, oldlocale );
+          ent->type = JSONEnt::Type_Int32;
+          ent->value.int32 = int32Value;
         }
       }
-      
+
       if ( ent )
         ent->rawStrWithLoc.drop_back( ds.size() );
     }
@@ -1010,6 +956,197 @@ inline void JSONEnt::ConsumeEntity(
   }
 }
 
+inline size_t JSONEnt::CountDigits( char const *p, char const *pEnd )
+{
+  char const *pBegin = p;
+#if defined(FTL_SSE2)
+  // Classify 16 characters at a time: ch is a digit iff
+  // int8_t( ( ch - '0' ) ^ 0x80 ) < -128 + 10
+  __m128i const zero = _mm_set1_epi8( '0' );
+  __m128i const flip = _mm_set1_epi8( char(0x80) );
+  __m128i const limit = _mm_set1_epi8( char(-128 + 10) );
+  while ( pEnd - p >= 16 )
+  {
+    __m128i chunk = _mm_loadu_si128( reinterpret_cast<__m128i const *>( p ) );
+    __m128i biased = _mm_xor_si128( _mm_sub_epi8( chunk, zero ), flip );
+    uint32_t nonDigits =
+      ~uint32_t( _mm_movemask_epi8( _mm_cmplt_epi8( biased, limit ) ) )
+      & 0xFFFFu;
+    if ( nonDigits )
+      return size_t( p - pBegin ) + BitsCountTrailingZeros( nonDigits );
+    p += 16;
+  }
+#endif
+  while ( p != pEnd && *p >= '0' && *p <= '9' )
+    ++p;
+  return size_t( p - pBegin );
+}
+
+// Skips a run of decimal digits, accumulating them into mantissa.  Once
+// more than 19 significant digits have been seen mantissa is no longer
+// exact; mantissaDigits keeps counting so the caller can tell.
+inline size_t JSONEnt::ConsumeDigits(
+  JSONStrWithLoc &ds,
+  uint64_t &mantissa,
+  uint32_t &mantissaDigits
+  )
+{
+  static uint32_t const MaxExactDigits = 19;
+
+  char const *p = ds.data();
+  size_t const count = CountDigits( p, p + ds.size() );
+  char const *const pEnd = p + count;
+
+#if defined(FTL_LITTLE_ENDIAN)
+  // Convert 8 digits at a time (SWAR, little-endian).  The digit count is
+  // an upper bound when the mantissa is still zero, which only costs a
+  // trip through the slow path.
+  while ( pEnd - p >= 8 && mantissaDigits + 8 <= MaxExactDigits )
+  {
+    uint64_t chunk;
+    memcpy( &chunk, p, 8 );
+    chunk = ( ( chunk & UINT64_C(0x0F0F0F0F0F0F0F0F) ) * 2561 ) >> 8;
+    chunk = ( ( chunk & UINT64_C(0x00FF00FF00FF00FF) ) * 6553601 ) >> 16;
+    chunk = ( ( chunk & UINT64_C(0x0000FFFF0000FFFF) )
+      * UINT64_C(42949672960001) ) >> 32;
+    mantissa = mantissa * 100000000 + chunk;
+    if ( mantissa != 0 )
+      mantissaDigits += 8;
+    p += 8;
+  }
+#endif
+
+  for ( ; p != pEnd; ++p )
+  {
+    if ( mantissaDigits < MaxExactDigits )
+    {
+      mantissa = mantissa * 10 + uint64_t( *p - '0' );
+      if ( mantissa != 0 )
+        ++mantissaDigits;
+    }
+    else ++mantissaDigits;
+  }
+
+  ds.dropInLine( count );
+  return count;
+}
+
+// Consumes a number, returning true if it is floating point.  When
+// computeValue is set the value is stored in int32Value or float64Value;
+// the results are identical to atoi() and a "C" locale atof() on the
+// number's characters, without changing the process's locale.
+inline bool JSONEnt::ConsumeNumber(
+  JSONStrWithLoc &ds,
+  bool computeValue,
+  int32_t &int32Value,
+  double &float64Value
+  )
+{
+  char const *const numberBegin = ds.data();
+
+  bool negative = false;
+  if ( !ds.empty() && ds.front() == '-' )
+  {
+    negative = true;
+    ds.drop();
+    if ( ds.empty() )
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
+  }
+
+  uint64_t mantissa = 0;
+  uint32_t mantissaDigits = 0;
+  switch ( ds.front() )
+  {
+    case '0':
+      ds.drop();
+      break;
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+      ConsumeDigits( ds, mantissa, mantissaDigits );
+      break;
+    default:
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
+  }
+
+  if ( ds.empty()
+    || (ds.front() != '.' && ds.front() != 'e' && ds.front() != 'E') )
+  {
+    if ( computeValue )
+    {
+      static const uint32_t maxIntegerLength = 15;
+      uint32_t length = uint32_t( ds.data() - numberBegin );
+      if ( length > maxIntegerLength )
+        throw JSONMalformedException( ds.line, ds.column, FTL_STR("integer too long") );
+
+      // At most 15 digits, so mantissa is exact; like atoi(), keep the
+      // low 32 bits of out-of-range values
+      uint64_t value = negative? uint64_t(0) - mantissa: mantissa;
+      int32Value = int32_t( uint32_t( value ) );
+    }
+    return false;
+  }
+
+  int32_t exponent = 0;
+
+  if ( ds.front() == '.' )
+  {
+    ds.drop();
+
+    if ( ds.empty() || ds.front() < '0' || ds.front() > '9' )
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
+
+    exponent -= int32_t( ConsumeDigits( ds, mantissa, mantissaDigits ) );
+  }
+
+  if ( !ds.empty() && (ds.front() == 'e' || ds.front() == 'E') )
+  {
+    ds.drop();
+
+    bool exponentNegative = false;
+    if ( !ds.empty() && (ds.front() == '-' || ds.front() == '+') )
+    {
+      exponentNegative = ds.front() == '-';
+      ds.drop();
+    }
+
+    if ( ds.empty() || ds.front() < '0' || ds.front() > '9' )
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected decimal digit") );
+
+    uint64_t explicitExponent = 0;
+    uint32_t explicitExponentDigits = 0;
+    ConsumeDigits( ds, explicitExponent, explicitExponentDigits );
+    // Far outside the fast path's range either way
+    if ( explicitExponentDigits > 4 )
+      explicitExponent = 99999;
+    if ( exponentNegative )
+      exponent -= int32_t( explicitExponent );
+    else
+      exponent += int32_t( explicitExponent );
+  }
+
+  if ( computeValue )
+  {
+    static const uint32_t maxScalarLength = 31;
+    uint32_t length = uint32_t( ds.data() - numberBegin );
+    if ( length > maxScalarLength )
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("floating point too long") );
+
+    float64Value = StrToFloat64Decimal(
+      negative, mantissa, mantissaDigits, exponent,
+      numberBegin, numberBegin + length
+      );
+  }
+
+  return true;
+}
+
 inline void JSONEnt::SkipWhitespace(
   JSONStrWithLoc &ds
   )
@@ -1064,6 +1201,7 @@ inline void JSONEnt::SkipWhitespace(
               }
             }
           }
+          break;
 
           default: return;
         }
@@ -1168,11 +1306,72 @@ public:
     return true;
   }
 
+  // Whether the next element is a number, and if so whether it is
+  // floating point, without consuming it
+  bool peekNumber( bool &isFloat )
+  {
+    JSONEnt::SkipWhitespace( m_ds );
+    if ( m_ds.empty() )
+      return false;
+    char ch = m_ds.front();
+    if ( ch != '-' && ( ch < '0' || ch > '9' ) )
+      return false;
+
+    JSONStrWithLoc ds = m_ds;
+    int32_t int32Value;
+    double float64Value;
+    isFloat = JSONEnt::ConsumeNumber( ds, false, int32Value, float64Value );
+    return true;
+  }
+
+  // Bulk-decode a run of integer (resp. floating point) elements into
+  // values, stopping at the end of the array, after maxCount elements or
+  // in front of the first element of any other kind.  Returns the number
+  // of values stored.
+  uint32_t getNextSInt32s( int32_t *values, uint32_t maxCount )
+    { return getNextNumbers( values, maxCount, false ); }
+
+  uint32_t getNextFloat64s( double *values, uint32_t maxCount )
+    { return getNextNumbers( values, maxCount, true ); }
+
   uint32_t getLastIndex() const
     { return m_lastIndex; }
 
 private:
 
+  static void StoreNumber( int32_t *value, int32_t int32Value, double )
+    { *value = int32Value; }
+
+  static void StoreNumber( double *value, int32_t, double float64Value )
+    { *value = float64Value; }
+
+  template<typename EleTy>
+  uint32_t getNextNumbers( EleTy *values, uint32_t maxCount, bool isFloat )
+  {
+    uint32_t count = 0;
+    while ( count < maxCount )
+    {
+      JSONEnt::SkipWhitespace( m_ds );
+      if ( m_ds.empty() )
+        break;
+      char ch = m_ds.front();
+      if ( ch != '-' && ( ch < '0' || ch > '9' ) )
+        break;
+
+      JSONStrWithLoc ds = m_ds;
+      int32_t int32Value;
+      double float64Value;
+      if ( JSONEnt::ConsumeNumber( ds, true, int32Value, float64Value )
+        != isFloat )
+        break;
+      StoreNumber( &values[count++], int32Value, float64Value );
+      m_ds = ds;
+    }
+    if ( count > 0 )
+      m_lastIndex = ( m_count += count );
+    return count;
+  }
+
   JSONStrWithLoc &m_ds;
   uint32_t m_count;
   uint32_t m_lastIndex;
@@ -5,11 +5,18 @@
 #pragma once
 
 #include <FTL/ArrayRef.h>
+#include <FTL/Bits.h>
+#include <FTL/FmtFloat64.h>
+#include <FTL/FmtInt.h>
 #include <FTL/JSONException.h>
 #include <FTL/JSONFormat.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#if defined(FTL_SSE2)
+# include <emmintrin.h>
+#endif
 
 //
 // Usage:
@@ -27,6 +34,87 @@
 
 FTL_NAMESPACE_BEGIN
 
+// A string that is already quoted and escaped, such as a string token
+// copied from JSON input
+struct JSONQuotedStr
+{
+  StrRef str;
+
+  explicit JSONQuotedStr( StrRef theStr )
+    : str( theStr ) {}
+};
+
+// The text between list elements in a format: elementSepStr, newlineStr
+// and up to MaxIndents copies of indentStr, so that a line break at any
+// depth up to MaxIndents is sliced from it.  It is built on first use and
+// rebuilt when the format's strings no longer match it.
+class JSONEncBreakStr
+{
+  JSONEncBreakStr( JSONEncBreakStr const &that );
+  JSONEncBreakStr &operator=( JSONEncBreakStr const &that );
+
+public:
+
+  static const uint32_t MaxIndents = 32;
+
+  JSONEncBreakStr()
+    : m_elementSepSize( 0 )
+    , m_newlineSize( 0 )
+    {}
+
+  // elementSepStr if withSep, then newlineStr and indents (at most
+  // MaxIndents) copies of indentStr
+  StrRef get( JSONFormat const &format, bool withSep, uint32_t indents )
+  {
+    if ( !matches( format ) )
+      build( format );
+    size_t begin = withSep? 0: m_elementSepSize;
+    size_t end = m_elementSepSize + m_newlineSize
+      + indents * format.indentStr.size();
+    return StrRef( m_str.data() + begin, end - begin );
+  }
+
+private:
+
+  bool matches( JSONFormat const &format ) const
+  {
+    size_t const indentSize = format.indentStr.size();
+    if ( m_elementSepSize != format.elementSepStr.size()
+      || m_newlineSize != format.newlineStr.size()
+      || m_str.size()
+        != m_elementSepSize + m_newlineSize + MaxIndents * indentSize )
+      return false;
+    char const *p = m_str.data();
+    return Holds( p, format.elementSepStr )
+      && Holds( p + m_elementSepSize, format.newlineStr )
+      && Holds( p + m_elementSepSize + m_newlineSize, format.indentStr );
+  }
+
+  // Whether p starts with str, for an empty str (which may have a null
+  // data pointer) without calling memcmp
+  static bool Holds( char const *p, StrRef str )
+    { return str.empty() || memcmp( p, str.data(), str.size() ) == 0; }
+
+  void build( JSONFormat const &format )
+  {
+    m_elementSepSize = format.elementSepStr.size();
+    m_newlineSize = format.newlineStr.size();
+    m_str.clear();
+    m_str.reserve(
+      m_elementSepSize + m_newlineSize
+        + MaxIndents * format.indentStr.size()
+      );
+    m_str += format.elementSepStr;
+    m_str += format.newlineStr;
+    for ( uint32_t i = 0; i < MaxIndents; ++i )
+      m_str += format.indentStr;
+  }
+
+  std::string m_str;
+  size_t m_elementSepSize;
+  size_t m_newlineSize;
+};
+
 template<typename StringTy = std::string>
 class JSONElementEnc;
 
@@ -39,12 +127,21 @@ class JSONBooleanEnc;
 template<typename StringTy = std::string>
 class JSONSInt32Enc;
 
+template<typename StringTy = std::string>
+class JSONSInt64Enc;
+
+template<typename StringTy = std::string>
+class JSONUInt64Enc;
+
 template<typename StringTy = std::string>
 class JSONFloat64Enc;
 
 template<typename StringTy = std::string>
 class JSONStringEnc;
 
+template<typename StringTy = std::string>
+class JSONRawEnc;
+
 template<typename StringTy = std::string>
 class JSONListEnc;
 
@@ -61,8 +158,11 @@ class JSONEnc
   friend class JSONNullEnc<StringTy>;
   friend class JSONBooleanEnc<StringTy>;
   friend class JSONSInt32Enc<StringTy>;
+  friend class JSONSInt64Enc<StringTy>;
+  friend class JSONUInt64Enc<StringTy>;
   friend class JSONFloat64Enc<StringTy>;
   friend class JSONStringEnc<StringTy>;
+  friend class JSONRawEnc<StringTy>;
   friend class JSONListEnc<StringTy>;
   friend class JSONObjectEnc<StringTy>;
   friend class JSONArrayEnc<StringTy>;
@@ -78,14 +178,32 @@ public:
     )
     : m_string( string )
     , m_format( format )
+    , m_breakStr( m_ownBreakStr )
     , m_indents( 0 )
     , m_used( false )
   {
   }
 
+  // Starts at the given nesting depth, for output that is spliced into
+  // a larger document (see JSONArrayEnc's and JSONObjectEnc's part
+  // constructors).
+  JSONEnc(
+    StringTy &string,
+    JSONFormat const &format,
+    uint32_t indents
+    )
+    : m_string( string )
+    , m_format( format )
+    , m_breakStr( m_ownBreakStr )
+    , m_indents( indents )
+    , m_used( false )
+  {
+  }
+
   JSONEnc( JSONObjectEnc<StringTy> &objectEnc, StrRef key )
     : m_string( objectEnc.getEnc().m_string )
     , m_format( objectEnc.getEnc().m_format )
+    , m_breakStr( objectEnc.getEnc().m_breakStr )
     , m_indents( objectEnc.getEnc().m_indents + 1 )
     , m_used( false )
   {
@@ -94,9 +212,22 @@ public:
     append( m_format.memberSepStr );
   }
 
+  JSONEnc( JSONObjectEnc<StringTy> &objectEnc, JSONQuotedStr key )
+    : m_string( objectEnc.getEnc().m_string )
+    , m_format( objectEnc.getEnc().m_format )
+    , m_breakStr( objectEnc.getEnc().m_breakStr )
+    , m_indents( objectEnc.getEnc().m_indents + 1 )
+    , m_used( false )
+  {
+    objectEnc.inc();
+    append( key.str );
+    append( m_format.memberSepStr );
+  }
+
   JSONEnc( JSONArrayEnc<StringTy> &arrayEnc )
     : m_string( arrayEnc.getEnc().m_string )
     , m_format( arrayEnc.getEnc().m_format )
+    , m_breakStr( arrayEnc.getEnc().m_breakStr )
     , m_indents( arrayEnc.getEnc().m_indents + 1 )
     , m_used( false )
   {
@@ -105,6 +236,9 @@ public:
 
   ~JSONEnc() {}
 
+  JSONFormat const &getFormat() const
+    { return m_format; }
+
 protected:
 
   void use()
@@ -114,9 +248,6 @@ protected:
     m_used = true;
   }
 
-  JSONFormat const &getFormat() const
-    { return m_format; }
-
   void reserve( size_t size )
     { m_string.reserve( m_string.size() + size ); }
 
@@ -126,17 +257,63 @@ protected:
   void append( StrRef str )
     { m_string += str; }
 
+  // Room needed by FmtNumber
+  static const uint32_t NumberMaxLength = FmtFloat64MaxLength + 2;
+
+  // Formats a number into buf the way its element encoder writes it
+  // (doubles always with a '.' or exponent), returning the length
+  static uint32_t FmtNumber(
+    JSONFormat const &,
+    int32_t value,
+    char *buf
+    )
+    { return FmtSInt32( value, buf ); }
+
+  static uint32_t FmtNumber(
+    JSONFormat const &format,
+    double value,
+    char *buf
+    )
+  {
+    if ( format.canonical )
+    {
+      // RFC 8785 has no representation for them
+      if ( !( value - value == 0.0 ) )
+        throw JSONEncodingErrorException(
+          FTL_STR("non-finite number in canonical JSON")
+          );
+      return FmtFloat64JS( value, buf );
+    }
+    uint32_t len = FmtFloat64( value, buf, format.float64Precision );
+    for ( uint32_t i = 0; i < len; ++i )
+    {
+      if ( buf[i] == '.' || buf[i] == 'e' )
+        return len;
+    }
+    buf[len++] = '.';
+    buf[len++] = '0';
+    return len;
+  }
+
+  static uint32_t FmtNumber(
+    JSONFormat const &format,
+    float value,
+    char *buf
+    )
+    { return FmtNumber( format, double( value ), buf ); }
+
+  template<typename NumberTy>
+  void appendNumber( NumberTy value )
+  {
+    char buf[NumberMaxLength];
+    append( StrRef( buf, FmtNumber( m_format, value, buf ) ) );
+  }
+
   void appendQuotedStrs(
     ArrayRef<StrRef> strs,
     StrRef delim
     )
   {
-    size_t delimCount = strs.empty()? 0: strs.size() - 1;
-    size_t expandAmount = 2 + delim.size() * delimCount;
-    for ( ArrayRef<StrRef>::IT it = strs.begin(); it != strs.end(); ++it )
-      expandAmount += 2 * it->size();
-    reserve( expandAmount );
-
     append( '"' );
     const ArrayRef<StrRef>::IT itBegin = strs.begin();
     const ArrayRef<StrRef>::IT itEnd = strs.end();
@@ -149,59 +326,113 @@ protected:
     append( '"' );
   }
 
+  // Returns the first character in [p, pEnd) that must be escaped inside
+  // a JSON string, or pEnd
+  static char const *FindCharToEscape( char const *p, char const *pEnd )
+  {
+#if defined(FTL_SSE2)
+    // Classify 16 characters at a time: '"', '\\' or below 0x20 (which
+    // is max( ch, 0x1F ) == 0x1F, unsigned)
+    __m128i const quote = _mm_set1_epi8( '"' );
+    __m128i const backslash = _mm_set1_epi8( '\\' );
+    __m128i const control = _mm_set1_epi8( 0x1F );
+    while ( pEnd - p >= 16 )
+    {
+      __m128i chunk = _mm_loadu_si128( reinterpret_cast<__m128i const *>( p ) );
+      __m128i special = _mm_or_si128(
+        _mm_or_si128(
+          _mm_cmpeq_epi8( chunk, quote ),
+          _mm_cmpeq_epi8( chunk, backslash )
+          ),
+        _mm_cmpeq_epi8( _mm_max_epu8( chunk, control ), control )
+        );
+      uint32_t mask = uint32_t( _mm_movemask_epi8( special ) );
+      if ( mask )
+        return p + BitsCountTrailingZeros( mask );
+      p += 16;
+    }
+#endif
+    while ( p != pEnd
+      && uint8_t( *p ) >= 0x20 && *p != '"' && *p != '\\' )
+      ++p;
+    return p;
+  }
+
   void appendQuotedStrChars( StrRef str )
   {
-    const StrRef::IT itEnd = str.end();
-    for ( StrRef::IT it = str.begin(); it != itEnd; ++it )
+    char const *p = str.data();
+    char const *const pEnd = p + str.size();
+    for (;;)
     {
-      switch ( *it )
+      char const *run = p;
+      p = FindCharToEscape( p, pEnd );
+      if ( p != run )
+        append( StrRef( run, p - run ) );
+      if ( p == pEnd )
+        break;
+
+      char const ch = *p++;
+      switch ( ch )
       {
         case '\b':
-          append( '\\' );
-          append( 'b' );
+          append( FTL_STR("\\b") );
           break;
         case '\f':
-          append( '\\' );
-          append( 'f' );
+          append( FTL_STR("\\f") );
           break;
         case '\n':
-          append( '\\' );
-          append( 'n' );
+          append( FTL_STR("\\n") );
           break;
         case '\r':
-          append( '\\' );
-          append( 'r' );
+          append( FTL_STR("\\r") );
           break;
         case '\t':
-          append( '\\' );
-          append( 't' );
+          append( FTL_STR("\\t") );
           break;
         case '"':
+          append( FTL_STR("\\\"") );
+          break;
         case '\\':
-          append( '\\' );
-          // fall through
-        default:
-          append( *it );
+          append( FTL_STR("\\\\") );
           break;
+        default:
+        {
+          char const *hexDigits = getFormat().canonical?
+            "0123456789abcdef": "0123456789ABCDEF";
+          char escape[6] = { '\\', 'u', '0', '0', 0, 0 };
+          escape[4] = hexDigits[uint8_t( ch ) >> 4];
+          escape[5] = hexDigits[uint8_t( ch ) & 0xF];
+          append( StrRef( escape, 6 ) );
+        }
+        break;
       }
     }
   }
 
-  void indent()
+  // Starts a new line at this encoder's depth, after an element separator
+  // if withSep, with a single append for all but very deep nesting
+  void indent( bool withSep = false )
   {
-    reserve(
-        getFormat().newlineStr.size()
-      + m_indents * getFormat().indentStr.size()
-      );
-    append( getFormat().newlineStr );
-    for ( uint32_t indent = 0; indent <= m_indents; ++indent )
-      append( getFormat().indentStr );
+    uint32_t const indents = m_indents + 1;
+    if ( indents <= JSONEncBreakStr::MaxIndents )
+      append( m_breakStr.get( m_format, withSep, indents ) );
+    else
+    {
+      append(
+        m_breakStr.get( m_format, withSep, JSONEncBreakStr::MaxIndents )
+        );
+      for ( uint32_t i = JSONEncBreakStr::MaxIndents; i < indents; ++i )
+        append( m_format.indentStr );
+    }
   }
 
 private:
 
   StringTy &m_string;
   JSONFormat const &m_format;
+  // Shared with the encoders nested in this one
+  JSONEncBreakStr m_ownBreakStr;
+  JSONEncBreakStr &m_breakStr;
   uint32_t const m_indents;
   bool m_used; 
 };
@@ -251,10 +482,39 @@ public:
     int32_t value
     )
     : JSONElementEnc<StringTy>( enc )
+    { enc.appendNumber( value ); }
+};
+
+// Note that JSONDec itself only decodes 32-bit integers.
+template<typename StringTy>
+class JSONSInt64Enc : public JSONElementEnc<StringTy>
+{
+public:
+
+  JSONSInt64Enc( 
+    JSONEnc<StringTy> &enc,
+    int64_t value
+    )
+    : JSONElementEnc<StringTy>( enc )
   {
-    char buf[24];
-    int len = snprintf( buf, 24, "%d", value );
-    enc.append( StrRef( buf, len ) );
+    char buf[FmtIntMaxLength];
+    enc.append( StrRef( buf, FmtSInt64( value, buf ) ) );
+  }
+};
+
+template<typename StringTy>
+class JSONUInt64Enc : public JSONElementEnc<StringTy>
+{
+public:
+
+  JSONUInt64Enc( 
+    JSONEnc<StringTy> &enc,
+    uint64_t value
+    )
+    : JSONElementEnc<StringTy>( enc )
+  {
+    char buf[FmtIntMaxLength];
+    enc.append( StrRef( buf, FmtUInt64( value, buf ) ) );
   }
 };
 
@@ -268,31 +528,7 @@ public:
     double value
     )
     : JSONElementEnc<StringTy>( enc )
-  {
-    char buf[32];
-    char const *oldlocale = setlocale( LC_NUMERIC, "C" );
-    int len = snprintf( buf, 24, "%.16lg", value );
-    if ( oldlocale )
-      setlocale( LC_NUMERIC, oldlocale );
-    char *p = buf;
-    bool haveDec = false;
-    while ( *p )
-    {
-      if ( *p == '.' || *p == 'e' )
-      {
-        haveDec = true;
-        break;
-      }
-      ++p;
-    }
-    if ( !haveDec )
-    {
-      buf[len++] = '.';
-      buf[len++] = '0';
-      buf[len] = '\0';
-    }
-    enc.append( StrRef( buf, len ) );
-  }
+    { enc.appendNumber( value ); }
 };
 
 template<typename StringTy>
@@ -309,28 +545,53 @@ public:
     { enc.appendQuotedStrs( strs, delim ); }
 };
 
+// Writes json, which must be a complete, valid JSON value (such as a
+// scalar token copied from the input), as is.
+template<typename StringTy>
+class JSONRawEnc : public JSONElementEnc<StringTy>
+{
+public:
+
+  JSONRawEnc( 
+    JSONEnc<StringTy> &enc,
+    StrRef json
+    )
+    : JSONElementEnc<StringTy>( enc )
+    { enc.append( json ); }
+};
+
 template<typename StringTy>
 class JSONListEnc : public JSONElementEnc<StringTy>
 {
   friend class JSONEnc<StringTy>;
 
+public:
+
+  // Accounts for count elements that were encoded separately, by part
+  // encoders, and spliced into the output.
+  void skip( uint32_t count )
+    { m_count += count; }
+
 protected:
 
-  JSONListEnc( JSONEnc<StringTy> &enc )
+  JSONListEnc( JSONEnc<StringTy> &enc, uint32_t count = 0, bool isPart = false )
     : JSONElementEnc<StringTy>( enc )
     , m_enc( enc )
-    , m_count( 0 )
+    , m_count( count )
+    , m_isPart( isPart )
     {}
 
   JSONEnc<StringTy> &getEnc()
     { return m_enc; }
 
+  bool isPart() const
+    { return m_isPart; }
+
+  uint32_t getCount() const
+    { return m_count; }
+
   void inc()
-  {
-    if ( m_count++ > 0 )
-      m_enc.append( m_enc.getFormat().elementSepStr );
-    m_enc.indent();
-  }
+    { m_enc.indent( m_count++ > 0 ); }
 
   void fin()
   {
@@ -342,6 +603,7 @@ private:
 
   JSONEnc<StringTy> &m_enc;
   uint32_t m_count;
+  bool m_isPart;
 };
 
 template<typename StringTy>
@@ -355,8 +617,17 @@ public:
     enc.append( enc.getFormat().objectBeginStr );
   }
 
+  // Encodes members firstIndex onwards of an object whose braces are
+  // written by another JSONObjectEnc; enc must be at that encoder's depth.
+  JSONObjectEnc( JSONEnc<StringTy> &enc, uint32_t firstIndex )
+    : JSONListEnc<StringTy>( enc, firstIndex, true )
+  {
+  }
+
   ~JSONObjectEnc()
   {
+    if ( this->isPart() )
+      return;
     this->fin();
     JSONEnc<StringTy> &enc = this->getEnc();
     enc.append( enc.getFormat().objectEndStr );
@@ -374,12 +645,92 @@ public:
     enc.append( enc.getFormat().arrayBeginStr );
   }
 
+  // Encodes elements firstIndex onwards of an array whose brackets are
+  // written by another JSONArrayEnc; enc must be at that encoder's depth.
+  JSONArrayEnc( JSONEnc<StringTy> &enc, uint32_t firstIndex )
+    : JSONListEnc<StringTy>( enc, firstIndex, true )
+  {
+  }
+
   ~JSONArrayEnc()
   {
+    if ( this->isPart() )
+      return;
     this->fin();
     JSONEnc<StringTy> &enc = this->getEnc();
     enc.append( enc.getFormat().arrayEndStr );
   }
+
+  // Encodes values as the next elements, exactly as an element encoder
+  // per value would, but formatted in one loop into a local buffer.  With
+  // the format's inlineNumberArrays they all go on one line.
+  void appendValues( ArrayRef<int32_t> values )
+    { appendNumbers( values ); }
+
+  void appendValues( ArrayRef<float> values )
+    { appendNumbers( values ); }
+
+  void appendValues( ArrayRef<double> values )
+    { appendNumbers( values ); }
+
+private:
+
+  template<typename NumberTy>
+  void appendNumbers( ArrayRef<NumberTy> values )
+  {
+    typedef typename ArrayRef<NumberTy>::IT IT;
+    IT it = values.begin();
+    IT const itEnd = values.end();
+    if ( it == itEnd )
+      return;
+
+    JSONEnc<StringTy> &enc = this->getEnc();
+    JSONFormat const &format = enc.getFormat();
+    if ( this->getCount() == 0 )
+    {
+      this->inc();
+      enc.appendNumber( *it++ );
+    }
+
+    StrRef sep;
+    bool haveSep = true;
+    if ( format.inlineNumberArrays )
+      sep = format.inlineElementSepStr;
+    else if ( enc.m_indents + 1 <= JSONEncBreakStr::MaxIndents )
+      sep = enc.m_breakStr.get( format, true, enc.m_indents + 1 );
+    else
+      haveSep = false;
+
+    char buf[4096];
+    if ( !haveSep
+      || sep.size() + JSONEnc<StringTy>::NumberMaxLength > sizeof( buf ) )
+    {
+      // Nested too deeply for a precomputed separator, or a format with
+      // very long indents
+      for ( ; it != itEnd; ++it )
+      {
+        this->inc();
+        enc.appendNumber( *it );
+      }
+      return;
+    }
+
+    this->skip( uint32_t( itEnd - it ) );
+    size_t const maxLength = sep.size() + JSONEnc<StringTy>::NumberMaxLength;
+    size_t length = 0;
+    for ( ; it != itEnd; ++it )
+    {
+      if ( length + maxLength > sizeof( buf ) )
+      {
+        enc.append( StrRef( buf, length ) );
+        length = 0;
+      }
+      memcpy( buf + length, sep.data(), sep.size() );
+      length += sep.size();
+      length += JSONEnc<StringTy>::FmtNumber( format, *it, buf + length );
+    }
+    enc.append( StrRef( buf, length ) );
+  }
 };
 
 FTL_NAMESPACE_END
@@ -0,0 +1,403 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+#include <FTL/Hash64.h>
+#include <FTL/JSONEnc.h>
+#include <FTL/StrRef.h>
+
+#include <stdio.h>
+#include <string.h>
+#if defined(FTL_PLATFORM_POSIX)
+# include <errno.h>
+# include <unistd.h>
+#elif defined(FTL_PLATFORM_WINDOWS)
+# include <io.h>
+#endif
+
+//
+// Output sinks that can be used as the StringTy of JSONEnc (and so of
+// JSONValue::encodeTo) in place of a std::string holding the whole
+// document:
+//
+// JSONEncFDSink sink( fd );
+// {
+//   JSONEnc<JSONEncFDSink> enc( sink );
+//   jsonValue->encodeTo( enc );
+// }
+// if ( !sink.flush() )
+//   ... report errno ...
+// To write into a caller-owned buffer of exactly the right size, measure
+// first with JSONEncodedSize (below).
+//
+// Sinks never throw, since the encoders write closing brackets from their
+// destructors; a failed write is remembered and later output is dropped.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// Collects output in a block of blockSize bytes (at least 1) and passes
+// each full block to callback( userdata, data, size ), which returns false
+// on failure.  Remaining output is passed on by flush() or the destructor.
+class JSONEncCallbackSink
+{
+  JSONEncCallbackSink( JSONEncCallbackSink const & );
+  JSONEncCallbackSink &operator=( JSONEncCallbackSink const & );
+
+public:
+
+  static const size_t DefaultBlockSize = 64 * 1024;
+
+  typedef bool (*Callback)( void *userdata, char const *data, size_t size );
+
+  JSONEncCallbackSink(
+    Callback callback,
+    void *userdata,
+    size_t blockSize = DefaultBlockSize
+    )
+    : m_callback( callback )
+    , m_userdata( userdata )
+    , m_blockBegin( new char[blockSize? blockSize: 1] )
+    , m_blockEnd( m_blockBegin + ( blockSize? blockSize: 1 ) )
+    , m_pos( m_blockBegin )
+    , m_flushedSize( 0 )
+    , m_failed( false )
+    {}
+
+  ~JSONEncCallbackSink()
+  {
+    flush();
+    delete [] m_blockBegin;
+  }
+
+  JSONEncCallbackSink &operator+=( char ch )
+  {
+    if ( m_pos == m_blockEnd )
+      flushBlock();
+    *m_pos++ = ch;
+    return *this;
+  }
+
+  JSONEncCallbackSink &operator+=( StrRef str )
+  {
+    if ( str.empty() )
+      return *this;
+    if ( str.size() <= size_t( m_blockEnd - m_pos ) )
+    {
+      memcpy( m_pos, str.data(), str.size() );
+      m_pos += str.size();
+    }
+    else
+      appendLong( str );
+    return *this;
+  }
+
+  // The number of bytes output so far, flushed or not
+  size_t size() const
+    { return m_flushedSize + size_t( m_pos - m_blockBegin ); }
+
+  void reserve( size_t ) {}
+
+  // Passes on any buffered output; returns false if any write has failed
+  bool flush()
+  {
+    flushBlock();
+    return !m_failed;
+  }
+
+  bool failed() const
+    { return m_failed; }
+
+protected:
+
+  void flushBlock()
+  {
+    size_t size = size_t( m_pos - m_blockBegin );
+    write( m_blockBegin, size );
+    m_pos = m_blockBegin;
+  }
+
+  void write( char const *data, size_t size )
+  {
+    if ( size == 0 )
+      return;
+    if ( !m_failed && !m_callback( m_userdata, data, size ) )
+      m_failed = true;
+    m_flushedSize += size;
+  }
+
+  // Tops up the block; anything still left over that would fill a whole
+  // block is passed on directly rather than copied.
+  void appendLong( StrRef str )
+  {
+    size_t head = size_t( m_blockEnd - m_pos );
+    memcpy( m_pos, str.data(), head );
+    m_pos = m_blockEnd;
+    str = str.drop_front( head );
+    flushBlock();
+    size_t blockSize = size_t( m_blockEnd - m_blockBegin );
+    if ( str.size() >= blockSize )
+    {
+      write( str.data(), str.size() );
+      return;
+    }
+    memcpy( m_pos, str.data(), str.size() );
+    m_pos += str.size();
+  }
+
+private:
+
+  Callback m_callback;
+  void *m_userdata;
+  char *m_blockBegin;
+  char *m_blockEnd;
+  char *m_pos;
+  size_t m_flushedSize;
+  bool m_failed;
+};
+
+// Writes to a file descriptor in large blocks; after a failure errno
+// describes the failed write.
+class JSONEncFDSink : public JSONEncCallbackSink
+{
+public:
+
+  JSONEncFDSink( int fd, size_t blockSize = DefaultBlockSize )
+    : JSONEncCallbackSink( &Write, &m_fd, blockSize )
+    , m_fd( fd ) {}
+
+  ~JSONEncFDSink()
+    { flush(); }
+
+private:
+
+  static bool Write( void *userdata, char const *data, size_t size )
+  {
+    int fd = *static_cast<int *>( userdata );
+    while ( size > 0 )
+    {
+#if defined(FTL_PLATFORM_WINDOWS)
+      unsigned count = size > 0x40000000u? 0x40000000u: unsigned( size );
+      int written = ::_write( fd, data, count );
+      if ( written < 0 )
+        return false;
+#else
+      ssize_t written = ::write( fd, data, size );
+      if ( written < 0 )
+      {
+        if ( errno == EINTR )
+          continue;
+        return false;
+      }
+#endif
+      data += written;
+      size -= size_t( written );
+    }
+    return true;
+  }
+
+  int m_fd;
+};
+
+// Writes to a FILE in large blocks, bypassing most of its own buffering.
+// The FILE is not flushed or closed.
+class JSONEncFILESink : public JSONEncCallbackSink
+{
+public:
+
+  JSONEncFILESink( FILE *fp, size_t blockSize = DefaultBlockSize )
+    : JSONEncCallbackSink( &Write, fp, blockSize ) {}
+
+  ~JSONEncFILESink()
+    { flush(); }
+
+private:
+
+  static bool Write( void *userdata, char const *data, size_t size )
+  {
+    FILE *fp = static_cast<FILE *>( userdata );
+    return fwrite( data, 1, size, fp ) == size;
+  }
+};
+
+// Writes into a caller-owned buffer of fixed capacity.  Output that does
+// not fit is dropped, but still counted by size(), so that after an
+// overflow the caller knows how large a buffer to retry with.  No
+// terminating null is written.
+class JSONEncBufferSink
+{
+  JSONEncBufferSink( JSONEncBufferSink const & );
+  JSONEncBufferSink &operator=( JSONEncBufferSink const & );
+
+public:
+
+  JSONEncBufferSink( char *data, size_t capacity )
+    : m_data( data )
+    , m_capacity( capacity )
+    , m_size( 0 )
+    {}
+
+  JSONEncBufferSink &operator+=( char ch )
+  {
+    if ( m_size < m_capacity )
+      m_data[m_size] = ch;
+    ++m_size;
+    return *this;
+  }
+
+  JSONEncBufferSink &operator+=( StrRef str )
+  {
+    if ( m_size < m_capacity && !str.empty() )
+    {
+      size_t count = m_capacity - m_size;
+      if ( count > str.size() )
+        count = str.size();
+      memcpy( m_data + m_size, str.data(), count );
+    }
+    m_size += str.size();
+    return *this;
+  }
+
+  // The full size of the output, which may exceed the capacity
+  size_t size() const
+    { return m_size; }
+
+  void reserve( size_t ) {}
+
+  bool overflowed() const
+    { return m_size > m_capacity; }
+
+  // The output that fit in the buffer
+  StrRef str() const
+    { return StrRef( m_data, overflowed()? m_capacity: m_size ); }
+
+private:
+
+  char *m_data;
+  size_t m_capacity;
+  size_t m_size;
+};
+
+// Only counts the output, for measuring it before encoding for real
+class JSONEncCountSink
+{
+public:
+
+  JSONEncCountSink()
+    : m_size( 0 ) {}
+
+  JSONEncCountSink &operator+=( char )
+  {
+    ++m_size;
+    return *this;
+  }
+
+  JSONEncCountSink &operator+=( StrRef str )
+  {
+    m_size += str.size();
+    return *this;
+  }
+
+  size_t size() const
+    { return m_size; }
+
+  void reserve( size_t ) {}
+
+private:
+
+  size_t m_size;
+};
+
+// Hashes the output (see Hash64) instead of storing it
+class JSONEncHashSink
+{
+public:
+
+  JSONEncHashSink( uint64_t seed = 0 )
+    : m_hash( seed )
+    , m_size( 0 )
+    {}
+
+  JSONEncHashSink &operator+=( char ch )
+  {
+    m_hash.update( ch );
+    ++m_size;
+    return *this;
+  }
+
+  JSONEncHashSink &operator+=( StrRef str )
+  {
+    m_hash.update( str );
+    m_size += str.size();
+    return *this;
+  }
+
+  size_t size() const
+    { return m_size; }
+
+  void reserve( size_t ) {}
+
+  uint64_t digest() const
+    { return m_hash.digest(); }
+
+private:
+
+  Hash64 m_hash;
+  size_t m_size;
+};
+
+// Two-pass encoding: encoder is a functor that encodes with any string
+// type, and is called once to measure the output and once to write it
+// into a std::string allocated at exactly that size.
+//
+// struct PointEncoder
+// {
+//   Point const &point;
+//   PointEncoder( Point const &thePoint ) : point( thePoint ) {}
+//   template<typename StringTy>
+//   void operator()( JSONEnc<StringTy> &enc ) const
+//   {
+//     JSONObjectEnc<StringTy> objectEnc( enc );
+//     {
+//       JSONEnc<StringTy> xEnc( objectEnc, FTL_STR("x") );
+//       JSONFloat64Enc<StringTy> xFloat64Enc( xEnc, point.x );
+//     }
+//     ...
+//   }
+// };
+//
+// std::string json = JSONEncodeExact( PointEncoder( point ) );
+//
+template<typename EncoderTy>
+inline size_t JSONEncodedSize(
+  EncoderTy const &encoder,
+  JSONFormat const &format = JSONFormat::Pretty()
+  )
+{
+  JSONEncCountSink sink;
+  {
+    JSONEnc<JSONEncCountSink> enc( sink, format );
+    encoder( enc );
+  }
+  return sink.size();
+}
+
+template<typename EncoderTy>
+inline std::string JSONEncodeExact(
+  EncoderTy const &encoder,
+  JSONFormat const &format = JSONFormat::Pretty()
+  )
+{
+  std::string result;
+  result.reserve( JSONEncodedSize( encoder, format ) );
+  {
+    JSONEnc<std::string> enc( result, format );
+    encoder( enc );
+  }
+  return result;
+}
+
+FTL_NAMESPACE_END
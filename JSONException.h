@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <FTL/FmtInt.h>
 #include <FTL/StrRef.h>
 
 #include <stdint.h>
@@ -33,11 +34,8 @@ protected:
 
   void appendSize( size_t value )
   {
-    size_t oldSize = m_desc.size();
-    m_desc.resize( oldSize + 24 );
-    m_desc.resize( oldSize + snprintf(
-      &m_desc[oldSize], 24, "%u", unsigned(value)
-      ) );
+    char buf[FmtIntMaxLength];
+    m_desc.append( buf, FmtUInt64( value, buf ) );
   }
 
 private:
@@ -91,6 +89,9 @@ public:
 
   JSONEncodingErrorException()
     : JSONException( FTL_STR("encoding error") ) {}
+
+  JSONEncodingErrorException( StrRef desc )
+    : JSONException( desc ) {}
 };
 
 class JSONMalformedException : public JSONException
@@ -18,6 +18,18 @@ struct JSONFormat
   StrRef arrayBeginStr;
   StrRef arrayEndStr;
   StrRef newlineStr;
+  // Separates the elements of a list written on one line
+  StrRef inlineElementSepStr;
+  // Significant digits for floating point numbers; 0 gives the fewest
+  // that read back as the same double
+  uint32_t float64Precision;
+  // Object members are written sorted by key, numbers as ECMAScript
+  // writes them (see FmtFloat64JS) and \u escapes in lower case, so that
+  // equal values always encode the same way
+  bool canonical;
+  // Bulk-encoded numeric arrays (see JSONArrayEnc::appendValues) are
+  // written on a single line
+  bool inlineNumberArrays;
 
   static JSONFormat const &Pretty()
   {
@@ -29,7 +41,47 @@ struct JSONFormat
       FTL_STR("}"), // objectEndStr
       FTL_STR("["), // arrayBeginStr
       FTL_STR("]"), // arrayEndStr
-      FTL_STR("\n") // newlineStr
+      FTL_STR("\n"), // newlineStr
+      FTL_STR(", ") // inlineElementSepStr
+      );
+    return format;
+  }
+
+  // A copy of this format that writes floating point numbers with at
+  // most precision significant digits, for compact but lossy output
+  JSONFormat withFloat64Precision( uint32_t precision ) const
+  {
+    JSONFormat result( *this );
+    result.float64Precision = precision;
+    return result;
+  }
+
+  // A copy of this format that writes bulk-encoded numeric arrays, such
+  // as vertex data, on one line rather than one element per line
+  JSONFormat withInlineNumberArrays( bool inlineNumberArrays = true ) const
+  {
+    JSONFormat result( *this );
+    result.inlineNumberArrays = inlineNumberArrays;
+    return result;
+  }
+
+  // Packed and canonical, as specified for JSON by RFC 8785, except that
+  // keys are sorted by their UTF-8 rather than UTF-16 encoding.  Numbers
+  // that RFC 8785 can't represent (NaN and infinities) throw
+  // JSONEncodingErrorException.
+  static JSONFormat const &Canonical()
+  {
+    static JSONFormat format(
+      StrRef(), // indentStr
+      FTL_STR(":"), // memberSepStr
+      FTL_STR(","), // elementSepStr
+      FTL_STR("{"), // objectBeginStr
+      FTL_STR("}"), // objectEndStr
+      FTL_STR("["), // arrayBeginStr
+      FTL_STR("]"), // arrayEndStr
+      StrRef(), // newlineStr
+      FTL_STR(","), // inlineElementSepStr
+      true // canonical
       );
     return format;
   }
@@ -44,7 +96,8 @@ struct JSONFormat
       FTL_STR("}"), // objectEndStr
       FTL_STR("["), // arrayBeginStr
       FTL_STR("]"), // arrayEndStr
-      StrRef() // newlineStr
+      StrRef(), // newlineStr
+      FTL_STR(",") // inlineElementSepStr
       );
     return format;
   }
@@ -59,7 +112,9 @@ protected:
     StrRef theObjectEndStr,
     StrRef theArrayBeginStr,
     StrRef theArrayEndStr,
-    StrRef theNewlineStr
+    StrRef theNewlineStr,
+    StrRef theInlineElementSepStr,
+    bool theCanonical = false
     )
     : indentStr( theIndentStr )
     , memberSepStr( theMemberSepStr )
@@ -69,6 +124,10 @@ protected:
     , arrayBeginStr( theArrayBeginStr )
     , arrayEndStr( theArrayEndStr )
     , newlineStr( theNewlineStr )
+    , inlineElementSepStr( theInlineElementSepStr )
+    , float64Precision( 0 )
+    , canonical( theCanonical )
+    , inlineNumberArrays( false )
     {}
 };
 
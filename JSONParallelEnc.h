@@ -0,0 +1,509 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+#include <FTL/JSONValue.h>
+
+#include <string>
+#include <vector>
+#if defined(FTL_PLATFORM_POSIX)
+# include <errno.h>
+# include <limits.h>
+# include <pthread.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#elif defined(FTL_PLATFORM_WINDOWS)
+# include <Windows.h>
+#else
+# error "Unsupported FTL_PLATFORM_..."
+#endif
+
+//
+// Usage:
+//
+// JSONParallelEnc parallelEnc( jsonValue, JSONFormat::Packed() );
+// std::string string;
+// parallelEnc.appendTo( string );
+//
+// The output is byte-identical to jsonValue->encode( format ).  Large
+// arrays and objects are cut into chunks of consecutive elements that are
+// encoded concurrently, each into its own string; the brackets, braces
+// and separators around them are encoded up front on the calling thread.
+//
+
+FTL_NAMESPACE_BEGIN
+
+class JSONParallelEnc
+{
+  JSONParallelEnc( JSONParallelEnc const & );
+  JSONParallelEnc &operator=( JSONParallelEnc const & );
+
+  struct Chunk
+  {
+    JSONValue const *container;
+    uint32_t indents;
+    uint32_t begin;
+    uint32_t end;
+    size_t frameOffset;
+    std::string string;
+  };
+
+  struct Worker
+  {
+    JSONParallelEnc *parallelEnc;
+    uint32_t index;
+    uint32_t count;
+    bool failed;
+  };
+
+public:
+
+  static const size_t MinChunkWeight = 64 * 1024;
+
+  // threadCount == 0 means one thread per processor.  The format is
+  // copied, so a temporary may be passed.  Smaller values of
+  // minChunkWeight split even small values, which is useful for testing.
+  JSONParallelEnc(
+    JSONValue const *jsonValue,
+    JSONFormat const &format = JSONFormat::Pretty(),
+    uint32_t threadCount = 0,
+    size_t minChunkWeight = MinChunkWeight
+    )
+    : m_format( format )
+  {
+    if ( threadCount == 0 )
+      threadCount = ProcessorCount();
+
+    size_t weight = Weight( jsonValue );
+    m_chunkWeight = (std::max)(
+      minChunkWeight,
+      weight / ( 4 * size_t( threadCount ) )
+      );
+
+    {
+      JSONEnc<std::string> enc( m_frame, m_format );
+      plan( jsonValue, enc, 0, weight );
+    }
+
+    run( (std::min)( threadCount, uint32_t( m_chunks.size() ) ) );
+  }
+
+  size_t size() const
+  {
+    size_t result = m_frame.size();
+    for ( size_t i = 0; i < m_chunks.size(); ++i )
+      result += m_chunks[i].string.size();
+    return result;
+  }
+
+  void appendTo( std::string &string ) const
+  {
+    string.reserve( string.size() + size() );
+    size_t frameOffset = 0;
+    for ( size_t i = 0; i < m_chunks.size(); ++i )
+    {
+      Chunk const &chunk = m_chunks[i];
+      string.append( m_frame, frameOffset, chunk.frameOffset - frameOffset );
+      string += chunk.string;
+      frameOffset = chunk.frameOffset;
+    }
+    string.append( m_frame, frameOffset, std::string::npos );
+  }
+
+  std::string encode() const
+  {
+    std::string result;
+    appendTo( result );
+    return result;
+  }
+
+#if defined(FTL_PLATFORM_POSIX)
+  // Writes the output with gathered writes, without concatenating it
+  // first.  Returns false, with errno set, if a write fails.
+  bool writeTo( int fd ) const
+  {
+    std::vector<struct iovec> iovs;
+    iovs.reserve( 2 * m_chunks.size() + 1 );
+    size_t frameOffset = 0;
+    for ( size_t i = 0; i < m_chunks.size(); ++i )
+    {
+      Chunk const &chunk = m_chunks[i];
+      AddIOV( iovs, m_frame.data() + frameOffset,
+        chunk.frameOffset - frameOffset );
+      AddIOV( iovs, chunk.string.data(), chunk.string.size() );
+      frameOffset = chunk.frameOffset;
+    }
+    AddIOV( iovs, m_frame.data() + frameOffset,
+      m_frame.size() - frameOffset );
+
+    size_t iovIndex = 0;
+    while ( iovIndex < iovs.size() )
+    {
+      int iovCount = int( (std::min)( iovs.size() - iovIndex, size_t(IOV_MAX) ) );
+      ssize_t written = ::writev( fd, &iovs[iovIndex], iovCount );
+      if ( written < 0 )
+      {
+        if ( errno == EINTR )
+          continue;
+        return false;
+      }
+      // Skip what was written, which may end part way through an iov
+      size_t remaining = size_t( written );
+      while ( iovIndex < iovs.size() && remaining >= iovs[iovIndex].iov_len )
+        remaining -= iovs[iovIndex++].iov_len;
+      if ( remaining > 0 )
+      {
+        iovs[iovIndex].iov_base =
+          static_cast<char *>( iovs[iovIndex].iov_base ) + remaining;
+        iovs[iovIndex].iov_len -= remaining;
+      }
+    }
+    return true;
+  }
+#endif
+
+protected:
+
+  // A rough estimate of the encoded size, used to balance the chunks
+  static size_t Weight( JSONValue const *jsonValue )
+  {
+    switch ( jsonValue->getType() )
+    {
+      case JSONValue::Type_String:
+        return 2 + static_cast<JSONString const *>(
+          jsonValue )->getValue().size();
+
+      case JSONValue::Type_Array:
+      {
+        JSONArray const *array = static_cast<JSONArray const *>( jsonValue );
+        if ( array->isTyped() )
+          return 2 + 12 * array->size();
+        size_t result = 2;
+        for ( JSONArray::const_iterator it = array->begin();
+          it != array->end(); ++it )
+          result += 2 + Weight( *it );
+        return result;
+      }
+
+      case JSONValue::Type_Object:
+      {
+        JSONObject const *object = static_cast<JSONObject const *>( jsonValue );
+        size_t result = 2;
+        for ( JSONObject::const_iterator it = object->begin();
+          it != object->end(); ++it )
+          result += 6 + it->first.size() + Weight( it->second );
+        return result;
+      }
+
+      default:
+        return 8;
+    }
+  }
+
+  static uint32_t ProcessorCount()
+  {
+#if defined(FTL_PLATFORM_POSIX)
+    long count = ::sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0? uint32_t( count ): 1;
+#elif defined(FTL_PLATFORM_WINDOWS)
+    SYSTEM_INFO systemInfo;
+    ::GetSystemInfo( &systemInfo );
+    return (std::max)( uint32_t( systemInfo.dwNumberOfProcessors ), uint32_t(1) );
+#endif
+  }
+
+  void addChunk(
+    JSONListEnc<std::string> &listEnc,
+    JSONValue const *container,
+    uint32_t indents,
+    uint32_t begin,
+    uint32_t end
+    )
+  {
+    if ( begin == end )
+      return;
+    m_chunks.resize( m_chunks.size() + 1 );
+    Chunk &chunk = m_chunks.back();
+    chunk.container = container;
+    chunk.indents = indents;
+    chunk.begin = begin;
+    chunk.end = end;
+    chunk.frameOffset = m_frame.size();
+    listEnc.skip( end - begin );
+  }
+
+  // Encodes jsonValue into m_frame, except for runs of elements of large
+  // containers, which are left to chunks.  Large elements are planned
+  // recursively so that a single huge member doesn't end up in one chunk.
+  void plan(
+    JSONValue const *jsonValue,
+    JSONEnc<std::string> &enc,
+    uint32_t indents,
+    size_t weight
+    )
+  {
+    if ( weight < 2 * m_chunkWeight )
+    {
+      jsonValue->encodeTo( enc );
+      return;
+    }
+
+    switch ( jsonValue->getType() )
+    {
+      case JSONValue::Type_Array:
+      {
+        JSONArray const *array = static_cast<JSONArray const *>( jsonValue );
+        JSONArrayEnc<std::string> arrayEnc( enc );
+        uint32_t const size = uint32_t( array->size() );
+
+        if ( array->isTyped() )
+        {
+          uint32_t const chunkSize = uint32_t( (std::max)(
+            size_t(1), m_chunkWeight * size / weight
+            ) );
+          for ( uint32_t begin = 0; begin < size; begin += chunkSize )
+            addChunk( arrayEnc, array, indents, begin,
+              (std::min)( begin + chunkSize, size ) );
+          break;
+        }
+
+        uint32_t runBegin = 0;
+        size_t runWeight = 0;
+        JSONArray::const_iterator const itBegin = array->begin();
+        for ( uint32_t index = 0; index < size; ++index )
+        {
+          JSONValue const *element = *( itBegin + index );
+          size_t elementWeight = Weight( element );
+          if ( elementWeight >= 2 * m_chunkWeight )
+          {
+            addChunk( arrayEnc, array, indents, runBegin, index );
+            runBegin = index + 1;
+            runWeight = 0;
+            JSONEnc<std::string> elementEnc( arrayEnc );
+            plan( element, elementEnc, indents + 1, elementWeight );
+          }
+          else if ( ( runWeight += elementWeight ) >= m_chunkWeight )
+          {
+            addChunk( arrayEnc, array, indents, runBegin, index + 1 );
+            runBegin = index + 1;
+            runWeight = 0;
+          }
+        }
+        addChunk( arrayEnc, array, indents, runBegin, size );
+      }
+      break;
+
+      case JSONValue::Type_Object:
+      {
+        // Canonical output sorts the members, so they are not split
+        if ( m_format.canonical )
+        {
+          jsonValue->encodeTo( enc );
+          break;
+        }
+        JSONObject const *object = static_cast<JSONObject const *>( jsonValue );
+        JSONObjectEnc<std::string> objectEnc( enc );
+        uint32_t const size = uint32_t( object->size() );
+
+        uint32_t runBegin = 0;
+        size_t runWeight = 0;
+        JSONObject::const_iterator const itBegin = object->begin();
+        for ( uint32_t index = 0; index < size; ++index )
+        {
+          JSONObject::const_iterator it = itBegin + index;
+          size_t memberWeight = Weight( it->second );
+          if ( memberWeight >= 2 * m_chunkWeight )
+          {
+            addChunk( objectEnc, object, indents, runBegin, index );
+            runBegin = index + 1;
+            runWeight = 0;
+            JSONEnc<std::string> memberEnc( objectEnc, it->first );
+            plan( it->second, memberEnc, indents + 1, memberWeight );
+          }
+          else if ( ( runWeight += memberWeight ) >= m_chunkWeight )
+          {
+            addChunk( objectEnc, object, indents, runBegin, index + 1 );
+            runBegin = index + 1;
+            runWeight = 0;
+          }
+        }
+        addChunk( objectEnc, object, indents, runBegin, size );
+      }
+      break;
+
+      default:
+        jsonValue->encodeTo( enc );
+        break;
+    }
+  }
+
+  void encodeChunk( Chunk &chunk ) const
+  {
+    chunk.string.clear();
+    JSONEnc<std::string> enc( chunk.string, m_format, chunk.indents );
+
+    if ( JSONArray const *array = chunk.container->maybeCast<JSONArray>() )
+    {
+      JSONArrayEnc<std::string> arrayEnc( enc, chunk.begin );
+      switch ( array->getEleType() )
+      {
+        case JSONArray::EleType_SInt32:
+          static_cast<JSONSInt32Array const *>( array )->encodeValuesTo(
+            arrayEnc, chunk.begin, chunk.end );
+          break;
+        case JSONArray::EleType_Float32:
+          static_cast<JSONFloat32Array const *>( array )->encodeValuesTo(
+            arrayEnc, chunk.begin, chunk.end );
+          break;
+        case JSONArray::EleType_Float64:
+          static_cast<JSONFloat64Array const *>( array )->encodeValuesTo(
+            arrayEnc, chunk.begin, chunk.end );
+          break;
+        default:
+        {
+          JSONArray::const_iterator it = array->begin() + chunk.begin;
+          JSONArray::const_iterator const itEnd = array->begin() + chunk.end;
+          for ( ; it != itEnd; ++it )
+          {
+            JSONEnc<std::string> elementEnc( arrayEnc );
+            (*it)->encodeTo( elementEnc );
+          }
+        }
+        break;
+      }
+    }
+    else
+    {
+      JSONObject const *object = chunk.container->cast<JSONObject>();
+      JSONObjectEnc<std::string> objectEnc( enc, chunk.begin );
+      JSONObject::const_iterator it = object->begin() + chunk.begin;
+      JSONObject::const_iterator const itEnd = object->begin() + chunk.end;
+      for ( ; it != itEnd; ++it )
+      {
+        JSONEnc<std::string> memberEnc( objectEnc, it->first );
+        it->second->encodeTo( memberEnc );
+      }
+    }
+  }
+
+  void work( Worker &worker )
+  {
+    try
+    {
+      for ( size_t i = worker.index; i < m_chunks.size(); i += worker.count )
+        encodeChunk( m_chunks[i] );
+    }
+    catch ( ... )
+    {
+      worker.failed = true;
+    }
+  }
+
+#if defined(FTL_PLATFORM_POSIX)
+  static void *WorkerMain( void *arg )
+  {
+    Worker *worker = static_cast<Worker *>( arg );
+    worker->parallelEnc->work( *worker );
+    return 0;
+  }
+#elif defined(FTL_PLATFORM_WINDOWS)
+  static DWORD WINAPI WorkerMain( LPVOID arg )
+  {
+    Worker *worker = static_cast<Worker *>( arg );
+    worker->parallelEnc->work( *worker );
+    return 0;
+  }
+#endif
+
+  // Chunks are dealt out round-robin; they are of similar weight.  Worker
+  // 0 runs on the calling thread, as does any worker whose thread can't
+  // be started.  Chunks of a failed worker are re-encoded here so that
+  // the exception reaches the caller.
+  void run( uint32_t threadCount )
+  {
+    if ( threadCount == 0 )
+      return;
+
+    std::vector<Worker> workers( threadCount );
+#if defined(FTL_PLATFORM_POSIX)
+    std::vector<pthread_t> threads( threadCount );
+#elif defined(FTL_PLATFORM_WINDOWS)
+    std::vector<HANDLE> threads( threadCount );
+#endif
+    std::vector<bool> started( threadCount, false );
+
+    for ( uint32_t i = 0; i < threadCount; ++i )
+    {
+      workers[i].parallelEnc = this;
+      workers[i].index = i;
+      workers[i].count = threadCount;
+      workers[i].failed = false;
+    }
+
+    for ( uint32_t i = 1; i < threadCount; ++i )
+    {
+#if defined(FTL_PLATFORM_POSIX)
+      started[i] = ::pthread_create(
+        &threads[i], 0, &WorkerMain, &workers[i]
+        ) == 0;
+#elif defined(FTL_PLATFORM_WINDOWS)
+      threads[i] = ::CreateThread( 0, 0, &WorkerMain, &workers[i], 0, 0 );
+      started[i] = threads[i] != 0;
+#endif
+    }
+
+    work( workers[0] );
+
+    for ( uint32_t i = 1; i < threadCount; ++i )
+    {
+      if ( !started[i] )
+        work( workers[i] );
+      else
+      {
+#if defined(FTL_PLATFORM_POSIX)
+        ::pthread_join( threads[i], 0 );
+#elif defined(FTL_PLATFORM_WINDOWS)
+        ::WaitForSingleObject( threads[i], INFINITE );
+        ::CloseHandle( threads[i] );
+#endif
+      }
+    }
+
+    for ( uint32_t i = 0; i < threadCount; ++i )
+    {
+      if ( workers[i].failed )
+      {
+        for ( size_t j = i; j < m_chunks.size(); j += threadCount )
+          encodeChunk( m_chunks[j] );
+      }
+    }
+  }
+
+#if defined(FTL_PLATFORM_POSIX)
+  static void AddIOV(
+    std::vector<struct iovec> &iovs,
+    char const *data,
+    size_t size
+    )
+  {
+    if ( size == 0 )
+      return;
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>( data );
+    iov.iov_len = size;
+    iovs.push_back( iov );
+  }
+#endif
+
+private:
+
+  JSONFormat const m_format;
+  size_t m_chunkWeight;
+  std::string m_frame;
+  std::vector<Chunk> m_chunks;
+};
+
+FTL_NAMESPACE_END
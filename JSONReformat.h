@@ -0,0 +1,243 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/JSONDec.h>
+#include <FTL/JSONEnc.h>
+
+#include <string>
+
+//
+// Reformats JSON text (re-indents, minifies, or turns the loose syntax
+// the decoder accepts -- comments, single-quoted strings, commas as
+// whitespace -- into strict JSON) in a single pass from the decoder's
+// tokens to an encoder, without building JSONValues.
+//
+// JSONStrWithLoc ds( input );
+// JSONReformatter reformatter( ds );
+// std::string output;
+// JSONEnc<> enc( output, JSONFormat::Packed() );
+// reformatter.reformatNext( enc );
+//
+// Strings that are already strict JSON and numbers are copied through
+// as they are, so "1.50" stays "1.50" and integers keep all of their
+// digits; other strings are decoded and re-escaped.  The exception is
+// JSONFormat::Canonical(), for which strings and numbers are always
+// re-encoded, as are non-integers when the format has a
+// float64Precision.  Objects keep their members in input order (and
+// duplicate keys are not detected), so canonical output also needs the
+// input's keys to be sorted; decode to a JSONValue otherwise.
+//
+
+FTL_NAMESPACE_BEGIN
+
+class JSONReformatter
+{
+  JSONReformatter( JSONReformatter const & );
+  JSONReformatter &operator=( JSONReformatter const & );
+
+public:
+
+  JSONReformatter( JSONStrWithLoc &ds )
+    : m_ds( ds ) {}
+
+  // Writes the next value of the input to enc, or returns false at the
+  // end of the input
+  template<typename StringTy>
+  bool reformatNext( JSONEnc<StringTy> &enc )
+  {
+    JSONEnt::SkipWhitespace( m_ds );
+    if ( m_ds.empty() )
+      return false;
+    m_canonical = enc.getFormat().canonical;
+    reformatValue( enc );
+    return true;
+  }
+
+private:
+
+  // Whether a string token can be copied as is: double-quoted, with no
+  // control characters and no "\'" escape
+  static bool IsStrictString( StrRef token )
+  {
+    if ( token.front() != '"' )
+      return false;
+    char const *p = token.data() + 1;
+    char const *const pEnd = token.data() + token.size() - 1;
+    while ( p != pEnd )
+    {
+      char const ch = *p++;
+      if ( uint8_t( ch ) < 0x20 )
+        return false;
+      if ( ch == '\\' )
+      {
+        if ( *p == '\'' )
+          return false;
+        ++p;
+      }
+    }
+    return true;
+  }
+
+  // Consumes a string token, returning it if it can be copied as is;
+  // otherwise returns an empty StrRef, with the decoded string in
+  // m_string
+  StrRef consumeString()
+  {
+    JSONStrWithLoc const tokenDs = m_ds;
+    JSONEnt::ConsumeString( m_ds, 0 );
+    StrRef const token( tokenDs.data(), m_ds.data() - tokenDs.data() );
+    if ( !m_canonical && IsStrictString( token ) )
+      return token;
+
+    JSONStrWithLoc decodeDs = tokenDs;
+    JSONEnt::ConsumeString( decodeDs, &m_ent );
+    m_string.clear();
+    m_ent.stringAppendTo( m_string );
+    return StrRef();
+  }
+
+  template<typename StringTy>
+  void reformatValue( JSONEnc<StringTy> &enc )
+  {
+    JSONStrWithLoc &ds = m_ds;
+    if ( ds.empty() )
+      throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected entity") );
+
+    switch ( ds.front() )
+    {
+      case '{':
+      {
+        ds.drop();
+        JSONObjectEnc<StringTy> objectEnc( enc );
+        for (;;)
+        {
+          JSONEnt::SkipWhitespace( ds );
+          if ( ds.empty() )
+            throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected string or '}'") );
+          if ( ds.front() == '}' )
+          {
+            ds.drop();
+            break;
+          }
+
+          StrRef const key = consumeString();
+
+          JSONEnt::SkipWhitespace( ds );
+          JSONEnt::ConsumeColon( ds );
+          JSONEnt::SkipWhitespace( ds );
+
+          if ( !key.empty() )
+          {
+            JSONEnc<StringTy> memberEnc( objectEnc, JSONQuotedStr( key ) );
+            reformatValue( memberEnc );
+          }
+          else
+          {
+            JSONEnc<StringTy> memberEnc( objectEnc, StrRef( m_string ) );
+            reformatValue( memberEnc );
+          }
+        }
+      }
+      break;
+
+      case '[':
+      {
+        ds.drop();
+        JSONArrayEnc<StringTy> arrayEnc( enc );
+        for (;;)
+        {
+          JSONEnt::SkipWhitespace( ds );
+          if ( ds.empty() )
+            throw JSONMalformedException( ds.line, ds.column, FTL_STR("expected entity or ']'") );
+          if ( ds.front() == ']' )
+          {
+            ds.drop();
+            break;
+          }
+
+          JSONEnc<StringTy> elementEnc( arrayEnc );
+          reformatValue( elementEnc );
+        }
+      }
+      break;
+
+      case '"':
+      case '\'':
+      {
+        StrRef const token = consumeString();
+        if ( !token.empty() )
+        {
+          JSONRawEnc<StringTy> rawEnc( enc, token );
+        }
+        else
+        {
+          JSONStringEnc<StringTy> stringEnc( enc, StrRef( m_string ) );
+        }
+      }
+      break;
+
+      case '-':
+      case '0':
+      case '1':
+      case '2':
+      case '3':
+      case '4':
+      case '5':
+      case '6':
+      case '7':
+      case '8':
+      case '9':
+      {
+        JSONStrWithLoc const tokenDs = ds;
+        int32_t int32Value;
+        double float64Value;
+        bool const isFloat =
+          JSONEnt::ConsumeNumber( ds, false, int32Value, float64Value );
+        if ( !m_canonical
+          && ( !isFloat || enc.getFormat().float64Precision == 0 ) )
+        {
+          JSONRawEnc<StringTy> rawEnc(
+            enc,
+            StrRef( tokenDs.data(), ds.data() - tokenDs.data() )
+            );
+          break;
+        }
+
+        ds = tokenDs;
+        if ( isFloat )
+        {
+          JSONEnt::ConsumeNumber( ds, true, int32Value, float64Value );
+          JSONFloat64Enc<StringTy> float64Enc( enc, float64Value );
+        }
+        else
+        {
+          JSONEnt::ConsumeNumber( ds, true, int32Value, float64Value );
+          JSONSInt32Enc<StringTy> sint32Enc( enc, int32Value );
+        }
+      }
+      break;
+
+      default:
+      {
+        // null, true and false, or an error
+        JSONStrWithLoc const tokenDs = ds;
+        JSONEnt::ConsumeEntity( ds, 0 );
+        JSONRawEnc<StringTy> rawEnc(
+          enc,
+          StrRef( tokenDs.data(), ds.data() - tokenDs.data() )
+          );
+      }
+      break;
+    }
+  }
+
+  JSONStrWithLoc &m_ds;
+  bool m_canonical;
+  JSONEnt m_ent;
+  std::string m_string;
+};
+
+FTL_NAMESPACE_END
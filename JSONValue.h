@@ -7,11 +7,48 @@
 #include <FTL/CStrRef.h>
 #include <FTL/JSONDec.h>
 #include <FTL/JSONEnc.h>
+#include <FTL/JSONEncSink.h>
 #include <FTL/OrderedStringMap.h>
 #include <FTL/OwnedPtr.h>
 
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#if defined(FTL_PLATFORM_WINDOWS)
+# include <intrin.h>
+#endif
+
 FTL_NAMESPACE_BEGIN
 
+class JSONValue;
+struct JSONMemoryUsage;
+
+// Heap allocations made by JSONValue::Decode: each value is counted as it
+// is created, using the same accounting as JSONMemoryUsage, along with
+// temporary buffers that are released before Decode returns.
+struct JSONDecStats
+{
+  size_t valueCount;
+  size_t allocCount;
+  size_t allocBytes;
+
+  JSONDecStats()
+    : valueCount( 0 )
+    , allocCount( 0 )
+    , allocBytes( 0 )
+    {}
+
+  void addValue( JSONValue const *jsonValue );
+
+  void addTemporary( size_t bytes )
+  {
+    ++allocCount;
+    allocBytes += bytes;
+  }
+};
+
 class JSONValue
 {
 public:
@@ -27,13 +64,13 @@ public:
     Type_Object
   };
 
-  static JSONValue *Create( JSONEnt const &je );
+  static JSONValue *Create( JSONEnt const &je, JSONDecStats *stats = 0 );
 
-  static JSONValue *Decode( JSONStrWithLoc &ds );
-  static JSONValue *Decode( FTL::StrRef str )
+  static JSONValue *Decode( JSONStrWithLoc &ds, JSONDecStats *stats = 0 );
+  static JSONValue *Decode( FTL::StrRef str, JSONDecStats *stats = 0 )
   {
     JSONStrWithLoc ds( str );
-    return Decode( ds );
+    return Decode( ds, stats );
   }
 
   Type getType() const
@@ -97,16 +134,43 @@ public:
   double getFloat64Value() const;
   FTL::CStrRef getStringValue() const;
 
-  virtual void encodeTo( JSONEnc<std::string> &je ) const = 0;
+  // Dispatches on getType() (see JSONVisit) rather than virtually, so
+  // any JSONEnc string type can be used.
+  template<typename StringTy>
+  void encodeTo( JSONEnc<StringTy> &enc ) const;
 
-  std::string encode() const
+  std::string encode(
+    JSONFormat const &format = JSONFormat::Pretty()
+    ) const
   {
     std::string result;
-    JSONEnc<std::string> je( result );
+    JSONEnc<std::string> je( result, format );
     encodeTo( je );
     return result;
   }
 
+  // The exact length of encode( format ), without building it
+  size_t encodedSize(
+    JSONFormat const &format = JSONFormat::Pretty()
+    ) const;
+
+  // The same as encode(), but measures the output first so that it is
+  // allocated once, at its exact size
+  std::string encodeExact(
+    JSONFormat const &format = JSONFormat::Pretty()
+    ) const;
+
+  // A hash (Hash64) of encode( JSONFormat::Canonical() ), computed without
+  // building the string; equal values have equal hashes regardless of
+  // member order or number representation.
+  uint64_t canonicalHash( uint64_t seed = 0 ) const;
+
+  // Adds this value and everything it owns to usage.
+  void getMemoryUsage( JSONMemoryUsage &usage ) const;
+
+  // Approximate heap bytes used by this value and everything it owns.
+  size_t memoryUsage() const;
+
 protected:
 
   JSONValue( Type type )
@@ -129,11 +193,6 @@ public:
 
   JSONNull()
     : JSONValue( Type_Null ) {}
-
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-    { JSONNullEnc<std::string> nullEnc( enc ); }
 };
 
 class JSONBoolean : public JSONValue
@@ -159,11 +218,6 @@ public:
   void setValue( bool value )
     { m_value = value; }
 
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-    { JSONBooleanEnc<std::string> booleanEnc( enc, m_value ); }
-
 private:
 
   bool m_value;
@@ -197,11 +251,6 @@ public:
   void setValue( int32_t value )
     { m_value = value; }
 
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-    { JSONSInt32Enc<std::string> sint32Enc( enc, m_value ); }
-
 private:
 
   int32_t m_value;
@@ -235,11 +284,6 @@ public:
   void setValue( double value )
     { m_value = value; }
 
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-    { JSONFloat64Enc<std::string> float64Enc( enc, m_value ); }
-
 private:
 
   double m_value;
@@ -252,6 +296,8 @@ inline double JSONValue::getFloat64Value() const
 
 class JSONString : public JSONValue
 {
+  friend struct JSONMemoryUsage;
+
 public:
 
   static bool classof( JSONValue const *jsonValue )
@@ -283,11 +329,6 @@ public:
   bool empty() const
     { return m_value.empty(); }
 
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-    { JSONStringEnc<std::string> stringEnc( enc, StrRef( m_value ) ); }
-
 private:
 
   std::string m_value;
@@ -300,12 +341,34 @@ inline FTL::CStrRef JSONValue::getStringValue() const
 
 class JSONObject;
 
+template<typename EleTy>
+class JSONTypedArray;
+
 class JSONArray : public JSONValue
 {
+  friend struct JSONMemoryUsage;
+
   typedef std::vector<JSONValue *> Vec;
 
 public:
 
+  // Homogeneous numeric arrays keep their elements in a contiguous
+  // buffer (see JSONTypedArray) rather than as individual JSONValues, so
+  // their elements are read as numbers: with getSInt32() and
+  // getFloat64(), or all at once with JSONTypedArray::getValues().  The
+  // accessors that return JSONValue pointers (get(), operator[], begin()
+  // and end()) convert a non-const typed array to a generic one, once.
+  // On a const typed array they return JSONSInt32s or JSONFloat64s boxed
+  // on first use, which concurrent readers may do safely, and which stay
+  // valid until the array's size changes.
+  enum EleType
+  {
+    EleType_Value,
+    EleType_SInt32,
+    EleType_Float32,
+    EleType_Float64
+  };
+
   static bool classof( JSONValue const *jsonValue )
     { return jsonValue->getType() == Type_Array; }
 
@@ -313,50 +376,62 @@ public:
     { return FTL_STR("not an array"); }
 
   JSONArray()
-    : JSONValue( Type_Array ) {}
+    : JSONValue( Type_Array )
+    , m_eleType( EleType_Value )
+    , m_typedData( 0 )
+    , m_typedSize( 0 )
+    , m_typedCapacity( 0 )
+    , m_boxed( 0 )
+    {}
 
   ~JSONArray()
-    { clear(); }
+  {
+    clearGeneric();
+    clearBoxed();
+    free( m_typedData );
+  }
+
+  EleType getEleType() const
+    { return m_eleType; }
+
+  bool isTyped() const
+    { return m_eleType != EleType_Value; }
 
   bool empty() const
-    { return m_vec.empty(); }
+    { return size() == 0; }
 
   size_t size() const
-    { return m_vec.size(); }
+    { return isTyped()? m_typedSize: m_vec.size(); }
 
   JSONValue const *get( size_t index ) const
   {
-    if ( index < m_vec.size() )
-      return m_vec[index];
-    else
-      throw JSONInvalidIndexException( index );
+    checkIndex( index );
+    return isTyped()? boxed()[index]: m_vec[index];
   }
   
   bool getBoolean( size_t index ) const
   {
+    if ( isTyped() )
+    {
+      checkIndex( index );
+      throw JSONInvalidCastException( JSONBoolean::NotAStr() );
+    }
     JSONValue const *jsonValue = get( index );
     bool result = jsonValue->cast<JSONBoolean>()->getValue();
     return result;
   }
   
-  int32_t getSInt32( size_t index ) const
-  {
-    JSONValue const *jsonValue = get( index );
-    int32_t result = jsonValue->cast<JSONSInt32>()->getValue();
-    return result;
-  }
+  int32_t getSInt32( size_t index ) const;
   
-  double getFloat64( size_t index ) const
-  {
-    JSONValue const *jsonValue = get( index );
-    if ( JSONSInt32 const *jsonSInt32 = jsonValue->maybeCast<JSONSInt32>() )
-      return (double)jsonSInt32->getValue();
-    double result = jsonValue->cast<JSONFloat64>()->getValue();
-    return result;
-  }
+  double getFloat64( size_t index ) const;
  
   CStrRef getString( size_t index ) const
   {
+    if ( isTyped() )
+    {
+      checkIndex( index );
+      throw JSONInvalidCastException( JSONString::NotAStr() );
+    }
     JSONValue const *jsonValue = get( index );
     CStrRef result = jsonValue->cast<JSONString>()->getValue();
     return result;
@@ -366,6 +441,11 @@ public:
   
   JSONArray const *getArray( size_t index ) const
   {
+    if ( isTyped() )
+    {
+      checkIndex( index );
+      throw JSONInvalidCastException( JSONArray::NotAStr() );
+    }
     JSONValue const *jsonValue = get( index );
     return jsonValue->cast<JSONArray>();
   }
@@ -375,10 +455,9 @@ public:
 
   JSONValue *get( size_t index )
   {
-    if ( index < m_vec.size() )
-      return m_vec[index];
-    else
-      throw JSONInvalidIndexException( index );
+    checkIndex( index );
+    untype();
+    return m_vec[index];
   }
 
   JSONValue *operator[]( size_t index )
@@ -387,26 +466,45 @@ public:
   typedef Vec::const_iterator const_iterator;
 
   const_iterator begin() const
-    { return m_vec.begin(); }
+    { return isTyped()? boxed().begin(): m_vec.begin(); }
 
   const_iterator end() const
-    { return m_vec.end(); }
+    { return isTyped()? boxed().end(): m_vec.end(); }
+
+  const_iterator begin()
+  {
+    untype();
+    return m_vec.begin();
+  }
 
+  const_iterator end()
+  {
+    untype();
+    return m_vec.end();
+  }
+
+  // A typed array stays typed, with no values
   void clear()
   {
-    for ( Vec::const_iterator it = m_vec.begin(); it != m_vec.end(); ++it )
-      delete *it;
-    m_vec.clear();
+    clearGeneric();
+    clearBoxed();
+    m_typedSize = 0;
   }
 
   void reserve( size_t size )
     { m_vec.reserve( size ); }
 
   void push_back( JSONValue *jsonValue )
-    { m_vec.push_back( jsonValue ); }
+  {
+    untype();
+    m_vec.push_back( jsonValue );
+  }
 
   void extend_take( FTL::OwnedPtr<FTL::JSONArray> &that )
   {
+    untype();
+    that->untype();
+
     Vec thatVec;
     thatVec.swap( that->m_vec );
 
@@ -421,24 +519,414 @@ public:
 
 protected:
 
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
+  JSONArray( EleType eleType )
+    : JSONValue( Type_Array )
+    , m_eleType( eleType )
+    , m_typedData( 0 )
+    , m_typedSize( 0 )
+    , m_typedCapacity( 0 )
+    , m_boxed( 0 )
+    {}
+
+  void checkIndex( size_t index ) const
+  {
+    if ( index >= size() )
+      throw JSONInvalidIndexException( index );
+  }
+
+  // The typed buffer, which holds m_typedSize values of the EleTy that
+  // m_eleType names
+  template<typename EleTy>
+  EleTy *typedValues() const
+    { return static_cast<EleTy *>( m_typedData ); }
+
+  size_t typedSize() const
+    { return m_typedSize; }
+
+  void reserveTyped( size_t capacity, size_t eleSize )
+  {
+    if ( capacity <= m_typedCapacity )
+      return;
+    void *typedData = realloc( m_typedData, capacity * eleSize );
+    if ( !typedData )
+      throw std::bad_alloc();
+    m_typedData = typedData;
+    m_typedCapacity = capacity;
+  }
+
+  // Resizes the typed buffer, zeroing any new values
+  void resizeTyped( size_t size, size_t eleSize )
+  {
+    reserveTyped( size, eleSize );
+    if ( size > m_typedSize )
+      memset(
+        static_cast<char *>( m_typedData ) + m_typedSize * eleSize,
+        0,
+        ( size - m_typedSize ) * eleSize
+        );
+    m_typedSize = size;
+  }
+
+  template<typename EleTy>
+  void appendTyped( EleTy value )
+  {
+    if ( m_typedSize == m_typedCapacity )
+      reserveTyped(
+        std::max( m_typedCapacity * 2, size_t( 4 ) ), sizeof( EleTy )
+        );
+    typedValues<EleTy>()[m_typedSize++] = value;
+  }
+
+  // Converts a typed array to a generic one, with a JSONValue for each of
+  // its values; the typed accessors then throw
+  void untype();
+
+  // Changing the typed values invalidates the boxes
+  void clearBoxed()
   {
-    JSONArrayEnc<std::string> arrayEnc( enc );
-    for ( Vec::const_iterator it = m_vec.begin(); it != m_vec.end(); ++it )
+    if ( m_boxed )
     {
-      JSONValue const *value = *it;
-      JSONEnc<std::string> elementEnc( arrayEnc );
-      value->encodeTo( elementEnc );
+      DeleteValues( *m_boxed );
+      delete m_boxed;
+      m_boxed = 0;
     }
   }
 
+  // Updates the box of a value set in place, if there is one
+  template<typename EleTy>
+  void setBoxed( size_t index, EleTy value )
+  {
+    if ( !m_boxed )
+      return;
+    JSONValue *jsonValue = ( *m_boxed )[index];
+    if ( JSONSInt32 *jsonSInt32 = jsonValue->maybeCast<JSONSInt32>() )
+      jsonSInt32->setValue( int32_t( value ) );
+    else
+      jsonValue->cast<JSONFloat64>()->setValue( double( value ) );
+  }
+
 private:
 
+  // The boxes of a typed array's values, made by the first const generic
+  // access.  Threads that race to make them each box the values, and all
+  // but the first to publish theirs delete them.
+  Vec const &boxed() const
+  {
+    if ( Vec const *result = loadBoxed() )
+      return *result;
+    Vec *vec = new Vec;
+    try
+    {
+      box( *vec );
+    }
+    catch ( ... )
+    {
+      delete vec;
+      throw;
+    }
+    if ( !publishBoxed( vec ) )
+    {
+      DeleteValues( *vec );
+      delete vec;
+    }
+    return *loadBoxed();
+  }
+
+  Vec const *loadBoxed() const
+  {
+#if defined(FTL_PLATFORM_WINDOWS)
+    return static_cast<Vec const *>(
+      _InterlockedCompareExchangePointer(
+        reinterpret_cast<void *volatile *>( &m_boxed ), 0, 0
+        )
+      );
+#else
+    return __atomic_load_n( &m_boxed, __ATOMIC_ACQUIRE );
+#endif
+  }
+
+  // Sets m_boxed to boxed unless another thread already has
+  bool publishBoxed( Vec *boxed ) const
+  {
+#if defined(FTL_PLATFORM_WINDOWS)
+    return _InterlockedCompareExchangePointer(
+      reinterpret_cast<void *volatile *>( &m_boxed ), boxed, 0
+      ) == 0;
+#else
+    Vec *expected = 0;
+    return __atomic_compare_exchange_n(
+      &m_boxed, &expected, boxed, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE
+      );
+#endif
+  }
+
+  template<typename EleTy, typename BoxedTy>
+  void boxTyped( Vec &vec ) const
+  {
+    EleTy const *values = typedValues<EleTy>();
+    for ( size_t i = 0; i < m_typedSize; ++i )
+      vec.push_back( new BoxedTy( values[i] ) );
+  }
+
+  // Appends a JSONValue for each typed value to vec, or none if running
+  // out of memory part way
+  void box( Vec &vec ) const;
+
+  static void DeleteValues( Vec &vec )
+  {
+    for ( Vec::const_iterator it = vec.begin(); it != vec.end(); ++it )
+      delete *it;
+    vec.clear();
+  }
+
+  void clearGeneric()
+    { DeleteValues( m_vec ); }
+
+  EleType m_eleType;
   Vec m_vec;
+  void *m_typedData;
+  size_t m_typedSize;
+  size_t m_typedCapacity;
+  mutable Vec *m_boxed;
+};
+
+template<typename EleTy>
+struct JSONTypedArrayTraits;
+
+template<>
+struct JSONTypedArrayTraits<int32_t>
+{
+  static const JSONArray::EleType EleType = JSONArray::EleType_SInt32;
+  static StrRef NotAStr()
+    { return FTL_STR("not an integer array"); }
+};
+
+template<>
+struct JSONTypedArrayTraits<float>
+{
+  static const JSONArray::EleType EleType = JSONArray::EleType_Float32;
+  static StrRef NotAStr()
+    { return FTL_STR("not a float32 array"); }
+};
+
+template<>
+struct JSONTypedArrayTraits<double>
+{
+  static const JSONArray::EleType EleType = JSONArray::EleType_Float64;
+  static StrRef NotAStr()
+    { return FTL_STR("not a scalar array"); }
+};
+
+// The typed interface to an array created typed.  The values live in
+// JSONArray's typed buffer; once non-const generic access has converted
+// the array (see JSONArray), classof() no longer matches and the
+// accessors here throw JSONInvalidCastException.
+template<typename EleTy>
+class JSONTypedArray : public JSONArray
+{
+  typedef JSONTypedArrayTraits<EleTy> Traits;
+
+public:
+
+  static bool classof( JSONValue const *jsonValue )
+  {
+    return JSONArray::classof( jsonValue )
+      && static_cast<JSONArray const *>( jsonValue )->getEleType()
+        == Traits::EleType;
+  }
+
+  static StrRef NotAStr()
+    { return Traits::NotAStr(); }
+
+  JSONTypedArray()
+    : JSONArray( Traits::EleType ) {}
+
+  JSONTypedArray( ArrayRef<EleTy> values )
+    : JSONArray( Traits::EleType )
+  {
+    if ( !values.empty() )
+      memcpy(
+        resizeValues( values.size() ),
+        values.data(),
+        values.size() * sizeof( EleTy )
+        );
+  }
+
+  ArrayRef<EleTy> getValues() const
+  {
+    checkTyped();
+    return ArrayRef<EleTy>( typedValues<EleTy>(), typedSize() );
+  }
+
+  EleTy getValue( size_t index ) const
+  {
+    checkTyped();
+    checkIndex( index );
+    return typedValues<EleTy>()[index];
+  }
+
+  void setValue( size_t index, EleTy value )
+  {
+    checkTyped();
+    checkIndex( index );
+    typedValues<EleTy>()[index] = value;
+    setBoxed( index, value );
+  }
+
+  void reserveValues( size_t size )
+  {
+    checkTyped();
+    reserveTyped( size, sizeof( EleTy ) );
+  }
+
+  // Resizes to size values, any new ones zero, and returns them all for
+  // writing in place (as decoders do), which must be done before any
+  // const generic access
+  EleTy *resizeValues( size_t size )
+  {
+    checkTyped();
+    clearBoxed();
+    resizeTyped( size, sizeof( EleTy ) );
+    return typedValues<EleTy>();
+  }
+
+  void appendValue( EleTy value )
+  {
+    checkTyped();
+    clearBoxed();
+    appendTyped( value );
+  }
+
+  // Encodes values [begin, end) as elements of arrayEnc, in bulk
+  template<typename StringTy>
+  void encodeValuesTo(
+    JSONArrayEnc<StringTy> &arrayEnc,
+    size_t begin,
+    size_t end
+    ) const
+  {
+    checkTyped();
+    assert( begin <= end && end <= typedSize() );
+    if ( begin != end )
+      arrayEnc.appendValues(
+        ArrayRef<EleTy>( typedValues<EleTy>() + begin, end - begin )
+        );
+  }
+
+private:
+
+  void checkTyped() const
+  {
+    if ( getEleType() != Traits::EleType )
+      throw JSONInvalidCastException( Traits::NotAStr() );
+  }
 };
 
+typedef JSONTypedArray<int32_t> JSONSInt32Array;
+typedef JSONTypedArray<float> JSONFloat32Array;
+typedef JSONTypedArray<double> JSONFloat64Array;
+
+inline int32_t JSONArray::getSInt32( size_t index ) const
+{
+  switch ( m_eleType )
+  {
+    case EleType_SInt32:
+      checkIndex( index );
+      return typedValues<int32_t>()[index];
+    case EleType_Float32:
+    case EleType_Float64:
+      checkIndex( index );
+      throw JSONInvalidCastException( JSONSInt32::NotAStr() );
+    default:
+    {
+      JSONValue const *jsonValue = get( index );
+      int32_t result = jsonValue->cast<JSONSInt32>()->getValue();
+      return result;
+    }
+  }
+}
+
+inline double JSONArray::getFloat64( size_t index ) const
+{
+  switch ( m_eleType )
+  {
+    case EleType_SInt32:
+      checkIndex( index );
+      return double( typedValues<int32_t>()[index] );
+    case EleType_Float32:
+      checkIndex( index );
+      return double( typedValues<float>()[index] );
+    case EleType_Float64:
+      checkIndex( index );
+      return typedValues<double>()[index];
+    default:
+    {
+      JSONValue const *jsonValue = get( index );
+      if ( JSONSInt32 const *jsonSInt32 = jsonValue->maybeCast<JSONSInt32>() )
+        return (double)jsonSInt32->getValue();
+      double result = jsonValue->cast<JSONFloat64>()->getValue();
+      return result;
+    }
+  }
+}
+
+inline void JSONArray::box( Vec &vec ) const
+{
+  vec.reserve( vec.size() + m_typedSize );
+  try
+  {
+    switch ( m_eleType )
+    {
+      case EleType_SInt32:
+        boxTyped<int32_t, JSONSInt32>( vec );
+        break;
+      case EleType_Float32:
+        boxTyped<float, JSONFloat64>( vec );
+        break;
+      case EleType_Float64:
+        boxTyped<double, JSONFloat64>( vec );
+        break;
+      default:
+        break;
+    }
+  }
+  catch ( ... )
+  {
+    DeleteValues( vec );
+    throw;
+  }
+}
+
+inline void JSONArray::untype()
+{
+  if ( !isTyped() )
+    return;
+
+  // Box into a separate vector, so that running out of memory part way
+  // leaves the array typed; boxes made by const access are taken over,
+  // so the pointers to them stay valid
+  Vec vec;
+  if ( m_boxed )
+    vec.swap( *m_boxed );
+  else
+  {
+    vec.reserve( std::max( m_vec.capacity(), m_typedSize ) );
+    box( vec );
+  }
+
+  clearBoxed();
+  m_vec.swap( vec );
+  free( m_typedData );
+  m_typedData = 0;
+  m_typedSize = 0;
+  m_typedCapacity = 0;
+  m_eleType = EleType_Value;
+}
+
 class JSONObject : public JSONValue
 {
+  friend struct JSONMemoryUsage;
+
   typedef OrderedStringMap<JSONValue *> Map;
 
 public:
@@ -488,6 +976,9 @@ public:
     m_map.clear();
   }
 
+  void reserve( size_t size )
+    { m_map.reserve( size ); }
+
   bool insert( StrRef key, JSONValue *value )
   {
     return m_map.insert( key, value );
@@ -618,51 +1109,47 @@ public:
     return result;
   }
 
-protected:
-
-  virtual void encodeTo( JSONEnc<std::string> &enc ) const
-  {
-    JSONObjectEnc<std::string> objectEnc( enc );
-    for ( Map::const_iterator it = m_map.begin(); it != m_map.end(); ++it )
-    {
-      StrRef key = it->first;
-      JSONValue const *value = it->second;
-      JSONEnc<std::string> memberEnc( objectEnc, key );
-      value->encodeTo( memberEnc );
-    }
-  }
-
 private:
 
   Map m_map;
 };
 
-inline JSONValue *JSONValue::Create( JSONEnt const &je )
+inline JSONValue *JSONValue::Create(
+  JSONEnt const &je,
+  JSONDecStats *stats
+  )
 {
+  JSONValue *result;
   switch ( je.getType() )
   {
     case JSONEnt::Type_Null:
-      return new JSONNull();
+      result = new JSONNull();
+      break;
 
     case JSONEnt::Type_Boolean:
-      return new JSONBoolean( je.booleanValue() );
+      result = new JSONBoolean( je.booleanValue() );
+      break;
 
     case JSONEnt::Type_Int32:
-      return new JSONSInt32( je.int32Value() );
+      result = new JSONSInt32( je.int32Value() );
+      break;
 
     case JSONEnt::Type_Float64:
-      return new JSONFloat64( je.float64Value() );
+      result = new JSONFloat64( je.float64Value() );
+      break;
 
     case JSONEnt::Type_String:
     {
       std::string string;
       je.stringAppendTo( string ); 
-      return JSONString::CreateWithSwap( string );
+      result = JSONString::CreateWithSwap( string );
     }
+    break;
 
     case JSONEnt::Type_Object:
     {
       OwnedPtr<JSONObject> object( new JSONObject() );
+      object->reserve( je.objectSize() );
 
       JSONStrWithLoc ds( je.getRawStr(), je.getLine(), je.getColumn() );
       JSONObjectDec objectDec( ds );
@@ -682,7 +1169,7 @@ inline JSONValue *JSONValue::Create( JSONEnt const &je )
           keyJE.stringGetData( longKeyCStr );
           key = FTL::StrRef( longKeyCStr, keyJE.stringLength() );
         }
-        JSONValue *value = Create( valueJE );
+        JSONValue *value = Create( valueJE, stats );
         if ( !object->insert( key, value ) )
         {
           delete value;
@@ -694,43 +1181,714 @@ inline JSONValue *JSONValue::Create( JSONEnt const &je )
         }
       }
 
-      return object.take();
+      result = object.take();
     }
+    break;
 
     case JSONEnt::Type_Array:
     {
-      OwnedPtr<JSONArray> array( new JSONArray() );
-      array->reserve( je.arraySize() );
-
       JSONStrWithLoc ds( je.getRawStr(), je.getLine(), je.getColumn() );
       JSONArrayDec arrayDec( ds );
+      uint32_t const size = je.arraySize();
+      if ( size == 0 )
+      {
+        result = new JSONArray();
+        break;
+      }
+
+      // Arrays made up entirely of integers, or entirely of floating
+      // point numbers, are decoded in bulk into typed buffers; the first
+      // element decides which, if either, to try.  If we stop short of
+      // the end the array is mixed and takes the generic path.
+      OwnedPtr<JSONSInt32Array> sint32Array;
+      int32_t const *sint32s = 0;
+      size_t sint32Count = 0;
+      OwnedPtr<JSONFloat64Array> float64Array;
+      double const *float64s = 0;
+      size_t float64Count = 0;
+      bool isFloat;
+      if ( arrayDec.peekNumber( isFloat ) )
+      {
+        if ( !isFloat )
+        {
+          sint32Array = new JSONSInt32Array;
+          int32_t *values = sint32Array->resizeValues( size );
+          sint32Count = arrayDec.getNextSInt32s( values, size );
+          if ( sint32Count == size )
+          {
+            result = sint32Array.take();
+            break;
+          }
+          sint32s = values;
+          if ( stats )
+            stats->addTemporary( size * sizeof( int32_t ) );
+        }
+        else
+        {
+          float64Array = new JSONFloat64Array;
+          double *values = float64Array->resizeValues( size );
+          float64Count = arrayDec.getNextFloat64s( values, size );
+          if ( float64Count == size )
+          {
+            result = float64Array.take();
+            break;
+          }
+          float64s = values;
+          if ( stats )
+            stats->addTemporary( size * sizeof( double ) );
+        }
+      }
+
+      OwnedPtr<JSONArray> array( new JSONArray() );
+      array->reserve( size );
+      for ( size_t i = 0; i < sint32Count; ++i )
+      {
+        JSONValue *element = new JSONSInt32( sint32s[i] );
+        array->push_back( element );
+        if ( stats )
+          stats->addValue( element );
+      }
+      for ( size_t i = 0; i < float64Count; ++i )
+      {
+        JSONValue *element = new JSONFloat64( float64s[i] );
+        array->push_back( element );
+        if ( stats )
+          stats->addValue( element );
+      }
       JSONEnt elementJE;
       while ( arrayDec.getNext( elementJE ) )
-        array->push_back( Create( elementJE ) );
+        array->push_back( Create( elementJE, stats ) );
 
-      return array.take();
+      result = array.take();
     }
+    break;
 
     default:
       throw JSONInternalErrorException();
       break;
   }
+  if ( stats )
+    stats->addValue( result );
+  return result;
 }
 
-inline JSONValue *JSONValue::Decode( JSONStrWithLoc &ds )
+inline JSONValue *JSONValue::Decode(
+  JSONStrWithLoc &ds,
+  JSONDecStats *stats
+  )
 {
   JSONDec jd( ds );
   JSONEnt je;
   OwnedPtr<JSONValue> result;
   if ( jd.getNext( je ) )
-    result = Create( je );
+    result = Create( je, stats );
   return result.take();
 }
 
 inline JSONObject const *JSONArray::getObject( size_t index ) const
 {
+  if ( isTyped() )
+  {
+    checkIndex( index );
+    throw JSONInvalidCastException( JSONObject::NotAStr() );
+  }
   JSONValue const *jsonValue = get( index );
   return jsonValue->cast<JSONObject>();
 }
 
+// Calls handler( node ) with node cast to its concrete class, switching
+// on its type: no virtual calls and no cast exceptions.  Typed arrays are
+// passed as JSONSInt32Array, JSONFloat32Array or JSONFloat64Array, which
+// a handler with no overload for them receives as a plain JSONArray.
+//
+// struct CountStrings
+// {
+//   size_t count;
+//   CountStrings() : count( 0 ) {}
+//   void operator()( JSONString const & ) { ++count; }
+//   void operator()( JSONArray const &array ) { ... JSONVisit( *it, *this ) ... }
+//   void operator()( JSONValue const & ) {}
+// };
+//
+template<typename HandlerTy>
+inline void JSONVisit( JSONValue const *jsonValue, HandlerTy &handler )
+{
+  switch ( jsonValue->getType() )
+  {
+    case JSONValue::Type_Null:
+      handler( *static_cast<JSONNull const *>( jsonValue ) );
+      break;
+
+    case JSONValue::Type_Boolean:
+      handler( *static_cast<JSONBoolean const *>( jsonValue ) );
+      break;
+
+    case JSONValue::Type_SInt32:
+      handler( *static_cast<JSONSInt32 const *>( jsonValue ) );
+      break;
+
+    case JSONValue::Type_Float64:
+      handler( *static_cast<JSONFloat64 const *>( jsonValue ) );
+      break;
+
+    case JSONValue::Type_String:
+      handler( *static_cast<JSONString const *>( jsonValue ) );
+      break;
+
+    case JSONValue::Type_Array:
+    {
+      JSONArray const *array = static_cast<JSONArray const *>( jsonValue );
+      switch ( array->getEleType() )
+      {
+        case JSONArray::EleType_SInt32:
+          handler( *static_cast<JSONSInt32Array const *>( array ) );
+          break;
+        case JSONArray::EleType_Float32:
+          handler( *static_cast<JSONFloat32Array const *>( array ) );
+          break;
+        case JSONArray::EleType_Float64:
+          handler( *static_cast<JSONFloat64Array const *>( array ) );
+          break;
+        default:
+          handler( *array );
+          break;
+      }
+    }
+    break;
+
+    case JSONValue::Type_Object:
+      handler( *static_cast<JSONObject const *>( jsonValue ) );
+      break;
+
+    default:
+      throw JSONInternalErrorException();
+  }
+}
+
+template<typename StringTy>
+class JSONValueEnc
+{
+public:
+
+  JSONValueEnc( JSONEnc<StringTy> &enc )
+    : m_enc( enc ) {}
+
+  void operator()( JSONNull const & )
+    { JSONNullEnc<StringTy> nullEnc( m_enc ); }
+
+  void operator()( JSONBoolean const &jsonBoolean )
+    { JSONBooleanEnc<StringTy> booleanEnc( m_enc, jsonBoolean.getValue() ); }
+
+  void operator()( JSONSInt32 const &jsonSInt32 )
+    { JSONSInt32Enc<StringTy> sint32Enc( m_enc, jsonSInt32.getValue() ); }
+
+  void operator()( JSONFloat64 const &jsonFloat64 )
+    { JSONFloat64Enc<StringTy> float64Enc( m_enc, jsonFloat64.getValue() ); }
+
+  void operator()( JSONString const &jsonString )
+  {
+    JSONStringEnc<StringTy> stringEnc(
+      m_enc, StrRef( jsonString.getValue() )
+      );
+  }
+
+  template<typename EleTy>
+  void operator()( JSONTypedArray<EleTy> const &jsonArray )
+  {
+    JSONArrayEnc<StringTy> arrayEnc( m_enc );
+    jsonArray.encodeValuesTo( arrayEnc, 0, jsonArray.size() );
+  }
+
+  void operator()( JSONArray const &jsonArray )
+  {
+    JSONArrayEnc<StringTy> arrayEnc( m_enc );
+    for ( JSONArray::const_iterator it = jsonArray.begin();
+      it != jsonArray.end(); ++it )
+    {
+      JSONEnc<StringTy> elementEnc( arrayEnc );
+      (*it)->encodeTo( elementEnc );
+    }
+  }
+
+  void operator()( JSONObject const &jsonObject )
+  {
+    JSONObjectEnc<StringTy> objectEnc( m_enc );
+    if ( m_enc.getFormat().canonical && jsonObject.size() > 1 )
+    {
+      std::vector<JSONObject::const_iterator> members;
+      members.reserve( jsonObject.size() );
+      for ( JSONObject::const_iterator it = jsonObject.begin();
+        it != jsonObject.end(); ++it )
+        members.push_back( it );
+      std::sort( members.begin(), members.end(), KeyLess() );
+      for ( size_t i = 0; i < members.size(); ++i )
+      {
+        JSONEnc<StringTy> memberEnc( objectEnc, members[i]->first );
+        members[i]->second->encodeTo( memberEnc );
+      }
+      return;
+    }
+    for ( JSONObject::const_iterator it = jsonObject.begin();
+      it != jsonObject.end(); ++it )
+    {
+      JSONEnc<StringTy> memberEnc( objectEnc, it->first );
+      it->second->encodeTo( memberEnc );
+    }
+  }
+
+private:
+
+  struct KeyLess
+  {
+    bool operator()(
+      JSONObject::const_iterator lhs,
+      JSONObject::const_iterator rhs
+      ) const
+      { return StrRef( lhs->first ) < StrRef( rhs->first ); }
+  };
+
+  JSONEnc<StringTy> &m_enc;
+};
+
+template<typename StringTy>
+inline void JSONValue::encodeTo( JSONEnc<StringTy> &enc ) const
+{
+  JSONValueEnc<StringTy> valueEnc( enc );
+  JSONVisit( this, valueEnc );
+}
+
+// An encoder functor (see JSONEncodeExact) for a JSONValue
+class JSONValueEncoder
+{
+public:
+
+  JSONValueEncoder( JSONValue const *jsonValue )
+    : m_jsonValue( jsonValue ) {}
+
+  template<typename StringTy>
+  void operator()( JSONEnc<StringTy> &enc ) const
+    { m_jsonValue->encodeTo( enc ); }
+
+private:
+
+  JSONValue const *m_jsonValue;
+};
+
+inline size_t JSONValue::encodedSize( JSONFormat const &format ) const
+{
+  return JSONEncodedSize( JSONValueEncoder( this ), format );
+}
+
+inline std::string JSONValue::encodeExact( JSONFormat const &format ) const
+{
+  return JSONEncodeExact( JSONValueEncoder( this ), format );
+}
+
+inline uint64_t JSONValue::canonicalHash( uint64_t seed ) const
+{
+  JSONEncHashSink sink( seed );
+  {
+    JSONEnc<JSONEncHashSink> enc( sink, JSONFormat::Canonical() );
+    encodeTo( enc );
+  }
+  return sink.digest();
+}
+
+// Approximate heap footprint of JSONValue trees, broken down by node kind.
+// Heap blocks are counted at the size requested, without allocator
+// overhead; a string's buffer counts only once it no longer fits in the
+// std::string itself.
+//
+// JSONMemoryUsage usage;
+// jsonValue->getMemoryUsage( usage );
+// printf( "%u nodes, %u bytes\n", unsigned( usage.nodeCount() ),
+//   unsigned( usage.totalBytes() ) );
+//
+struct JSONMemoryUsage
+{
+  enum Kind
+  {
+    Kind_Null,
+    Kind_Boolean,
+    Kind_SInt32,
+    Kind_Float64,
+    Kind_String,
+    Kind_Array,
+    Kind_SInt32Array,
+    Kind_Float32Array,
+    Kind_Float64Array,
+    Kind_Object,
+    Kind_Count
+  };
+
+  static StrRef KindName( Kind kind )
+  {
+    switch ( kind )
+    {
+      case Kind_Null: return FTL_STR("null");
+      case Kind_Boolean: return FTL_STR("boolean");
+      case Kind_SInt32: return FTL_STR("sint32");
+      case Kind_Float64: return FTL_STR("float64");
+      case Kind_String: return FTL_STR("string");
+      case Kind_Array: return FTL_STR("array");
+      case Kind_SInt32Array: return FTL_STR("sint32 array");
+      case Kind_Float32Array: return FTL_STR("float32 array");
+      case Kind_Float64Array: return FTL_STR("float64 array");
+      case Kind_Object: return FTL_STR("object");
+      default: return FTL_STR("unknown");
+    }
+  }
+
+  size_t nodeCounts[Kind_Count];
+  size_t nodeBytes[Kind_Count]; // sizeof the node objects
+  size_t stringBytes; // string value buffers
+  size_t keyCount;
+  size_t keyBytes; // object key copies
+  size_t containerBytes; // element vectors, typed buffers, member tables
+  size_t slackBytes; // unused capacity, included in the two above
+  size_t blockCount; // number of heap blocks
+
+  JSONMemoryUsage( bool recurse = true )
+    : m_recurse( recurse )
+    { clear(); }
+
+  void clear()
+  {
+    for ( size_t i = 0; i < Kind_Count; ++i )
+    {
+      nodeCounts[i] = 0;
+      nodeBytes[i] = 0;
+    }
+    stringBytes = 0;
+    keyCount = 0;
+    keyBytes = 0;
+    containerBytes = 0;
+    slackBytes = 0;
+    blockCount = 0;
+  }
+
+  size_t nodeCount() const
+  {
+    size_t result = 0;
+    for ( size_t i = 0; i < Kind_Count; ++i )
+      result += nodeCounts[i];
+    return result;
+  }
+
+  size_t totalBytes() const
+  {
+    size_t result = stringBytes + keyBytes + containerBytes;
+    for ( size_t i = 0; i < Kind_Count; ++i )
+      result += nodeBytes[i];
+    return result;
+  }
+
+  // JSONVisit handlers
+
+  void operator()( JSONNull const &jsonNull )
+    { addNode( Kind_Null, sizeof( jsonNull ) ); }
+
+  void operator()( JSONBoolean const &jsonBoolean )
+    { addNode( Kind_Boolean, sizeof( jsonBoolean ) ); }
+
+  void operator()( JSONSInt32 const &jsonSInt32 )
+    { addNode( Kind_SInt32, sizeof( jsonSInt32 ) ); }
+
+  void operator()( JSONFloat64 const &jsonFloat64 )
+    { addNode( Kind_Float64, sizeof( jsonFloat64 ) ); }
+
+  void operator()( JSONString const &jsonString )
+  {
+    addNode( Kind_String, sizeof( jsonString ) );
+
+    static size_t const inlineCapacity = std::string().capacity();
+    std::string const &value = jsonString.m_value;
+    if ( value.capacity() > inlineCapacity )
+    {
+      stringBytes += value.capacity() + 1;
+      slackBytes += value.capacity() - value.size();
+      ++blockCount;
+    }
+  }
+
+  void operator()( JSONSInt32Array const &jsonArray )
+    { addTypedArray( Kind_SInt32Array, jsonArray ); }
+
+  void operator()( JSONFloat32Array const &jsonArray )
+    { addTypedArray( Kind_Float32Array, jsonArray ); }
+
+  void operator()( JSONFloat64Array const &jsonArray )
+    { addTypedArray( Kind_Float64Array, jsonArray ); }
+
+  void operator()( JSONArray const &jsonArray )
+  {
+    addNode( Kind_Array, sizeof( jsonArray ) );
+    addElements( jsonArray );
+  }
+
+  void operator()( JSONObject const &jsonObject )
+  {
+    addNode( Kind_Object, sizeof( jsonObject ) );
+
+    keyCount += jsonObject.size();
+    jsonObject.m_map.addMemoryUsage(
+      keyBytes, containerBytes, slackBytes, blockCount
+      );
+
+    if ( m_recurse )
+    {
+      for ( JSONObject::const_iterator it = jsonObject.begin();
+        it != jsonObject.end(); ++it )
+        JSONVisit( it->second, *this );
+    }
+  }
+
+private:
+
+  void addNode( Kind kind, size_t bytes )
+  {
+    ++nodeCounts[kind];
+    nodeBytes[kind] += bytes;
+    ++blockCount;
+  }
+
+  template<typename VecTy>
+  void addVector( VecTy const &vec )
+  {
+    if ( vec.capacity() == 0 )
+      return;
+    size_t const eleSize = sizeof( typename VecTy::value_type );
+    containerBytes += vec.capacity() * eleSize;
+    slackBytes += ( vec.capacity() - vec.size() ) * eleSize;
+    ++blockCount;
+  }
+
+  void addElements( JSONArray const &jsonArray )
+  {
+    addVector( jsonArray.m_vec );
+    if ( m_recurse )
+    {
+      for ( JSONArray::Vec::const_iterator it = jsonArray.m_vec.begin();
+        it != jsonArray.m_vec.end(); ++it )
+        JSONVisit( *it, *this );
+    }
+  }
+
+  template<typename EleTy>
+  void addTypedArray( Kind kind, JSONTypedArray<EleTy> const &jsonArray )
+  {
+    addNode( kind, sizeof( jsonArray ) );
+    if ( jsonArray.m_typedCapacity != 0 )
+    {
+      containerBytes += jsonArray.m_typedCapacity * sizeof( EleTy );
+      slackBytes +=
+        ( jsonArray.m_typedCapacity - jsonArray.m_typedSize ) * sizeof( EleTy );
+      ++blockCount;
+    }
+    addVector( jsonArray.m_vec );
+    // Boxes made by const generic access
+    if ( JSONArray::Vec const *boxed = jsonArray.loadBoxed() )
+    {
+      containerBytes += sizeof( *boxed );
+      ++blockCount;
+      addVector( *boxed );
+      if ( m_recurse )
+      {
+        for ( JSONArray::Vec::const_iterator it = boxed->begin();
+          it != boxed->end(); ++it )
+          JSONVisit( *it, *this );
+      }
+    }
+  }
+
+  bool m_recurse;
+};
+
+inline void JSONValue::getMemoryUsage( JSONMemoryUsage &usage ) const
+{
+  JSONVisit( this, usage );
+}
+
+inline size_t JSONValue::memoryUsage() const
+{
+  JSONMemoryUsage usage;
+  getMemoryUsage( usage );
+  return usage.totalBytes();
+}
+
+inline void JSONDecStats::addValue( JSONValue const *jsonValue )
+{
+  JSONMemoryUsage usage( false );
+  JSONVisit( jsonValue, usage );
+  ++valueCount;
+  allocCount += usage.blockCount;
+  allocBytes += usage.totalBytes();
+}
+
+// Iterates over the elements of an array as JSONValueTy const *, which is
+// null for elements of any other type.  The elements of a typed array
+// are read as numbers, without modifying it: they are presented in a
+// JSONSInt32 or JSONFloat64 held by the iterator, which is valid until
+// the iterator moves.
+//
+// JSONArrayElements<JSONObject> elements( jsonArray );
+// for ( JSONArrayElements<JSONObject>::IT it = elements.begin();
+//   it != elements.end(); ++it )
+// {
+//   if ( JSONObject const *jsonObject = *it )
+//     ...
+// }
+//
+template<typename JSONValueTy>
+class JSONArrayElements
+{
+public:
+
+  class IT
+  {
+  public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef JSONValueTy const *value_type;
+    typedef ptrdiff_t difference_type;
+    typedef value_type const *pointer;
+    typedef value_type reference;
+
+    IT( JSONArray const *jsonArray, size_t index )
+      : m_jsonArray( jsonArray )
+      , m_index( index )
+      , m_sint32( 0 )
+      , m_float64( 0.0 )
+      {}
+
+    JSONValueTy const *operator*() const
+    {
+      switch ( m_jsonArray->getEleType() )
+      {
+        case JSONArray::EleType_SInt32:
+          m_sint32.setValue( m_jsonArray->getSInt32( m_index ) );
+          return m_sint32.template maybeCast<JSONValueTy>();
+        case JSONArray::EleType_Float32:
+        case JSONArray::EleType_Float64:
+          m_float64.setValue( m_jsonArray->getFloat64( m_index ) );
+          return m_float64.template maybeCast<JSONValueTy>();
+        default:
+          return m_jsonArray->get( m_index )->template maybeCast<JSONValueTy>();
+      }
+    }
+
+    IT &operator++()
+    {
+      ++m_index;
+      return *this;
+    }
+
+    IT operator++( int )
+    {
+      IT result = *this;
+      ++m_index;
+      return result;
+    }
+
+    bool operator==( IT const &that ) const
+      { return m_index == that.m_index; }
+
+    bool operator!=( IT const &that ) const
+      { return m_index != that.m_index; }
+
+  private:
+
+    JSONArray const *m_jsonArray;
+    size_t m_index;
+    mutable JSONSInt32 m_sint32;
+    mutable JSONFloat64 m_float64;
+  };
+
+  JSONArrayElements( JSONArray const *jsonArray )
+    : m_jsonArray( jsonArray ) {}
+
+  size_t size() const
+    { return m_jsonArray->size(); }
+
+  IT begin() const
+    { return IT( m_jsonArray, 0 ); }
+
+  IT end() const
+    { return IT( m_jsonArray, m_jsonArray->size() ); }
+
+private:
+
+  JSONArray const *m_jsonArray;
+};
+
+// Iterates over the members of an object; value() is a JSONValueTy const *,
+// which is null for members of any other type.
+template<typename JSONValueTy>
+class JSONObjectMembers
+{
+public:
+
+  class IT
+  {
+  public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef JSONValueTy const *value_type;
+    typedef ptrdiff_t difference_type;
+    typedef value_type const *pointer;
+    typedef value_type reference;
+
+    IT( JSONObject::const_iterator it )
+      : m_it( it ) {}
+
+    CStrRef key() const
+      { return m_it->first; }
+
+    JSONValueTy const *value() const
+      { return m_it->second->template maybeCast<JSONValueTy>(); }
+
+    JSONValueTy const *operator*() const
+      { return value(); }
+
+    IT &operator++()
+    {
+      ++m_it;
+      return *this;
+    }
+
+    IT operator++( int )
+    {
+      IT result = *this;
+      ++m_it;
+      return result;
+    }
+
+    bool operator==( IT const &that ) const
+      { return m_it == that.m_it; }
+
+    bool operator!=( IT const &that ) const
+      { return m_it != that.m_it; }
+
+  private:
+
+    JSONObject::const_iterator m_it;
+  };
+
+  JSONObjectMembers( JSONObject const *jsonObject )
+    : m_jsonObject( jsonObject ) {}
+
+  size_t size() const
+    { return m_jsonObject->size(); }
+
+  IT begin() const
+    { return IT( m_jsonObject->begin() ); }
+
+  IT end() const
+    { return IT( m_jsonObject->end() ); }
+
+private:
+
+  JSONObject const *m_jsonObject;
+};
+
 FTL_NAMESPACE_END
@@ -0,0 +1,28 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+
+//
+// MapChars that add a constant to the characters of one range, such as
+// the ASCII case mappings, specialize MapCharShift so that StrRemap can
+// map them 16 characters at a time.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// Adds Delta (modulo 256) to the characters in [Lo, Hi], compared as
+// MatchCharRange compares them, and leaves the others unchanged
+template<typename FnMap>
+struct MapCharShift
+{
+  static const bool Enabled = false;
+  static const char Lo = 0;
+  static const char Hi = 0;
+  static const char Delta = 0;
+};
+
+FTL_NAMESPACE_END
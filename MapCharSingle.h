@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MapCharShift.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -20,4 +21,13 @@ struct MapCharSingle
   }
 };
 
+template<char SrcChar, char DstChar>
+struct MapCharShift< MapCharSingle<SrcChar, DstChar> >
+{
+  static const bool Enabled = true;
+  static const char Lo = SrcChar;
+  static const char Hi = SrcChar;
+  static const char Delta = char( DstChar - SrcChar );
+};
+
 FTL_NAMESPACE_END
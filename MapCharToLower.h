@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MapCharShift.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -22,4 +23,13 @@ struct MapCharToLower
   }
 };
 
+template<>
+struct MapCharShift<MapCharToLower>
+{
+  static const bool Enabled = true;
+  static const char Lo = 'A';
+  static const char Hi = 'Z';
+  static const char Delta = char( 'a' - 'A' );
+};
+
 FTL_NAMESPACE_END
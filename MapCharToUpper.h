@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MapCharShift.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -22,4 +23,13 @@ struct MapCharToUpper
   }
 };
 
+template<>
+struct MapCharShift<MapCharToUpper>
+{
+  static const bool Enabled = true;
+  static const char Lo = 'a';
+  static const char Hi = 'z';
+  static const char Delta = char( 'A' - 'a' );
+};
+
 FTL_NAMESPACE_END
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -17,4 +18,14 @@ struct MatchCharAlways
   }
 };
 
+template<>
+struct MatchCharBits<MatchCharAlways>
+{
+  static const bool Enabled = true;
+  static const uint64_t Word0 = ~uint64_t(0);
+  static const uint64_t Word1 = ~uint64_t(0);
+  static const uint64_t Word2 = ~uint64_t(0);
+  static const uint64_t Word3 = ~uint64_t(0);
+};
+
 FTL_NAMESPACE_END
@@ -6,6 +6,7 @@
 
 #include <FTL/Config.h>
 #include <FTL/MatchCharNever.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -26,6 +27,10 @@ struct MatchCharAny
   MatchCharAny() {}
   bool operator()( char ch ) const
   {
+    // One table lookup rather than up to ten tests, when every
+    // alternative has a bitmap
+    if ( MatchCharBits<MatchCharAny>::Enabled )
+      return MatchCharTable<MatchCharAny>::Match( ch );
     return _0(ch) || _1(ch) || _2(ch) || _3(ch) || _4(ch)
       || _5(ch) || _6(ch) || _7(ch) || _8(ch) || _9(ch);
   }
@@ -42,4 +47,60 @@ private:
   MatchChar9 _9;
 };
 
+template<
+  typename MatchChar0,
+  typename MatchChar1,
+  typename MatchChar2,
+  typename MatchChar3,
+  typename MatchChar4,
+  typename MatchChar5,
+  typename MatchChar6,
+  typename MatchChar7,
+  typename MatchChar8,
+  typename MatchChar9
+  >
+struct MatchCharBits<
+  MatchCharAny<
+    MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+    MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+    >
+  >
+{
+  static const bool Enabled =
+    MatchCharBits<MatchChar0>::Enabled
+    && MatchCharBits<MatchChar1>::Enabled
+    && MatchCharBits<MatchChar2>::Enabled
+    && MatchCharBits<MatchChar3>::Enabled
+    && MatchCharBits<MatchChar4>::Enabled
+    && MatchCharBits<MatchChar5>::Enabled
+    && MatchCharBits<MatchChar6>::Enabled
+    && MatchCharBits<MatchChar7>::Enabled
+    && MatchCharBits<MatchChar8>::Enabled
+    && MatchCharBits<MatchChar9>::Enabled;
+  static const uint64_t Word0 =
+    MatchCharBits<MatchChar0>::Word0 | MatchCharBits<MatchChar1>::Word0
+    | MatchCharBits<MatchChar2>::Word0 | MatchCharBits<MatchChar3>::Word0
+    | MatchCharBits<MatchChar4>::Word0 | MatchCharBits<MatchChar5>::Word0
+    | MatchCharBits<MatchChar6>::Word0 | MatchCharBits<MatchChar7>::Word0
+    | MatchCharBits<MatchChar8>::Word0 | MatchCharBits<MatchChar9>::Word0;
+  static const uint64_t Word1 =
+    MatchCharBits<MatchChar0>::Word1 | MatchCharBits<MatchChar1>::Word1
+    | MatchCharBits<MatchChar2>::Word1 | MatchCharBits<MatchChar3>::Word1
+    | MatchCharBits<MatchChar4>::Word1 | MatchCharBits<MatchChar5>::Word1
+    | MatchCharBits<MatchChar6>::Word1 | MatchCharBits<MatchChar7>::Word1
+    | MatchCharBits<MatchChar8>::Word1 | MatchCharBits<MatchChar9>::Word1;
+  static const uint64_t Word2 =
+    MatchCharBits<MatchChar0>::Word2 | MatchCharBits<MatchChar1>::Word2
+    | MatchCharBits<MatchChar2>::Word2 | MatchCharBits<MatchChar3>::Word2
+    | MatchCharBits<MatchChar4>::Word2 | MatchCharBits<MatchChar5>::Word2
+    | MatchCharBits<MatchChar6>::Word2 | MatchCharBits<MatchChar7>::Word2
+    | MatchCharBits<MatchChar8>::Word2 | MatchCharBits<MatchChar9>::Word2;
+  static const uint64_t Word3 =
+    MatchCharBits<MatchChar0>::Word3 | MatchCharBits<MatchChar1>::Word3
+    | MatchCharBits<MatchChar2>::Word3 | MatchCharBits<MatchChar3>::Word3
+    | MatchCharBits<MatchChar4>::Word3 | MatchCharBits<MatchChar5>::Word3
+    | MatchCharBits<MatchChar6>::Word3 | MatchCharBits<MatchChar7>::Word3
+    | MatchCharBits<MatchChar8>::Word3 | MatchCharBits<MatchChar9>::Word3;
+};
+
 FTL_NAMESPACE_END
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -17,4 +18,14 @@ struct MatchCharNever
   }
 };
 
+template<>
+struct MatchCharBits<MatchCharNever>
+{
+  static const bool Enabled = true;
+  static const uint64_t Word0 = 0;
+  static const uint64_t Word1 = 0;
+  static const uint64_t Word2 = 0;
+  static const uint64_t Word3 = 0;
+};
+
 FTL_NAMESPACE_END
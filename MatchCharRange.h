@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -18,4 +19,31 @@ struct MatchCharRange
   }
 };
 
+// With a signed char, a range such as ['\x90', '\x10'] is two intervals
+// of unsigned characters, [0x90, 0xFF] and [0x00, 0x10]
+template<char BeginCharToMatch, char EndCharToMatch>
+struct MatchCharBits< MatchCharRange<BeginCharToMatch, EndCharToMatch> >
+{
+  static const bool Enabled = true;
+  static const bool Empty = !( BeginCharToMatch <= EndCharToMatch );
+  static const uint32_t Lo = uint8_t( BeginCharToMatch );
+  static const uint32_t Hi = uint8_t( EndCharToMatch );
+  static const bool Wraps = Lo > Hi;
+  static const uint32_t Lo0 = Wraps? 0: Lo;
+  static const uint32_t Lo1 = Wraps? Lo: 1;
+  static const uint32_t Hi1 = Wraps? 255: 0;
+  static const uint64_t Word0 = Empty? 0:
+    MatchCharIntervalWord<Lo0, Hi, 0>::Value
+      | MatchCharIntervalWord<Lo1, Hi1, 0>::Value;
+  static const uint64_t Word1 = Empty? 0:
+    MatchCharIntervalWord<Lo0, Hi, 1>::Value
+      | MatchCharIntervalWord<Lo1, Hi1, 1>::Value;
+  static const uint64_t Word2 = Empty? 0:
+    MatchCharIntervalWord<Lo0, Hi, 2>::Value
+      | MatchCharIntervalWord<Lo1, Hi1, 2>::Value;
+  static const uint64_t Word3 = Empty? 0:
+    MatchCharIntervalWord<Lo0, Hi, 3>::Value
+      | MatchCharIntervalWord<Lo1, Hi1, 3>::Value;
+};
+
 FTL_NAMESPACE_END
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -18,4 +19,14 @@ struct MatchCharSingle
   }
 };
 
+template<char CharToMatch>
+struct MatchCharBits< MatchCharSingle<CharToMatch> >
+{
+  static const bool Enabled = true;
+  static const uint64_t Word0 = MatchCharSingleWord<CharToMatch, 0>::Value;
+  static const uint64_t Word1 = MatchCharSingleWord<CharToMatch, 1>::Value;
+  static const uint64_t Word2 = MatchCharSingleWord<CharToMatch, 2>::Value;
+  static const uint64_t Word3 = MatchCharSingleWord<CharToMatch, 3>::Value;
+};
+
 FTL_NAMESPACE_END
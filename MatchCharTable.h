@@ -0,0 +1,161 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+
+#include <stdint.h>
+
+//
+// Character classes as 256-bit membership bitmaps, computed at compile
+// time.  The built-in MatchChars (and MatchCharAny compositions of them)
+// specialize MatchCharBits; MatchCharTable then looks characters up in
+// the bitmap, and lays it out for the nibble-shuffle classifier used by
+// StrScan.  MatchChars without MatchCharBits, such as arbitrary
+// predicates, are simply called per character.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// Bit (c & 63) of Word<c / 64> is set if the MatchChar matches the char
+// whose unsigned value is c
+template<typename MatchChar>
+struct MatchCharBits
+{
+  static const bool Enabled = false;
+  static const uint64_t Word0 = 0;
+  static const uint64_t Word1 = 0;
+  static const uint64_t Word2 = 0;
+  static const uint64_t Word3 = 0;
+};
+
+// Word of the bitmap of the unsigned characters [Lo, Hi]
+template<uint32_t Lo, uint32_t Hi, uint32_t Word>
+struct MatchCharIntervalWord
+{
+  static const uint32_t First = Lo > Word * 64? Lo: Word * 64;
+  static const uint32_t Last = Hi < Word * 64 + 63? Hi: Word * 64 + 63;
+  static const uint64_t Value = First > Last? 0:
+    ( ~uint64_t(0) >> ( 63 - ( Last - First ) % 64 ) )
+      << ( ( First - Word * 64 ) % 64 );
+};
+
+// Word of the bitmap of a single character
+template<char Ch, uint32_t Word>
+struct MatchCharSingleWord
+{
+  static const uint64_t Value = uint32_t( uint8_t( Ch ) ) / 64 == Word?
+    uint64_t(1) << ( uint8_t( Ch ) % 64 ): 0;
+};
+
+template<typename MatchChar, uint32_t Ch>
+struct MatchCharBit
+{
+  typedef MatchCharBits<MatchChar> Bits;
+  static const uint64_t Word =
+    Ch < 64? Bits::Word0:
+    Ch < 128? Bits::Word1:
+    Ch < 192? Bits::Word2:
+    Bits::Word3;
+  static const uint8_t Value = uint8_t( ( Word >> ( Ch % 64 ) ) & 1 );
+};
+
+// For the nibble-shuffle classifier: entry Lo of half Half has bit i set
+// if the character ( Half * 8 + i ) * 16 + Lo matches
+template<typename MatchChar, uint32_t Half, uint32_t Lo>
+struct MatchCharNibbleRow
+{
+  static const uint8_t Value = uint8_t(
+    MatchCharBit<MatchChar, ( Half * 8 + 0 ) * 16 + Lo>::Value
+    | MatchCharBit<MatchChar, ( Half * 8 + 1 ) * 16 + Lo>::Value << 1
+    | MatchCharBit<MatchChar, ( Half * 8 + 2 ) * 16 + Lo>::Value << 2
+    | MatchCharBit<MatchChar, ( Half * 8 + 3 ) * 16 + Lo>::Value << 3
+    | MatchCharBit<MatchChar, ( Half * 8 + 4 ) * 16 + Lo>::Value << 4
+    | MatchCharBit<MatchChar, ( Half * 8 + 5 ) * 16 + Lo>::Value << 5
+    | MatchCharBit<MatchChar, ( Half * 8 + 6 ) * 16 + Lo>::Value << 6
+    | MatchCharBit<MatchChar, ( Half * 8 + 7 ) * 16 + Lo>::Value << 7
+    );
+};
+
+// MatchCharNibbleRow for a bitmap known only at run time: rows[Half *
+// 16 + Lo] for Half 0 and 1
+inline void MatchCharNibbleRows( uint64_t const words[4], uint8_t rows[32] )
+{
+  for ( uint32_t i = 0; i < 32; ++i )
+  {
+    uint32_t const half = i / 16;
+    uint32_t const lo = i % 16;
+    uint8_t row = 0;
+    for ( uint32_t bit = 0; bit < 8; ++bit )
+    {
+      uint32_t const c = ( half * 8 + bit ) * 16 + lo;
+      row |= uint8_t( ( ( words[c / 64] >> ( c % 64 ) ) & 1 ) << bit );
+    }
+    rows[i] = row;
+  }
+}
+
+template<typename MatchChar>
+struct MatchCharTable
+{
+  static bool Match( char ch )
+  {
+    uint8_t const c = uint8_t( ch );
+    return ( Words[c / 64] >> ( c % 64 ) ) & 1;
+  }
+
+  static const uint64_t Words[4];
+
+  // MatchCharNibbleRow for Half 0, then Half 1
+  static const uint8_t NibbleRows[32];
+};
+
+template<typename MatchChar>
+const uint64_t MatchCharTable<MatchChar>::Words[4] =
+{
+  MatchCharBits<MatchChar>::Word0,
+  MatchCharBits<MatchChar>::Word1,
+  MatchCharBits<MatchChar>::Word2,
+  MatchCharBits<MatchChar>::Word3
+};
+
+template<typename MatchChar>
+const uint8_t MatchCharTable<MatchChar>::NibbleRows[32] =
+{
+  MatchCharNibbleRow<MatchChar, 0, 0>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 1>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 2>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 3>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 4>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 5>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 6>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 7>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 8>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 9>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 10>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 11>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 12>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 13>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 14>::Value,
+  MatchCharNibbleRow<MatchChar, 0, 15>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 0>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 1>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 2>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 3>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 4>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 5>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 6>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 7>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 8>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 9>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 10>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 11>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 12>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 13>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 14>::Value,
+  MatchCharNibbleRow<MatchChar, 1, 15>::Value
+};
+
+FTL_NAMESPACE_END
@@ -5,18 +5,31 @@
 #pragma once
 
 #include <FTL/Config.h>
-
-#include <ctype.h>
+#include <FTL/MatchCharTable.h>
 
 FTL_NAMESPACE_BEGIN
 
+// ASCII whitespace: ' ' and '\t' through '\r', which is what isspace()
+// matches in the "C" locale, whatever the current locale is
 struct MatchCharWhitespace
 {
   MatchCharWhitespace() {}
   bool operator()( char ch ) const
   {
-    return isspace( ch );
+    return ch == ' ' || uint8_t( ch - '\t' ) <= uint8_t( '\r' - '\t' );
   }
 };
 
+template<>
+struct MatchCharBits<MatchCharWhitespace>
+{
+  static const bool Enabled = true;
+  static const uint64_t Word0 =
+    MatchCharIntervalWord<'\t', '\r', 0>::Value
+      | MatchCharSingleWord<' ', 0>::Value;
+  static const uint64_t Word1 = 0;
+  static const uint64_t Word2 = 0;
+  static const uint64_t Word3 = 0;
+};
+
 FTL_NAMESPACE_END
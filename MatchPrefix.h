@@ -6,6 +6,7 @@
 
 #include <FTL/MatchPrefixAny.h>
 #include <FTL/MatchPrefixChar.h>
+#include <FTL/MatchPrefixEmpty.h>
 #include <FTL/MatchPrefixNever.h>
 #include <FTL/MatchPrefixOneOrMore.h>
 #include <FTL/MatchPrefixSeq.h>
@@ -0,0 +1,517 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+#include <FTL/MatchPrefix.h>
+#include <FTL/StrRef.h>
+
+#include <algorithm>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+//
+// Compiles MatchPrefix expressions (MatchPrefixChar, MatchPrefixSeq,
+// MatchPrefixAny, MatchPrefixOneOrMore, MatchPrefixEmpty and
+// MatchPrefixNever) into a DFA, once at startup, which then matches in
+// one forward pass with one table lookup per character and never
+// backtracks.  Several patterns can be compiled together and matched
+// against the same input at once:
+//
+// MatchPrefixNFA nfa;
+// uint32_t const absolute = nfa.add<MatchPrefixAbsolutePath>();
+// uint32_t const home = nfa.add< MatchPrefixChar< MatchCharSingle<'~'> > >();
+// MatchPrefixDFA const dfa( nfa );
+// ...
+// StrRef::IT it = path.begin();
+// uint32_t const pattern = dfa.match( it, path.end() );
+//
+// The DFA matches the longest prefix that the pattern, read as a regular
+// expression, describes.  The combinators themselves instead commit to
+// the first alternative of a MatchPrefixAny that matches, and
+// MatchPrefixOneOrMore to as many repetitions as possible, without ever
+// backtracking into them.  The two agree for patterns in which no
+// alternative (or repetition) matches a proper prefix of what a later
+// one does -- such as MatchPrefixAbsolutePath -- and otherwise the DFA
+// matches more.  With A and B the MatchPrefixChars of 'a' and 'b', the
+// DFA of MatchPrefixAny< A, MatchPrefixSeq<A, B> > matches all of "ab",
+// where the combinator stops after "a", and that of
+// MatchPrefixSeq< MatchPrefixOneOrMore<A>, A > matches "aa", which the
+// combinator never matches.
+//
+// MatchPrefixChar's MatchChar is called on all 256 characters while
+// compiling, so it must not depend on anything but its argument.  Other
+// MatchPrefixes can be compiled by specializing MatchPrefixNFABuild.
+//
+
+FTL_NAMESPACE_BEGIN
+
+static const uint32_t MatchPrefixNoState = ~uint32_t( 0 );
+static const uint32_t MatchPrefixNoPattern = ~uint32_t( 0 );
+static const size_t MatchPrefixNoLength = ~size_t( 0 );
+
+// A piece of the NFA with one way in and one way out, which is the state
+// reached once the piece has matched
+struct MatchPrefixNFAFragment
+{
+  uint32_t begin;
+  uint32_t end;
+
+  MatchPrefixNFAFragment( uint32_t begin_, uint32_t end_ )
+    : begin( begin_ ), end( end_ ) {}
+};
+
+class MatchPrefixNFA;
+
+// Specialized below for each MatchPrefix:
+//   static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa );
+template<typename MatchPrefix>
+struct MatchPrefixNFABuild;
+
+class MatchPrefixNFA
+{
+public:
+
+  struct State
+  {
+    // Characters that lead to charTarget: bit (c & 63) of chars[c / 64]
+    // for the unsigned character c
+    uint64_t chars[4];
+    uint32_t charTarget;
+    std::vector<uint32_t> epsilonTargets;
+    // The pattern matched on reaching this state, if any
+    uint32_t pattern;
+  };
+
+  MatchPrefixNFA() {}
+
+  // Adds a pattern, returning its index: 0 for the first, and so on
+  template<typename MatchPrefix>
+  uint32_t add()
+  {
+    MatchPrefixNFAFragment const fragment =
+      MatchPrefixNFABuild<MatchPrefix>::Build( *this );
+    uint32_t const pattern = uint32_t( m_patternBegins.size() );
+    m_states[fragment.end].pattern = pattern;
+    m_patternBegins.push_back( fragment.begin );
+    return pattern;
+  }
+
+  uint32_t patternCount() const
+    { return uint32_t( m_patternBegins.size() ); }
+
+  std::vector<uint32_t> const &patternBegins() const
+    { return m_patternBegins; }
+
+  std::vector<State> const &states() const
+    { return m_states; }
+
+  // For MatchPrefixNFABuild
+
+  uint32_t addState()
+  {
+    State state;
+    state.chars[0] = state.chars[1] = state.chars[2] = state.chars[3] = 0;
+    state.charTarget = MatchPrefixNoState;
+    state.pattern = MatchPrefixNoPattern;
+    m_states.push_back( state );
+    return uint32_t( m_states.size() - 1 );
+  }
+
+  void addEpsilon( uint32_t from, uint32_t to )
+    { m_states[from].epsilonTargets.push_back( to ); }
+
+  template<typename MatchChar>
+  void addChars( uint32_t from, uint32_t to )
+  {
+    MatchChar const mc;
+    State &state = m_states[from];
+    for ( uint32_t c = 0; c < 256; ++c )
+    {
+      if ( mc( char( c ) ) )
+        state.chars[c / 64] |= uint64_t( 1 ) << ( c % 64 );
+    }
+    state.charTarget = to;
+  }
+
+private:
+
+  std::vector<State> m_states;
+  std::vector<uint32_t> m_patternBegins;
+};
+
+template<>
+struct MatchPrefixNFABuild<MatchPrefixNever>
+{
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    uint32_t const begin = nfa.addState();
+    return MatchPrefixNFAFragment( begin, nfa.addState() );
+  }
+};
+
+template<>
+struct MatchPrefixNFABuild<MatchPrefixEmpty>
+{
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    uint32_t const state = nfa.addState();
+    return MatchPrefixNFAFragment( state, state );
+  }
+};
+
+template<typename MatchChar>
+struct MatchPrefixNFABuild< MatchPrefixChar<MatchChar> >
+{
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    uint32_t const begin = nfa.addState();
+    uint32_t const end = nfa.addState();
+    nfa.addChars<MatchChar>( begin, end );
+    return MatchPrefixNFAFragment( begin, end );
+  }
+};
+
+template<typename MatchPrefix>
+struct MatchPrefixNFABuild< MatchPrefixOneOrMore<MatchPrefix> >
+{
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    MatchPrefixNFAFragment const fragment =
+      MatchPrefixNFABuild<MatchPrefix>::Build( nfa );
+    nfa.addEpsilon( fragment.end, fragment.begin );
+    return fragment;
+  }
+};
+
+template<
+  typename MatchPrefix0,
+  typename MatchPrefix1,
+  typename MatchPrefix2,
+  typename MatchPrefix3,
+  typename MatchPrefix4,
+  typename MatchPrefix5,
+  typename MatchPrefix6,
+  typename MatchPrefix7,
+  typename MatchPrefix8,
+  typename MatchPrefix9
+  >
+struct MatchPrefixNFABuild<
+  MatchPrefixSeq<
+    MatchPrefix0,
+    MatchPrefix1,
+    MatchPrefix2,
+    MatchPrefix3,
+    MatchPrefix4,
+    MatchPrefix5,
+    MatchPrefix6,
+    MatchPrefix7,
+    MatchPrefix8,
+    MatchPrefix9
+    >
+  >
+{
+  template<typename MatchPrefix>
+  static void Append( MatchPrefixNFA &nfa, MatchPrefixNFAFragment &seq )
+  {
+    MatchPrefixNFAFragment const fragment =
+      MatchPrefixNFABuild<MatchPrefix>::Build( nfa );
+    nfa.addEpsilon( seq.end, fragment.begin );
+    seq.end = fragment.end;
+  }
+
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    MatchPrefixNFAFragment seq =
+      MatchPrefixNFABuild<MatchPrefix0>::Build( nfa );
+    Append<MatchPrefix1>( nfa, seq );
+    Append<MatchPrefix2>( nfa, seq );
+    Append<MatchPrefix3>( nfa, seq );
+    Append<MatchPrefix4>( nfa, seq );
+    Append<MatchPrefix5>( nfa, seq );
+    Append<MatchPrefix6>( nfa, seq );
+    Append<MatchPrefix7>( nfa, seq );
+    Append<MatchPrefix8>( nfa, seq );
+    Append<MatchPrefix9>( nfa, seq );
+    return seq;
+  }
+};
+
+template<
+  typename MatchPrefix0,
+  typename MatchPrefix1,
+  typename MatchPrefix2,
+  typename MatchPrefix3,
+  typename MatchPrefix4,
+  typename MatchPrefix5,
+  typename MatchPrefix6,
+  typename MatchPrefix7,
+  typename MatchPrefix8,
+  typename MatchPrefix9
+  >
+struct MatchPrefixNFABuild<
+  MatchPrefixAny<
+    MatchPrefix0,
+    MatchPrefix1,
+    MatchPrefix2,
+    MatchPrefix3,
+    MatchPrefix4,
+    MatchPrefix5,
+    MatchPrefix6,
+    MatchPrefix7,
+    MatchPrefix8,
+    MatchPrefix9
+    >
+  >
+{
+  template<typename MatchPrefix>
+  static void Add( MatchPrefixNFA &nfa, MatchPrefixNFAFragment const &any )
+  {
+    MatchPrefixNFAFragment const fragment =
+      MatchPrefixNFABuild<MatchPrefix>::Build( nfa );
+    nfa.addEpsilon( any.begin, fragment.begin );
+    nfa.addEpsilon( fragment.end, any.end );
+  }
+
+  static MatchPrefixNFAFragment Build( MatchPrefixNFA &nfa )
+  {
+    uint32_t const begin = nfa.addState();
+    MatchPrefixNFAFragment const any( begin, nfa.addState() );
+    Add<MatchPrefix0>( nfa, any );
+    Add<MatchPrefix1>( nfa, any );
+    Add<MatchPrefix2>( nfa, any );
+    Add<MatchPrefix3>( nfa, any );
+    Add<MatchPrefix4>( nfa, any );
+    Add<MatchPrefix5>( nfa, any );
+    Add<MatchPrefix6>( nfa, any );
+    Add<MatchPrefix7>( nfa, any );
+    Add<MatchPrefix8>( nfa, any );
+    Add<MatchPrefix9>( nfa, any );
+    return any;
+  }
+};
+
+class MatchPrefixDFA
+{
+  typedef std::vector<uint32_t> NFAStates;
+
+public:
+
+  // The subset construction: each state of the DFA is the set of states
+  // the NFA may be in.  State 0, the empty set, matches nothing more and
+  // loops to itself.
+  explicit MatchPrefixDFA( MatchPrefixNFA const &nfa )
+    : m_patternCount( nfa.patternCount() )
+  {
+    std::vector<MatchPrefixNFA::State> const &nfaStates = nfa.states();
+    std::vector<uint32_t> marks( nfaStates.size(), 0 );
+    uint32_t mark = 0;
+
+    std::map<NFAStates, uint32_t> ids;
+    std::vector<NFAStates> sets;
+    sets.push_back( NFAStates() );
+    ids[sets.back()] = 0;
+
+    NFAStates start = nfa.patternBegins();
+    Close( nfaStates, start, marks, ++mark );
+    uint32_t const startId = Intern( start, ids, sets );
+
+    // By set, until the states are renumbered below
+    std::vector<uint32_t> nexts;
+    std::vector< std::vector<uint32_t> > patterns;
+    for ( uint32_t id = 0; id < sets.size(); ++id )
+    {
+      // Copied, since sets grows below
+      NFAStates const set = sets[id];
+
+      patterns.push_back( std::vector<uint32_t>() );
+      for ( NFAStates::const_iterator it = set.begin();
+        it != set.end(); ++it )
+      {
+        if ( nfaStates[*it].pattern != MatchPrefixNoPattern )
+          patterns.back().push_back( nfaStates[*it].pattern );
+      }
+      std::sort( patterns.back().begin(), patterns.back().end() );
+
+      for ( uint32_t c = 0; c < 256; ++c )
+      {
+        NFAStates next;
+        for ( NFAStates::const_iterator it = set.begin();
+          it != set.end(); ++it )
+        {
+          MatchPrefixNFA::State const &state = nfaStates[*it];
+          if ( ( state.chars[c / 64] >> ( c % 64 ) ) & 1 )
+            next.push_back( state.charTarget );
+        }
+        Close( nfaStates, next, marks, ++mark );
+        nexts.push_back( Intern( next, ids, sets ) );
+      }
+    }
+
+    // The states that accept go last, so that matching tells them apart
+    // by number alone; the table holds the offsets of the states' rows
+    uint32_t const stateCount = uint32_t( sets.size() );
+    std::vector<uint32_t> newIds( stateCount );
+    uint32_t newId = 0;
+    for ( uint32_t pass = 0; pass < 2; ++pass )
+    {
+      if ( pass == 1 )
+        m_firstAccepting = newId * 256;
+      for ( uint32_t id = 0; id < stateCount; ++id )
+      {
+        if ( patterns[id].empty() == ( pass == 0 ) )
+          newIds[id] = newId++;
+      }
+    }
+    m_start = newIds[startId] * 256;
+
+    m_next.resize( nexts.size() );
+    m_accepts.resize( stateCount );
+    std::vector< std::vector<uint32_t> > newPatterns( stateCount );
+    for ( uint32_t id = 0; id < stateCount; ++id )
+    {
+      for ( uint32_t c = 0; c < 256; ++c )
+        m_next[newIds[id] * 256 + c] = newIds[nexts[id * 256 + c]] * 256;
+      m_accepts[newIds[id]] =
+        patterns[id].empty()? MatchPrefixNoPattern: patterns[id][0];
+      newPatterns[newIds[id]].swap( patterns[id] );
+    }
+    for ( uint32_t id = 0; id < stateCount; ++id )
+    {
+      m_acceptBegins.push_back( uint32_t( m_acceptPatterns.size() ) );
+      m_acceptPatterns.insert(
+        m_acceptPatterns.end(),
+        newPatterns[id].begin(),
+        newPatterns[id].end()
+        );
+    }
+    m_acceptBegins.push_back( uint32_t( m_acceptPatterns.size() ) );
+  }
+
+  uint32_t patternCount() const
+    { return m_patternCount; }
+
+  uint32_t stateCount() const
+    { return uint32_t( m_accepts.size() ); }
+
+  // Matches the longest prefix of [it, itEnd) that any pattern does,
+  // moving it past the prefix and returning the pattern (the one added
+  // first, if several match it); otherwise returns MatchPrefixNoPattern
+  uint32_t match( StrRef::IT &it, StrRef::IT itEnd ) const
+  {
+    uint32_t const *const next = &m_next[0];
+    uint32_t const firstAccepting = m_firstAccepting;
+
+    uint32_t state = m_start;
+    uint32_t acceptState = state;
+    StrRef::IT itMatchEnd = it;
+    for ( StrRef::IT itCur = it; itCur != itEnd; )
+    {
+      state = next[state + uint8_t( *itCur++ )];
+      if ( state >= firstAccepting )
+      {
+        acceptState = state;
+        itMatchEnd = itCur;
+      }
+      else if ( state == 0 )
+        break;
+    }
+
+    uint32_t const pattern = m_accepts[acceptState / 256];
+    if ( pattern != MatchPrefixNoPattern )
+      it = itMatchEnd;
+    return pattern;
+  }
+
+  // As a MatchPrefix
+  bool operator()( StrRef::IT &it, StrRef::IT itEnd ) const
+    { return match( it, itEnd ) != MatchPrefixNoPattern; }
+
+  // Sets lengths[pattern] to the length of the longest prefix of str that
+  // the pattern matches, or to MatchPrefixNoLength if it matches none
+  void matchAll( StrRef str, std::vector<size_t> &lengths ) const
+  {
+    lengths.assign( m_patternCount, MatchPrefixNoLength );
+    uint32_t state = m_start;
+    setAccepted( state, 0, lengths );
+    for ( size_t i = 0; i < str.size(); )
+    {
+      state = m_next[state + uint8_t( str[i++] )];
+      if ( state == 0 )
+        break;
+      setAccepted( state, i, lengths );
+    }
+  }
+
+private:
+
+  // Adds the states reachable through epsilon edges to states, and sorts
+  // them; marks[s] == mark for the states already in
+  static void Close(
+    std::vector<MatchPrefixNFA::State> const &nfaStates,
+    NFAStates &states,
+    std::vector<uint32_t> &marks,
+    uint32_t mark
+    )
+  {
+    NFAStates pending;
+    pending.swap( states );
+    while ( !pending.empty() )
+    {
+      uint32_t const s = pending.back();
+      pending.pop_back();
+      if ( marks[s] == mark )
+        continue;
+      marks[s] = mark;
+      states.push_back( s );
+      std::vector<uint32_t> const &targets = nfaStates[s].epsilonTargets;
+      pending.insert( pending.end(), targets.begin(), targets.end() );
+    }
+    std::sort( states.begin(), states.end() );
+  }
+
+  static uint32_t Intern(
+    NFAStates const &set,
+    std::map<NFAStates, uint32_t> &ids,
+    std::vector<NFAStates> &sets
+    )
+  {
+    std::map<NFAStates, uint32_t>::const_iterator const it = ids.find( set );
+    if ( it != ids.end() )
+      return it->second;
+    uint32_t const id = uint32_t( sets.size() );
+    ids[set] = id;
+    sets.push_back( set );
+    return id;
+  }
+
+  void setAccepted(
+    uint32_t state,
+    size_t length,
+    std::vector<size_t> &lengths
+    ) const
+  {
+    uint32_t const id = state / 256;
+    for ( uint32_t i = m_acceptBegins[id]; i != m_acceptBegins[id + 1]; ++i )
+      lengths[m_acceptPatterns[i]] = length;
+  }
+
+  uint32_t m_patternCount;
+  // Offsets (state * 256) of the start state and of the first accepting
+  // state
+  uint32_t m_start;
+  uint32_t m_firstAccepting;
+  // For each state, the offsets of the next states, indexed by unsigned
+  // character
+  std::vector<uint32_t> m_next;
+  // The first pattern matched on reaching each state
+  std::vector<uint32_t> m_accepts;
+  // All of them: m_acceptPatterns[m_acceptBegins[s], m_acceptBegins[s+1])
+  std::vector<uint32_t> m_acceptBegins;
+  std::vector<uint32_t> m_acceptPatterns;
+};
+
+FTL_NAMESPACE_END
@@ -74,6 +74,44 @@ public:
     m_vec.clear();
   }
 
+  // Makes room for size entries, so that inserting up to that many does
+  // not reallocate the entry vector or rehash.
+  void reserve( size_t size )
+  {
+    m_vec.reserve( size );
+    if ( size > 0 )
+      m_map.rehash( size_t( size / m_map.max_load_factor() ) + 1 );
+  }
+
+  // Adds the approximate heap usage of the map itself, not counting
+  // whatever the values own: the key copies, and the entry vector and hash
+  // table.  Unused entry capacity is also added to slackBytes.
+  void addMemoryUsage(
+    size_t &keyBytes,
+    size_t &indexBytes,
+    size_t &slackBytes,
+    size_t &blockCount
+    ) const
+  {
+    for ( const_iterator it = begin(); it != end(); ++it )
+      keyBytes += it->first.size() + 1;
+    blockCount += m_vec.size();
+
+    if ( m_vec.capacity() > 0 )
+    {
+      indexBytes += m_vec.capacity() * sizeof( KV );
+      slackBytes += ( m_vec.capacity() - m_vec.size() ) * sizeof( KV );
+      ++blockCount;
+    }
+
+    // Each hash node holds the value, a next pointer and (usually) the
+    // cached hash
+    indexBytes += m_map.bucket_count() * sizeof( void * );
+    indexBytes += m_map.size()
+      * ( sizeof( typename Map::value_type ) + 2 * sizeof( void * ) );
+    blockCount += 1 + m_map.size();
+  }
+
   bool insert( StrRef key, ValueTy const &value )
   {
     char *keyCStr = new char[key.size()+1];
@@ -6,9 +6,12 @@
 
 #include <FTL/StrCount.h>
 #include <FTL/StrFilter.h>
+#include <FTL/StrPipe.h>
 #include <FTL/StrRef.h>
 #include <FTL/StrRemap.h>
 #include <FTL/StrSplit.h>
 #include <FTL/StrTrim.h>
 #include <FTL/StrTrimWhitespace.h>
 #include <FTL/StrToLower.h>
+#include <FTL/StrToNum.h>
+#include <FTL/StrToUpper.h>
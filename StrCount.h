@@ -6,29 +6,34 @@
 
 #include <FTL/Config.h>
 #include <FTL/MatchCharSingle.h>
+#include <FTL/StrRef.h>
 
 #include <string>
 
 FTL_NAMESPACE_BEGIN
 
+template<typename MatchChar>
+size_t StrCount( StrRef str )
+{
+  return StrScanCount<MatchChar>( str.begin(), str.end() );
+}
+
 template<typename MatchChar>
 size_t StrCount( char const *cStr )
 {
-  MatchChar const fn;
-
-  size_t count = 0;
-  while ( *cStr )
-  {
-    if ( fn( *cStr++ ) )
-      ++count;
-  }
-  return count;
+  return StrCount<MatchChar>( StrRef( cStr ) );
 }
 
 template<typename MatchChar>
 size_t StrCount( std::string const &str )
 {
-  return StrCount<MatchChar>( str.c_str() );
+  return StrCount<MatchChar>( StrRef( str ) );
+}
+
+template<char CharToMatch>
+size_t StrCount( StrRef str )
+{
+  return StrCount< MatchCharSingle<CharToMatch> >( str );
 }
 
 template<char CharToMatch>
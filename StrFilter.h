@@ -5,31 +5,49 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/StrRef.h>
+
 #include <string>
 
 FTL_NAMESPACE_BEGIN
 
+// Returns str without the characters that match MatchChar
 template<typename MatchChar>
-std::string StrFilter( char const *cStr )
+std::string StrFilter( StrRef str )
 {
-  MatchChar const fn;
-
   std::string result;
-  for (;;)
+  if ( !str.empty() )
   {
-    char ch = *cStr++;
-    if ( !ch )
-      break;
-    else if ( !fn( ch ) )
-      result += ch;
+    result.resize( str.size() );
+    char *const out = &result[0];
+    result.resize(
+      StrScanFilter<MatchChar>( str.begin(), str.end(), out ) - out
+      );
   }
   return result;
 }
 
+template<typename MatchChar>
+std::string StrFilter( char const *cStr )
+{
+  return StrFilter<MatchChar>( StrRef( cStr ) );
+}
+
 template<typename MatchChar>
 std::string StrFilter( std::string const &str )
 {
-  return StrFilter<MatchChar>( str.c_str() );
+  return StrFilter<MatchChar>( StrRef( str ) );
+}
+
+// Removes the characters that match MatchChar from str
+template<typename MatchChar>
+void StrFilterInPlace( std::string &str )
+{
+  if ( !str.empty() )
+  {
+    char *const p = &str[0];
+    str.resize( StrScanFilter<MatchChar>( p, p + str.size(), p ) - p );
+  }
 }
 
 FTL_NAMESPACE_END
@@ -10,6 +10,11 @@
 
 FTL_NAMESPACE_BEGIN
 
+inline std::string StrFilterWhitespace( StrRef str )
+{
+  return StrFilter<MatchCharWhitespace>( str );
+}
+
 inline std::string StrFilterWhitespace( char const *cStr )
 {
   return StrFilter<MatchCharWhitespace>( cStr );
@@ -20,4 +25,9 @@ inline std::string StrFilterWhitespace( std::string const &str )
   return StrFilter<MatchCharWhitespace>( str );
 }
 
+inline void StrFilterWhitespaceInPlace( std::string &str )
+{
+  StrFilterInPlace<MatchCharWhitespace>( str );
+}
+
 FTL_NAMESPACE_END
@@ -0,0 +1,470 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Bits.h>
+#include <FTL/Config.h>
+#include <FTL/MatchCharTable.h>
+#include <FTL/StrRef.h>
+#include <FTL/StrScan.h>
+
+#include <iterator>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+//
+// Finds all the occurrences of many literal strings in one pass
+// (Aho-Corasick).  The patterns are compiled once into a DFA over the
+// classes of characters they use; the text is then read one character
+// (and one table lookup) at a time, except that, outside of any partial
+// match, the characters that cannot start a pattern are skipped 16 at a
+// time: with SSSE3, by nibble table shuffles, and with SSE2 when the
+// patterns start with at most three different characters.
+//
+// std::vector<StrRef> keywords;
+// ...
+// StrMultiFind const finder( keywords );
+//
+// struct Report
+// {
+//   bool operator()( uint32_t pattern, size_t offset )
+//     { ...; return true; } // false to stop
+// } report;
+// finder.findAll( line, report );
+//
+// or, in the style of StrSplitRange:
+//
+// StrMultiFindRange matches( finder, line );
+// for ( StrMultiFindRange::const_iterator it = matches.begin();
+//   it != matches.end(); ++it )
+//   ...( it->pattern, it->offset );
+//
+// Every occurrence is reported, overlapping ones included, in order of
+// where they end, and the longest first of those that end at the same
+// place.  Patterns are identified by their index in the list; empty
+// patterns never match.
+//
+
+FTL_NAMESPACE_BEGIN
+
+struct StrMultiFindMatch
+{
+  uint32_t pattern;
+  // Where the occurrence starts in the searched string
+  size_t offset;
+};
+
+class StrMultiFind
+{
+public:
+
+  explicit StrMultiFind( std::vector<StrRef> const &patterns )
+  {
+    buildClasses( patterns );
+    buildTrie( patterns );
+    buildLinks();
+    buildPrefilter();
+  }
+
+  uint32_t patternCount() const
+    { return uint32_t( m_patternSizes.size() ); }
+
+  uint32_t stateCount() const
+    { return uint32_t( m_outputBegins.size() - 1 ); }
+
+  // Calls callback( pattern, offset ) for every occurrence in str until
+  // it returns false, in which case returns false
+  template<typename Callback>
+  bool findAll( StrRef str, Callback &callback ) const
+  {
+    char const *const pBegin = str.data();
+    char const *const pEnd = pBegin + str.size();
+    char const *p = pBegin;
+    uint32_t state = 0;
+    while ( ( p = scan( state, p, pEnd ) ) != 0 )
+    {
+      for ( uint32_t i = m_outputBegins[state];
+        i != m_outputBegins[state + 1]; ++i )
+      {
+        uint32_t const pattern = m_outputs[i];
+        size_t const offset = ( p - pBegin ) - m_patternSizes[pattern];
+        if ( !callback( pattern, offset ) )
+          return false;
+      }
+    }
+    return true;
+  }
+
+  // Whether any pattern occurs in str
+  bool containsAny( StrRef str ) const
+  {
+    uint32_t state = 0;
+    return scan( state, str.data(), str.data() + str.size() ) != 0;
+  }
+
+  // Reads [p, pEnd) from state until reaching a state where patterns
+  // end, returning the position after its character, or 0 at pEnd
+  char const *scan(
+    uint32_t &state,
+    char const *p,
+    char const *pEnd
+    ) const
+  {
+    uint32_t const *const next = &m_next[0];
+    uint32_t const *const outputBegins = &m_outputBegins[0];
+    uint8_t const *const classes = m_classes;
+    uint32_t const classCount = m_classCount;
+
+    uint32_t s = state;
+    for (;;)
+    {
+      if ( s == 0 )
+        p = skipToStart( p, pEnd );
+      if ( p == pEnd )
+      {
+        state = s;
+        return 0;
+      }
+      s = next[s * classCount + classes[uint8_t( *p++ )]];
+      if ( outputBegins[s] != outputBegins[s + 1] )
+      {
+        state = s;
+        return p;
+      }
+    }
+  }
+
+  // For StrMultiFindRange: the patterns that end on reaching state
+  uint32_t const *outputsBegin( uint32_t state ) const
+    { return &m_outputs[0] + m_outputBegins[state]; }
+  uint32_t const *outputsEnd( uint32_t state ) const
+    { return &m_outputs[0] + m_outputBegins[state + 1]; }
+
+  size_t patternSize( uint32_t pattern ) const
+    { return m_patternSizes[pattern]; }
+
+private:
+
+  // The first position in [p, pEnd) whose character can start a
+  // pattern, or pEnd
+  char const *skipToStart( char const *p, char const *pEnd ) const
+  {
+    if ( p == pEnd || m_starts[uint8_t( *p )] )
+      return p;
+    ++p;
+
+#if defined(FTL_SSE2)
+    if ( m_startsSIMD )
+    {
+# if defined(FTL_SSSE3)
+      __m128i const rowsLow = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>( &m_startRows[0] )
+        );
+      __m128i const rowsHigh = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>( &m_startRows[16] )
+        );
+# else
+      __m128i const start0 = _mm_set1_epi8( char( m_startChars[0] ) );
+      __m128i const start1 = _mm_set1_epi8( char( m_startChars[1] ) );
+      __m128i const start2 = _mm_set1_epi8( char( m_startChars[2] ) );
+# endif
+      for ( ; pEnd - p >= 16; p += 16 )
+      {
+        __m128i const chunk = StrScanLoad( p );
+# if defined(FTL_SSSE3)
+        __m128i const matches =
+          StrScanNibbleMatch( rowsLow, rowsHigh, chunk );
+# else
+        __m128i const matches = _mm_or_si128(
+          _mm_cmpeq_epi8( chunk, start0 ),
+          _mm_or_si128(
+            _mm_cmpeq_epi8( chunk, start1 ),
+            _mm_cmpeq_epi8( chunk, start2 )
+            )
+          );
+# endif
+        uint32_t const mask = StrScanMask( matches );
+        if ( mask )
+          return p + BitsCountTrailingZeros( mask );
+      }
+    }
+#endif
+
+    for ( ; p != pEnd && !m_starts[uint8_t( *p )]; ++p ) ;
+    return p;
+  }
+
+  // Characters that occur in no pattern share class 0
+  void buildClasses( std::vector<StrRef> const &patterns )
+  {
+    memset( m_classes, 0, sizeof( m_classes ) );
+    for ( size_t i = 0; i < patterns.size(); ++i )
+    {
+      StrRef const pattern = patterns[i];
+      for ( size_t j = 0; j < pattern.size(); ++j )
+        m_classes[uint8_t( pattern[j] )] = 1;
+    }
+    // ... unless there are no such characters, since class 256 would
+    // not fit
+    uint32_t used = 0;
+    for ( uint32_t c = 0; c < 256; ++c )
+      used += m_classes[c];
+    m_classCount = used < 256? 1: 0;
+    for ( uint32_t c = 0; c < 256; ++c )
+    {
+      if ( m_classes[c] )
+        m_classes[c] = uint8_t( m_classCount++ );
+    }
+  }
+
+  uint32_t addState()
+  {
+    m_next.resize( m_next.size() + m_classCount, 0 );
+    m_ownOutputs.push_back( std::vector<uint32_t>() );
+    return uint32_t( m_ownOutputs.size() - 1 );
+  }
+
+  // The trie of the patterns, in which 0 (the root) means no child
+  void buildTrie( std::vector<StrRef> const &patterns )
+  {
+    addState();
+    for ( size_t i = 0; i < patterns.size(); ++i )
+    {
+      StrRef const pattern = patterns[i];
+      m_patternSizes.push_back( pattern.size() );
+      if ( pattern.empty() )
+        continue;
+      uint32_t state = 0;
+      for ( size_t j = 0; j < pattern.size(); ++j )
+      {
+        uint32_t const index =
+          state * m_classCount + m_classes[uint8_t( pattern[j] )];
+        if ( !m_next[index] )
+        {
+          uint32_t const child = addState();
+          m_next[index] = child;
+        }
+        state = m_next[index];
+      }
+      m_ownOutputs[state].push_back( uint32_t( i ) );
+    }
+  }
+
+  // Breadth first, so that each state's failure link (the state of its
+  // longest proper suffix in the trie) is complete before its children:
+  // missing transitions are taken from the failure link's, which turns
+  // the trie into a DFA, and outputs are inherited from it
+  void buildLinks()
+  {
+    uint32_t const stateCount = uint32_t( m_ownOutputs.size() );
+    std::vector<uint32_t> links( stateCount, 0 );
+    std::vector<uint32_t> order;
+    order.reserve( stateCount );
+    order.push_back( 0 );
+
+    for ( size_t i = 0; i < order.size(); ++i )
+    {
+      uint32_t const state = order[i];
+      uint32_t const link = links[state];
+      for ( uint32_t c = 0; c < m_classCount; ++c )
+      {
+        uint32_t &child = m_next[state * m_classCount + c];
+        uint32_t const linkChild = m_next[link * m_classCount + c];
+        if ( child )
+        {
+          links[child] = state? linkChild: 0;
+          order.push_back( child );
+        }
+        else
+          child = state? linkChild: 0;
+      }
+    }
+
+    // In breadth-first order too, so that links' outputs are complete
+    std::vector< std::vector<uint32_t> > outputs( stateCount );
+    for ( size_t i = 0; i < order.size(); ++i )
+    {
+      uint32_t const state = order[i];
+      outputs[state] = m_ownOutputs[state];
+      if ( state )
+      {
+        std::vector<uint32_t> const &linkOutputs = outputs[links[state]];
+        outputs[state].insert(
+          outputs[state].end(), linkOutputs.begin(), linkOutputs.end()
+          );
+      }
+    }
+    for ( uint32_t state = 0; state < stateCount; ++state )
+    {
+      m_outputBegins.push_back( uint32_t( m_outputs.size() ) );
+      m_outputs.insert(
+        m_outputs.end(), outputs[state].begin(), outputs[state].end()
+        );
+    }
+    m_outputBegins.push_back( uint32_t( m_outputs.size() ) );
+    // Never empty, so that &m_outputs[0] is valid
+    m_outputs.push_back( 0 );
+
+    std::vector< std::vector<uint32_t> >().swap( m_ownOutputs );
+  }
+
+  void buildPrefilter()
+  {
+    uint64_t words[4] = { 0, 0, 0, 0 };
+    uint32_t startCount = 0;
+    for ( uint32_t c = 0; c < 256; ++c )
+    {
+      m_starts[c] = m_next[m_classes[c]] != 0;
+      if ( m_starts[c] )
+      {
+        words[c / 64] |= uint64_t( 1 ) << ( c % 64 );
+        if ( startCount < 3 )
+          m_startChars[startCount] = uint8_t( c );
+        ++startCount;
+      }
+    }
+    MatchCharNibbleRows( words, m_startRows );
+    for ( uint32_t i = startCount; i < 3; ++i )
+      m_startChars[i] = startCount? m_startChars[0]: 0;
+#if defined(FTL_SSSE3)
+    m_startsSIMD = startCount > 0;
+#else
+    m_startsSIMD = startCount > 0 && startCount <= 3;
+#endif
+  }
+
+  uint8_t m_classes[256];
+  uint32_t m_classCount;
+  // m_classCount entries per state
+  std::vector<uint32_t> m_next;
+  // The patterns that end on reaching each state:
+  // m_outputs[m_outputBegins[s], m_outputBegins[s+1]), longest first
+  std::vector<uint32_t> m_outputBegins;
+  std::vector<uint32_t> m_outputs;
+  std::vector<size_t> m_patternSizes;
+  // Only while building
+  std::vector< std::vector<uint32_t> > m_ownOutputs;
+
+  // The characters that start patterns, as a table, as MatchCharNibbleRows
+  // and, if there are no more than three, as a list
+  bool m_starts[256];
+  uint8_t m_startRows[32];
+  uint8_t m_startChars[3];
+  bool m_startsSIMD;
+};
+
+// The occurrences of a StrMultiFind's patterns in str, one at a time, as
+// StrMultiFindMatches
+class StrMultiFindRange
+{
+public:
+
+  class const_iterator
+  {
+    friend class StrMultiFindRange;
+
+  public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef StrMultiFindMatch value_type;
+    typedef ptrdiff_t difference_type;
+    typedef StrMultiFindMatch const *pointer;
+    typedef StrMultiFindMatch const &reference;
+
+    const_iterator()
+      : m_finder( 0 ), m_begin( 0 ), m_next( 0 ), m_end( 0 ), m_state( 0 )
+      , m_output( 0 ), m_outputEnd( 0 ) {}
+
+    StrMultiFindMatch const &operator*() const
+      { return m_match; }
+
+    StrMultiFindMatch const *operator->() const
+      { return &m_match; }
+
+    const_iterator &operator++()
+    {
+      advance();
+      return *this;
+    }
+
+    const_iterator operator++( int )
+    {
+      const_iterator result = *this;
+      advance();
+      return result;
+    }
+
+    bool operator==( const_iterator const &that ) const
+    {
+      return m_next == that.m_next && m_output == that.m_output;
+    }
+
+    bool operator!=( const_iterator const &that ) const
+      { return !( *this == that ); }
+
+  private:
+
+    const_iterator( StrMultiFind const &finder, StrRef str )
+      : m_finder( &finder )
+      , m_begin( str.data() )
+      , m_next( str.data() )
+      , m_end( str.data() + str.size() )
+      , m_state( 0 )
+      , m_output( 0 )
+      , m_outputEnd( 0 )
+    {
+      advance();
+    }
+
+    void advance()
+    {
+      if ( m_output == m_outputEnd )
+      {
+        m_next = m_finder->scan( m_state, m_next, m_end );
+        if ( !m_next )
+        {
+          // The end iterator
+          m_output = m_outputEnd = 0;
+          return;
+        }
+        m_output = m_finder->outputsBegin( m_state );
+        m_outputEnd = m_finder->outputsEnd( m_state );
+      }
+      m_match.pattern = *m_output++;
+      m_match.offset =
+        size_t( m_next - m_begin ) - m_finder->patternSize( m_match.pattern );
+    }
+
+    StrMultiFind const *m_finder;
+    char const *m_begin;
+    // After the end of the current match, or 0 at the end
+    char const *m_next;
+    char const *m_end;
+    uint32_t m_state;
+    // The patterns still to report at m_next
+    uint32_t const *m_output;
+    uint32_t const *m_outputEnd;
+    StrMultiFindMatch m_match;
+  };
+
+  typedef const_iterator iterator;
+
+  StrMultiFindRange( StrMultiFind const &finder, StrRef str )
+    : m_finder( finder ), m_str( str ) {}
+
+  const_iterator begin() const
+    { return const_iterator( m_finder, m_str ); }
+
+  const_iterator end() const
+    { return const_iterator(); }
+
+private:
+
+  StrMultiFind const &m_finder;
+  StrRef m_str;
+};
+
+FTL_NAMESPACE_END
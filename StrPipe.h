@@ -0,0 +1,450 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Bits.h>
+#include <FTL/Config.h>
+#include <FTL/MapCharShift.h>
+#include <FTL/MatchCharNever.h>
+#include <FTL/MatchCharSingle.h>
+#include <FTL/StrRef.h>
+#include <FTL/StrRemap.h>
+#include <FTL/StrScan.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// A chain of trims, filters and remaps (and, optionally, a split),
+// applied to a StrRef in a single pass, straight into one output buffer
+// or into the split pieces, without building the intermediate strings
+// that StrTrim, StrFilter, StrRemap and StrSplit one after another
+// would.  For example:
+//
+// typedef StrPipe<
+//   StrPipeTrim<MatchCharWhitespace>,
+//   StrPipeFilter< MatchCharSingle<'_'> >,
+//   StrPipeRemap<MapCharToLower>
+//   > Normalize;
+//
+// std::string key;
+// Normalize::AppendTo( " Content_Type ", key ); // "contenttype"
+//
+// std::vector<std::string> fields;
+// Normalize::Split<','>( " A_b,C ", fields ); // "ab", "c"
+//
+// Trims only read the ends of the input, so they must come before the
+// other stages.  Filters and remaps are applied to each character in
+// turn, in order, and the split to what comes out of them.  When every
+// stage (and the split's MatchChar) has an SSE2 form -- StrScanSIMD for
+// MatchChars, MapCharShift for MapChars -- the pipeline runs 16
+// characters at a time.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// Removes the characters that match MatchChar from both ends of the input
+template<typename MatchChar>
+struct StrPipeTrim
+{
+  static const bool IsTrim = true;
+#if defined(FTL_SSE2)
+  static const bool SIMD = true;
+#endif
+
+  static StrRef Trim( StrRef str )
+    { return str.trimMatch<MatchChar>(); }
+
+  bool operator()( char & ) const
+    { return true; }
+
+#if defined(FTL_SSE2)
+  void operator()( __m128i &, __m128i & ) const {}
+#endif
+};
+
+// Drops the characters that match MatchChar
+template<typename MatchChar>
+struct StrPipeFilter
+{
+  static const bool IsTrim = false;
+#if defined(FTL_SSE2)
+  static const bool SIMD = StrScanSIMD<MatchChar>::Enabled;
+#endif
+
+  StrPipeFilter()
+#if defined(FTL_SSE2)
+    : m_simd( m_mc )
+#endif
+    {}
+
+  static StrRef Trim( StrRef str )
+    { return str; }
+
+  bool operator()( char &ch ) const
+    { return !m_mc( ch ); }
+
+#if defined(FTL_SSE2)
+  void operator()( __m128i &chunk, __m128i &drop ) const
+    { drop = _mm_or_si128( drop, m_simd( chunk ) ); }
+#endif
+
+private:
+
+  MatchChar m_mc;
+#if defined(FTL_SSE2)
+  StrScanSIMD<MatchChar> const m_simd;
+#endif
+};
+
+// Maps every character with FnMap
+template<typename FnMap>
+struct StrPipeRemap
+{
+  static const bool IsTrim = false;
+#if defined(FTL_SSE2)
+  static const bool SIMD = MapCharShift<FnMap>::Enabled;
+#endif
+
+  StrPipeRemap()
+#if defined(FTL_SSE2)
+    : m_inRange( (Range()) )
+    , m_delta( _mm_set1_epi8( MapCharShift<FnMap>::Delta ) )
+#endif
+    {}
+
+  static StrRef Trim( StrRef str )
+    { return str; }
+
+  bool operator()( char &ch ) const
+  {
+    ch = m_mf( ch );
+    return true;
+  }
+
+#if defined(FTL_SSE2)
+  void operator()( __m128i &chunk, __m128i & ) const
+    { chunk = StrRemapImpl<FnMap, true>::Map( m_inRange, m_delta, chunk ); }
+#endif
+
+private:
+
+  typedef MatchCharRange<
+    MapCharShift<FnMap>::Lo,
+    MapCharShift<FnMap>::Hi
+    > Range;
+
+  FnMap m_mf;
+#if defined(FTL_SSE2)
+  StrScanSIMD<Range> const m_inRange;
+  __m128i const m_delta;
+#endif
+};
+
+// The stage of the unused slots of StrPipe
+struct StrPipeNone
+{
+  static const bool IsTrim = false;
+  static const bool HasTrim = false;
+  static const bool TrimsFirst = true;
+#if defined(FTL_SSE2)
+  static const bool SIMD = true;
+#endif
+
+  static StrRef Trim( StrRef str )
+    { return str; }
+
+  bool operator()( char & ) const
+    { return true; }
+
+#if defined(FTL_SSE2)
+  void operator()( __m128i &, __m128i & ) const {}
+#endif
+};
+
+template<typename Stage, typename Next>
+struct StrPipeChain
+{
+  static const bool HasTrim = Stage::IsTrim || Next::HasTrim;
+  static const bool TrimsFirst =
+    Next::TrimsFirst && ( Stage::IsTrim || !Next::HasTrim );
+#if defined(FTL_SSE2)
+  static const bool SIMD = Stage::SIMD && Next::SIMD;
+#endif
+
+  static StrRef Trim( StrRef str )
+    { return Next::Trim( Stage::Trim( str ) ); }
+
+  // Applies the stages to ch, or returns false if one of them drops it
+  bool operator()( char &ch ) const
+    { return m_stage( ch ) && m_next( ch ); }
+
+#if defined(FTL_SSE2)
+  // Applies the stages to chunk, setting the characters they drop in drop
+  void operator()( __m128i &chunk, __m128i &drop ) const
+  {
+    m_stage( chunk, drop );
+    m_next( chunk, drop );
+  }
+#endif
+
+private:
+
+  Stage m_stage;
+  Next m_next;
+};
+
+// Output to a buffer, which may be the input itself: nothing is ever
+// written past the character being read
+struct StrPipeBufferSink
+{
+  char *m_out;
+
+  explicit StrPipeBufferSink( char *out )
+    : m_out( out ) {}
+
+  // The characters of chars[0, 16) whose bit is set in keep
+  void putSome( char const *chars, uint32_t keep )
+  {
+    // In a local, since the stores through a char * could otherwise
+    // change m_out
+    char *out = m_out;
+    for ( uint32_t i = 0; i < 16; ++i )
+    {
+      *out = chars[i];
+      out += ( keep >> i ) & 1;
+    }
+    m_out = out;
+  }
+
+#if defined(FTL_SSE2)
+  void putChunk( __m128i chunk )
+  {
+    _mm_storeu_si128( reinterpret_cast<__m128i *>( m_out ), chunk );
+    m_out += 16;
+  }
+#endif
+
+  // Called with the position in the output of each delimiter
+  void endPiece( char const * ) {}
+};
+
+// Delimiters are output like any other character, and the pieces between
+// them appended to a list, as StrRefs into the output or as std::strings
+template<typename PieceTy>
+struct StrPipePiecesSink : StrPipeBufferSink
+{
+  std::vector<PieceTy> &m_list;
+  bool const m_strict;
+  char const *m_pieceBegin;
+
+  StrPipePiecesSink( char *out, std::vector<PieceTy> &list, bool strict )
+    : StrPipeBufferSink( out )
+    , m_list( list )
+    , m_strict( strict )
+    , m_pieceBegin( out ) {}
+
+  void endPiece( char const *delim )
+  {
+    if ( m_strict || delim != m_pieceBegin )
+      m_list.push_back( PieceTy( m_pieceBegin, delim ) );
+    m_pieceBegin = delim + 1;
+  }
+
+  // The last piece, which no delimiter ends
+  void finish()
+    { endPiece( m_out ); }
+};
+
+template<
+  typename Chain,
+  typename Delim,
+#if defined(FTL_SSE2)
+  bool UseSIMD = Chain::SIMD && StrScanSIMD<Delim>::Enabled
+#else
+  bool UseSIMD = false
+#endif
+  >
+struct StrPipeRun
+{
+  template<typename Sink>
+  static void Run(
+    Chain const &chain,
+    char const *p,
+    char const *pEnd,
+    Sink &sink
+    )
+  {
+    Delim const delim;
+    char *out = sink.m_out;
+    for ( ; p != pEnd; ++p )
+    {
+      char ch = *p;
+      if ( !chain( ch ) )
+        continue;
+      *out++ = ch;
+      if ( delim( ch ) )
+        sink.endPiece( out - 1 );
+    }
+    sink.m_out = out;
+  }
+};
+
+#if defined(FTL_SSE2)
+
+template<typename Chain, typename Delim>
+struct StrPipeRun<Chain, Delim, true>
+{
+  template<typename Sink>
+  static void Run(
+    Chain const &chain,
+    char const *p,
+    char const *pEnd,
+    Sink &sink
+    )
+  {
+    Delim const delim;
+    StrScanSIMD<Delim> const delimSIMD( delim );
+    for ( ; pEnd - p >= 16; p += 16 )
+    {
+      __m128i chunk = StrScanLoad( p );
+      __m128i drop = _mm_setzero_si128();
+      chain( chunk, drop );
+      uint32_t const dropMask = StrScanMask( drop );
+      uint32_t const keep = ~dropMask & 0xFFFF;
+      char const *const chunkOut = sink.m_out;
+      if ( dropMask == 0 )
+        sink.putChunk( chunk );
+      else
+      {
+        char chars[16];
+        _mm_storeu_si128( reinterpret_cast<__m128i *>( chars ), chunk );
+        sink.putSome( chars, keep );
+      }
+
+      // Each delimiter follows the characters kept before it
+      uint32_t delimMask = StrScanMask( delimSIMD( chunk ) ) & keep;
+      for ( ; delimMask; delimMask &= delimMask - 1 )
+      {
+        uint32_t const before =
+          ( 1u << BitsCountTrailingZeros( delimMask ) ) - 1;
+        sink.endPiece( chunkOut + BitsCountOnes( keep & before ) );
+      }
+    }
+    StrPipeRun<Chain, Delim, false>::Run( chain, p, pEnd, sink );
+  }
+};
+
+#endif
+
+template<
+  typename Stage0,
+  typename Stage1 = StrPipeNone,
+  typename Stage2 = StrPipeNone,
+  typename Stage3 = StrPipeNone,
+  typename Stage4 = StrPipeNone,
+  typename Stage5 = StrPipeNone,
+  typename Stage6 = StrPipeNone,
+  typename Stage7 = StrPipeNone
+  >
+struct StrPipe
+{
+  typedef StrPipeChain<Stage0,
+    StrPipeChain<Stage1,
+    StrPipeChain<Stage2,
+    StrPipeChain<Stage3,
+    StrPipeChain<Stage4,
+    StrPipeChain<Stage5,
+    StrPipeChain<Stage6,
+    StrPipeChain<Stage7, StrPipeNone
+    > > > > > > > > Chain;
+
+  // Fails to compile if a StrPipeTrim follows another kind of stage
+  typedef char TrimsFirstCheck[Chain::TrimsFirst? 1: -1];
+
+  // Writes the output to out, which needs room for str.size()
+  // characters (and may be str.data()), and returns its end
+  static char *Write( StrRef str, char *out )
+  {
+    StrPipeBufferSink sink( out );
+    Run<MatchCharNever>( str, sink );
+    return sink.m_out;
+  }
+
+  static void AppendTo( StrRef str, std::string &result )
+  {
+    if ( str.empty() )
+      return;
+    size_t const oldSize = result.size();
+    result.resize( oldSize + str.size() );
+    char *const out = &result[0] + oldSize;
+    result.resize( oldSize + ( Write( str, out ) - out ) );
+  }
+
+  // Splits the output at the characters that match MatchChar, as
+  // StrSplit does, appending the pieces to list
+  template<typename MatchChar>
+  static void Split(
+    StrRef str,
+    std::vector<std::string> &list,
+    bool strict = false
+    )
+  {
+    std::string scratch( str.size() + 1, '\0' );
+    StrPipePiecesSink<std::string> sink( &scratch[0], list, strict );
+    Run<MatchChar>( str, sink );
+    sink.finish();
+  }
+
+  template<char CharToMatch>
+  static void Split(
+    StrRef str,
+    std::vector<std::string> &list,
+    bool strict = false
+    )
+  {
+    Split< MatchCharSingle<CharToMatch> >( str, list, strict );
+  }
+
+  // As above, with the pieces written to out (which needs room for
+  // str.size() characters, and may be str.data()) and referred to by
+  // the StrRefs of list
+  template<typename MatchChar>
+  static void Split(
+    StrRef str,
+    char *out,
+    std::vector<StrRef> &list,
+    bool strict = false
+    )
+  {
+    StrPipePiecesSink<StrRef> sink( out, list, strict );
+    Run<MatchChar>( str, sink );
+    sink.finish();
+  }
+
+  template<char CharToMatch>
+  static void Split(
+    StrRef str,
+    char *out,
+    std::vector<StrRef> &list,
+    bool strict = false
+    )
+  {
+    Split< MatchCharSingle<CharToMatch> >( str, out, list, strict );
+  }
+
+private:
+
+  template<typename Delim, typename Sink>
+  static void Run( StrRef str, Sink &sink )
+  {
+    str = Chain::Trim( str );
+    Chain const chain;
+    StrPipeRun<Chain, Delim>::Run( chain, str.begin(), str.end(), sink );
+  }
+};
+
+FTL_NAMESPACE_END
@@ -5,15 +5,19 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/Hash64Bytes.h>
 #include <FTL/MatchCharWhitespace.h>
+#include <FTL/StrScan.h>
+#include <FTL/StrToNum.h>
 
 #include <algorithm>
 #include <assert.h>
 #include <iostream>
 #include <limits.h>
-#include <locale.h>
+#include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <time.h>
 
 FTL_NAMESPACE_BEGIN
 
@@ -24,13 +28,35 @@ class StrRef
 
 protected:
 
-  static double SafeATOF( char const *cStr )
+  // Mixes what differs between processes: addresses (randomized by
+  // ASLR) and the time
+  static uint64_t MakeRandomHashSeed()
   {
-    char const *oldLocale = ::setlocale( LC_NUMERIC, "C" );
-    double result = ::atof( cStr );
-    if ( oldLocale )
-      ::setlocale( LC_NUMERIC, oldLocale );
-    return result;
+    char local;
+    uint64_t entropy[4] =
+    {
+      uint64_t( reinterpret_cast<size_t>( &local ) ),
+      uint64_t( reinterpret_cast<size_t>( &MakeRandomHashSeed ) ),
+      uint64_t( ::time( 0 ) ),
+      uint64_t( ::clock() )
+    };
+    return Hash64Bytes( entropy, sizeof( entropy ) );
+  }
+
+  // A single seed for the whole program, since an inline function's
+  // static is shared by every translation unit
+  static uint64_t &HashSeedRef()
+  {
+    static uint64_t seed = InitialHashSeed();
+    return seed;
+  }
+
+  static uint64_t InitialHashSeed()
+  {
+    char const *env = ::getenv( "FTL_RANDOM_HASH_SEED" );
+    if ( !env || !*env || ( env[0] == '0' && !env[1] ) )
+      return 0;
+    return MakeRandomHashSeed();
   }
 
 public:
@@ -107,14 +133,7 @@ public:
 
   IT find( IT b, IT e, char ch ) const
   {
-    IT it = b;
-    while ( it != e )
-    {
-      if ( *it == ch )
-        break;
-      ++it;
-    }
-    return it;
+    return StrScanFind( b, e, ch );
   }
 
   IT find( char ch ) const
@@ -125,15 +144,7 @@ public:
   template<typename MatchChar>
   IT find( IT b, IT e ) const
   {
-    MatchChar const mc;
-    IT it = b;
-    while ( it != e )
-    {
-      if ( mc( *it ) )
-        break;
-      ++it;
-    }
-    return it;
+    return StrScanFind<MatchChar>( b, e );
   }
 
   template<typename MatchChar>
@@ -142,17 +153,20 @@ public:
     return find<MatchChar>( begin(), end() );
   }
 
+  // The first occurrence of str, or e
+  IT find( IT b, IT e, StrRef str ) const
+  {
+    return StrScanFind( b, e, str.begin(), str.end() );
+  }
+
+  IT find( StrRef str ) const
+  {
+    return find( begin(), end(), str );
+  }
+
   size_t count( IT b, IT e, char ch ) const
   {
-    size_t result = 0;
-    IT it = b;
-    while ( it != e )
-    {
-      if ( *it == ch )
-        ++result;
-      ++it;
-    }
-    return result;
+    return StrScanCount( b, e, ch );
   }
 
   size_t count( char ch ) const
@@ -163,16 +177,7 @@ public:
   template<typename MatchChar>
   size_t count( IT b, IT e ) const
   {
-    MatchChar const mc;
-    size_t result = 0;
-    IT it = b;
-    while ( it != e )
-    {
-      if ( mc( *it ) )
-        ++result;
-      ++it;
-    }
-    return result;
+    return StrScanCount<MatchChar>( b, e );
   }
 
   template<typename MatchChar>
@@ -181,23 +186,27 @@ public:
     return count<MatchChar>( begin(), end() );
   }
 
+  // As atof() in the "C" locale: leading whitespace is skipped and the
+  // result is 0 when there is no number
   double toFloat64() const
   {
-    static const size_t allocaMaxSize = 1024;
-    size_t allocSize = _size + 1;
-    char *cStr;
-    if ( allocSize > allocaMaxSize )
-      cStr = (char *)( malloc( allocSize ) );
-    else
-      cStr = (char *)( alloca( allocSize ) );
-    memcpy( cStr, _data, _size );
-    cStr[_size] = '\0';
-    double result = SafeATOF( cStr );
-    if ( allocSize > allocaMaxSize )
-      free( cStr );
+    StrRef str = ltrim();
+    double result = 0.0;
+    StrToFloat64( str.begin(), str.end(), result );
     return result;
   }
 
+  // Convert the number at the start of the string, without copying it
+  // and whatever the locale; see StrToNumResult for what is returned
+  StrToNumResult toInt32( int32_t &value ) const
+    { return StrToInt32( begin(), end(), value ); }
+  StrToNumResult toInt64( int64_t &value ) const
+    { return StrToInt64( begin(), end(), value ); }
+  StrToNumResult toUInt64( uint64_t &value ) const
+    { return StrToUInt64( begin(), end(), value ); }
+  StrToNumResult toFloat64( double &value ) const
+    { return StrToFloat64( begin(), end(), value ); }
+
   typedef std::pair<StrRef, StrRef> Split;
 
   Split split( char ch ) const
@@ -220,14 +229,8 @@ public:
 
   RIT rfind( RIT rb, RIT re, char ch ) const
   {
-    RIT rit = rb;
-    while ( rit != re )
-    {
-      if ( *rit == ch )
-        break;
-      ++rit;
-    }
-    return rit;
+    IT it = StrScanRFind( re.base(), rb.base(), ch );
+    return it != rb.base()? RIT( it + 1 ): re;
   }
 
   RIT rfind( char ch ) const
@@ -235,6 +238,19 @@ public:
     return rfind( rbegin(), rend(), ch );
   }
 
+  template<typename MatchChar>
+  RIT rfind( RIT rb, RIT re ) const
+  {
+    IT it = StrScanRFind<MatchChar>( re.base(), rb.base() );
+    return it != rb.base()? RIT( it + 1 ): re;
+  }
+
+  template<typename MatchChar>
+  RIT rfind() const
+  {
+    return rfind<MatchChar>( rbegin(), rend() );
+  }
+
   Split rsplit( char ch ) const
   {
     RIT it = rfind( ch );
@@ -258,11 +274,22 @@ public:
       return StrRef( begin() + start, begin() + start + length );
   }
 
-  bool contains( char ch )
+  bool contains( char ch ) const
   {
     return find(ch) != end();
   }
 
+  template<typename MatchChar>
+  bool contains() const
+  {
+    return find<MatchChar>() != end();
+  }
+
+  bool contains( StrRef str ) const
+  {
+    return str.empty() || find( str ) != end();
+  }
+
   bool equals( StrRef that ) const
     { return _size == that._size
       && memcmp( _data, that._data, _size ) == 0; }
@@ -308,15 +335,28 @@ public:
   bool operator>=( StrRef that ) const
     { return compare( that ) >= 0; }
 
+  // XXH64 of the characters (see Hash64Bytes), which is the same on
+  // every platform for a given seed
+  uint64_t hash64( uint64_t seed = 0 ) const
+    { return Hash64Bytes( _data, _size, seed ); }
+
+  // For hash tables: hash64 with HashSeed()
   size_t hash() const
-  {
-    // [pzion 20150415] DJB2 algorithm
-    size_t result = 5381;
-    char const *pEnd = _data + _size;
-    for ( char const *p = _data; p != pEnd; ++p )
-      result = ((result << 5) + result) + size_t(*p);
-    return result;
-  }
+    { return size_t( hash64( HashSeed() ) ); }
+
+  // 0, or a value chosen once per process, so that keys from untrusted
+  // input, such as JSON object keys, cannot be picked to collide.  The
+  // random seed is used if EnableRandomHashSeed() has been called, or if
+  // the FTL_RANDOM_HASH_SEED environment variable is set to anything but
+  // "" or "0" when the seed is first needed.
+  static uint64_t HashSeed()
+    { return HashSeedRef(); }
+
+  // Switches to a random HashSeed().  Call it before anything is hashed
+  // and before other threads start, as early in main() as possible;
+  // tables filled with the old seed can no longer be searched.
+  static void EnableRandomHashSeed()
+    { HashSeedRef() = MakeRandomHashSeed(); }
 
   struct Hash
   {
@@ -376,9 +416,6 @@ public:
 
   char const *c_str() const { return data(); }
 
-  double toFloat64() const
-    { return SafeATOF( c_str() ); }
-
   typedef std::pair<StrRef, CStrRef> Split;
 
   Split split( char ch ) const
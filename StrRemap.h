@@ -5,20 +5,119 @@
 #pragma once
 
 #include <FTL/Config.h>
+#include <FTL/MapCharShift.h>
+#include <FTL/MatchCharRange.h>
+#include <FTL/StrRef.h>
+#include <FTL/StrScan.h>
 
+#include <stdint.h>
 #include <string>
 
+//
+// Applies a MapChar to every character of a string.  MapChars with a
+// MapCharShift (the case mappings and MapCharSingle) are applied 16
+// characters at a time with SSE2; other MapChars are tabulated, for
+// strings long enough to pay for the 256 calls, and looked up per
+// character.
+//
+
 FTL_NAMESPACE_BEGIN
 
+template<
+  typename FnMap,
+  bool UseSIMD = MapCharShift<FnMap>::Enabled
+  >
+struct StrRemapImpl
+{
+  // Strings from which on a table is built
+  static const size_t TableMinSize = 1024;
+
+  static char *Remap( char const *p, char const *pEnd, char *out )
+  {
+    FnMap const mf;
+    if ( size_t( pEnd - p ) >= TableMinSize )
+    {
+      char table[256];
+      for ( uint32_t c = 0; c < 256; ++c )
+        table[c] = mf( char( c ) );
+      for ( ; p != pEnd; ++p )
+        *out++ = table[uint8_t( *p )];
+    }
+    else
+    {
+      for ( ; p != pEnd; ++p )
+        *out++ = mf( *p );
+    }
+    return out;
+  }
+};
+
+#if defined(FTL_SSE2)
+
 template<typename FnMap>
-void StrRemap( std::string &str )
+struct StrRemapImpl<FnMap, true>
+{
+  typedef MapCharShift<FnMap> Shift;
+  typedef MatchCharRange<Shift::Lo, Shift::Hi> Range;
+
+  static __m128i Map(
+    StrScanSIMD<Range> const &inRange,
+    __m128i delta,
+    __m128i chunk
+    )
+  {
+    return _mm_add_epi8( chunk, _mm_and_si128( inRange( chunk ), delta ) );
+  }
+
+  static char *Remap( char const *p, char const *pEnd, char *out )
+  {
+    size_t const size = pEnd - p;
+    if ( size < 16 )
+    {
+      FnMap const mf;
+      for ( ; p != pEnd; ++p )
+        *out++ = mf( *p );
+      return out;
+    }
+
+    StrScanSIMD<Range> const inRange( (Range()) );
+    __m128i const delta = _mm_set1_epi8( Shift::Delta );
+
+    // The last 16 characters are loaded before anything is stored, so
+    // that they can be mapped as one (overlapping) chunk even in place
+    __m128i const last = StrScanLoad( pEnd - 16 );
+    char *const outEnd = out + size;
+    for ( ; pEnd - p > 16; p += 16, out += 16 )
+      _mm_storeu_si128(
+        reinterpret_cast<__m128i *>( out ),
+        Map( inRange, delta, StrScanLoad( p ) )
+        );
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i *>( outEnd - 16 ),
+      Map( inRange, delta, last )
+      );
+    return outEnd;
+  }
+};
+
+#endif
+
+// Writes str, mapped, to out, which may be str.data() to map in place,
+// and returns the end of the output
+template<typename FnMap>
+char *StrRemap( StrRef str, char *out )
 {
-  FnMap const mf;
+  return StrRemapImpl<FnMap>::Remap( str.begin(), str.end(), out );
+}
 
-  std::string::iterator const itBegin = str.begin();
-  std::string::iterator const itEnd = str.end();
-  for ( std::string::iterator it = itBegin; it != itEnd; ++it )
-    *it = mf( *it );
+template<typename FnMap>
+void StrRemap( std::string &str )
+{
+  if ( !str.empty() )
+  {
+    char *const p = &str[0];
+    StrRemapImpl<FnMap>::Remap( p, p + str.size(), p );
+  }
 }
 
 FTL_NAMESPACE_END
@@ -0,0 +1,637 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Bits.h>
+#include <FTL/Config.h>
+#include <FTL/MatchChar.h>
+#include <FTL/MatchCharTable.h>
+
+#include <stddef.h>
+#include <string.h>
+#if defined(FTL_SSE2)
+# include <emmintrin.h>
+#endif
+#if defined(FTL_SSSE3)
+# include <tmmintrin.h>
+#endif
+
+//
+// The searches behind StrRef's find, rfind, count and contains, and
+// StrFilter, over [p, pEnd).  Finds return the first (resp. last) match
+// or, if there is none, pEnd.
+//
+// Single characters are found with memchr, which the C library already
+// vectorizes (with AVX2, where available, chosen at run time).  The
+// rest use SSE2, 16 characters at a time: MatchChars that StrScanSIMD
+// knows how to classify in bulk (MatchCharSingle, MatchCharRange and
+// MatchCharAny of those, ...) as well as substrings, which are found by
+// comparing their first and last characters at every position and only
+// then the characters between.  With SSSE3, any MatchChar with a
+// MatchCharBits bitmap is classified with two table shuffles.  Other
+// MatchChars are tested one character at a time.
+//
+
+FTL_NAMESPACE_BEGIN
+
+// Matches one character given at run time, for the single-character
+// searches
+struct StrScanCharMatch
+{
+  char m_ch;
+
+  explicit StrScanCharMatch( char ch )
+    : m_ch( ch ) {}
+
+  bool operator()( char ch ) const
+    { return ch == m_ch; }
+};
+
+template<bool Cond, typename TrueTy, typename FalseTy>
+struct StrScanSelect
+{
+  typedef TrueTy Type;
+};
+
+template<typename TrueTy, typename FalseTy>
+struct StrScanSelect<false, TrueTy, FalseTy>
+{
+  typedef FalseTy Type;
+};
+
+// Classifies 16 characters at once by a MatchChar's MatchCharBits, with
+// SSSE3 (see StrScanSIMD)
+template<
+  typename MatchChar,
+  bool UseTable =
+#if defined(FTL_SSSE3)
+    MatchCharBits<MatchChar>::Enabled
+#else
+    false
+#endif
+  >
+struct StrScanSIMDTable
+{
+  static const bool Enabled = false;
+
+  // So that StrPipeFilter can hold one for any MatchChar; it is never
+  // applied
+  StrScanSIMDTable( MatchChar const & ) {}
+};
+
+#if defined(FTL_SSSE3)
+
+// Each row has bit i set if the character i * 16 + (its index) matches,
+// for the characters below 0x80 (rowsLow) and from 0x80 (rowsHigh);
+// pshufb picks a character's row by its low nibble, and yields zero for
+// indices with the top bit set, which selects the half
+inline __m128i StrScanNibbleMatch(
+  __m128i rowsLow,
+  __m128i rowsHigh,
+  __m128i chunk
+  )
+{
+  __m128i const rows = _mm_or_si128(
+    _mm_shuffle_epi8( rowsLow, chunk ),
+    _mm_shuffle_epi8(
+      rowsHigh, _mm_xor_si128( chunk, _mm_set1_epi8( char( 0x80 ) ) )
+      )
+    );
+  __m128i const highNibbles = _mm_and_si128(
+    _mm_srli_epi16( chunk, 4 ), _mm_set1_epi8( 0x0F )
+    );
+  __m128i const bits = _mm_shuffle_epi8(
+    _mm_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, char( 0x80 ),
+      1, 2, 4, 8, 16, 32, 64, char( 0x80 )
+      ),
+    highNibbles
+    );
+  return _mm_cmpeq_epi8( _mm_and_si128( rows, bits ), bits );
+}
+
+template<typename MatchChar>
+struct StrScanSIMDTable<MatchChar, true>
+{
+  static const bool Enabled = true;
+
+  StrScanSIMDTable( MatchChar const & )
+    : m_rowsLow( _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(
+          &MatchCharTable<MatchChar>::NibbleRows[0]
+          )
+        ) )
+    , m_rowsHigh( _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(
+          &MatchCharTable<MatchChar>::NibbleRows[16]
+          )
+        ) )
+    {}
+
+  __m128i operator()( __m128i chunk ) const
+    { return StrScanNibbleMatch( m_rowsLow, m_rowsHigh, chunk ); }
+
+private:
+
+  __m128i const m_rowsLow;
+  __m128i const m_rowsHigh;
+};
+
+#endif
+
+// Enabled for MatchChars that can classify 16 characters at once: it is
+// constructed from the MatchChar, and returns a mask with 0xFF in the
+// bytes of chunk that match.  Simple classes are specialized below;
+// others use their bitmap, if any.
+template<typename MatchChar>
+struct StrScanSIMD : StrScanSIMDTable<MatchChar>
+{
+  StrScanSIMD( MatchChar const &mc )
+    : StrScanSIMDTable<MatchChar>( mc ) {}
+};
+
+#if defined(FTL_SSE2)
+
+template<>
+struct StrScanSIMD<MatchCharAlways>
+{
+  static const bool Enabled = true;
+  StrScanSIMD( MatchCharAlways const & ) {}
+  __m128i operator()( __m128i ) const
+    { return _mm_set1_epi8( char( 0xFF ) ); }
+};
+
+template<>
+struct StrScanSIMD<MatchCharNever>
+{
+  static const bool Enabled = true;
+  StrScanSIMD( MatchCharNever const & ) {}
+  __m128i operator()( __m128i ) const
+    { return _mm_setzero_si128(); }
+};
+
+template<>
+struct StrScanSIMD<StrScanCharMatch>
+{
+  static const bool Enabled = true;
+  __m128i const m_ch;
+  StrScanSIMD( StrScanCharMatch const &mc )
+    : m_ch( _mm_set1_epi8( mc.m_ch ) ) {}
+  __m128i operator()( __m128i chunk ) const
+    { return _mm_cmpeq_epi8( chunk, m_ch ); }
+};
+
+template<char CharToMatch>
+struct StrScanSIMD< MatchCharSingle<CharToMatch> >
+{
+  static const bool Enabled = true;
+  StrScanSIMD( MatchCharSingle<CharToMatch> const & ) {}
+  __m128i operator()( __m128i chunk ) const
+    { return _mm_cmpeq_epi8( chunk, _mm_set1_epi8( CharToMatch ) ); }
+};
+
+template<char BeginCharToMatch, char EndCharToMatch>
+struct StrScanSIMD< MatchCharRange<BeginCharToMatch, EndCharToMatch> >
+{
+  static const bool Enabled = true;
+  StrScanSIMD(
+    MatchCharRange<BeginCharToMatch, EndCharToMatch> const &
+    ) {}
+  __m128i operator()( __m128i chunk ) const
+  {
+    if ( !( BeginCharToMatch <= EndCharToMatch ) )
+      return _mm_setzero_si128();
+    // ch - Begin <= End - Begin, unsigned, which is max( x, k ) == k
+    __m128i const limit =
+      _mm_set1_epi8( char( EndCharToMatch - BeginCharToMatch ) );
+    __m128i const offset = _mm_sub_epi8(
+      chunk, _mm_set1_epi8( BeginCharToMatch )
+      );
+    return _mm_cmpeq_epi8( _mm_max_epu8( offset, limit ), limit );
+  }
+};
+
+template<>
+struct StrScanSIMD<MatchCharWhitespace>
+{
+  static const bool Enabled = true;
+  StrScanSIMD( MatchCharWhitespace const & ) {}
+  __m128i operator()( __m128i chunk ) const
+  {
+    return _mm_or_si128(
+      StrScanSIMD< MatchCharRange<'\t', '\r'> >(
+        MatchCharRange<'\t', '\r'>()
+        )( chunk ),
+      _mm_cmpeq_epi8( chunk, _mm_set1_epi8( ' ' ) )
+      );
+  }
+};
+
+// The union of the alternatives' classifications
+template<
+  typename MatchChar0,
+  typename MatchChar1,
+  typename MatchChar2,
+  typename MatchChar3,
+  typename MatchChar4,
+  typename MatchChar5,
+  typename MatchChar6,
+  typename MatchChar7,
+  typename MatchChar8,
+  typename MatchChar9
+  >
+struct StrScanSIMDAny
+{
+  static const bool Enabled =
+    StrScanSIMD<MatchChar0>::Enabled
+    && StrScanSIMD<MatchChar1>::Enabled
+    && StrScanSIMD<MatchChar2>::Enabled
+    && StrScanSIMD<MatchChar3>::Enabled
+    && StrScanSIMD<MatchChar4>::Enabled
+    && StrScanSIMD<MatchChar5>::Enabled
+    && StrScanSIMD<MatchChar6>::Enabled
+    && StrScanSIMD<MatchChar7>::Enabled
+    && StrScanSIMD<MatchChar8>::Enabled
+    && StrScanSIMD<MatchChar9>::Enabled;
+
+  // The alternatives of a MatchCharAny are stateless
+  StrScanSIMDAny(
+    MatchCharAny<
+      MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+      MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+      > const &
+    )
+    : _0( MatchChar0() ), _1( MatchChar1() ), _2( MatchChar2() )
+    , _3( MatchChar3() ), _4( MatchChar4() ), _5( MatchChar5() )
+    , _6( MatchChar6() ), _7( MatchChar7() ), _8( MatchChar8() )
+    , _9( MatchChar9() ) {}
+
+  __m128i operator()( __m128i chunk ) const
+  {
+    return _mm_or_si128(
+      _mm_or_si128(
+        _mm_or_si128( _0( chunk ), _1( chunk ) ),
+        _mm_or_si128( _2( chunk ), _3( chunk ) )
+        ),
+      _mm_or_si128(
+        _mm_or_si128(
+          _mm_or_si128( _4( chunk ), _5( chunk ) ),
+          _mm_or_si128( _6( chunk ), _7( chunk ) )
+          ),
+        _mm_or_si128( _8( chunk ), _9( chunk ) )
+        )
+      );
+  }
+
+private:
+  StrScanSIMD<MatchChar0> const _0;
+  StrScanSIMD<MatchChar1> const _1;
+  StrScanSIMD<MatchChar2> const _2;
+  StrScanSIMD<MatchChar3> const _3;
+  StrScanSIMD<MatchChar4> const _4;
+  StrScanSIMD<MatchChar5> const _5;
+  StrScanSIMD<MatchChar6> const _6;
+  StrScanSIMD<MatchChar7> const _7;
+  StrScanSIMD<MatchChar8> const _8;
+  StrScanSIMD<MatchChar9> const _9;
+};
+
+// With SSSE3, classes with a bitmap take the shuffles rather than up to
+// ten comparisons
+template<
+  typename MatchChar0,
+  typename MatchChar1,
+  typename MatchChar2,
+  typename MatchChar3,
+  typename MatchChar4,
+  typename MatchChar5,
+  typename MatchChar6,
+  typename MatchChar7,
+  typename MatchChar8,
+  typename MatchChar9
+  >
+struct StrScanSIMD<
+  MatchCharAny<
+    MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+    MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+    >
+  >
+  : StrScanSelect<
+    StrScanSIMDTable<
+      MatchCharAny<
+        MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+        MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+        >
+      >::Enabled,
+    StrScanSIMDTable<
+      MatchCharAny<
+        MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+        MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+        >
+      >,
+    StrScanSIMDAny<
+      MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+      MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+      >
+    >::Type
+{
+  typedef MatchCharAny<
+    MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+    MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+    > Any;
+  typedef typename StrScanSelect<
+    StrScanSIMDTable<Any>::Enabled,
+    StrScanSIMDTable<Any>,
+    StrScanSIMDAny<
+      MatchChar0, MatchChar1, MatchChar2, MatchChar3, MatchChar4,
+      MatchChar5, MatchChar6, MatchChar7, MatchChar8, MatchChar9
+      >
+    >::Type Base;
+
+  StrScanSIMD( Any const &mc )
+    : Base( mc ) {}
+};
+
+inline __m128i StrScanLoad( char const *p )
+  { return _mm_loadu_si128( reinterpret_cast<__m128i const *>( p ) ); }
+
+inline uint32_t StrScanMask( __m128i matches )
+  { return uint32_t( _mm_movemask_epi8( matches ) ); }
+
+// Counts the matches of chunks' masks: each byte of counts accumulates
+// (by subtracting 0xFF, i.e. adding 1) up to 255 of them before they
+// are summed into total
+class StrScanCounter
+{
+public:
+
+  StrScanCounter()
+    : m_counts( _mm_setzero_si128() ), m_pending( 0 ), m_total( 0 ) {}
+
+  void add( __m128i matches )
+  {
+    m_counts = _mm_sub_epi8( m_counts, matches );
+    if ( ++m_pending == 255 )
+      flush();
+  }
+
+  size_t flush()
+  {
+    __m128i sums = _mm_sad_epu8( m_counts, _mm_setzero_si128() );
+    m_total += size_t( _mm_cvtsi128_si32( sums ) )
+      + size_t( _mm_cvtsi128_si32( _mm_srli_si128( sums, 8 ) ) );
+    m_counts = _mm_setzero_si128();
+    m_pending = 0;
+    return m_total;
+  }
+
+private:
+
+  __m128i m_counts;
+  uint32_t m_pending;
+  size_t m_total;
+};
+
+#endif
+
+template<typename MatchChar, bool UseSIMD = StrScanSIMD<MatchChar>::Enabled>
+struct StrScanImpl
+{
+  static char const *Find(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    while ( p != pEnd && !mc( *p ) )
+      ++p;
+    return p;
+  }
+
+  static char const *RFind(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    for ( char const *q = pEnd; q != p; )
+    {
+      if ( mc( *--q ) )
+        return q;
+    }
+    return pEnd;
+  }
+
+  static size_t Count(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    size_t result = 0;
+    for ( ; p != pEnd; ++p )
+    {
+      if ( mc( *p ) )
+        ++result;
+    }
+    return result;
+  }
+
+  // Every character is stored, but out only moves past those to keep
+  static char *Filter(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd,
+    char *out
+    )
+  {
+    for ( ; p != pEnd; ++p )
+    {
+      char const ch = *p;
+      *out = ch;
+      out += !mc( ch );
+    }
+    return out;
+  }
+};
+
+#if defined(FTL_SSE2)
+
+template<typename MatchChar>
+struct StrScanImpl<MatchChar, true>
+{
+  typedef StrScanImpl<MatchChar, false> Scalar;
+
+  static char const *Find(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    StrScanSIMD<MatchChar> const simd( mc );
+    for ( ; pEnd - p >= 16; p += 16 )
+    {
+      uint32_t mask = StrScanMask( simd( StrScanLoad( p ) ) );
+      if ( mask )
+        return p + BitsCountTrailingZeros( mask );
+    }
+    return Scalar::Find( mc, p, pEnd );
+  }
+
+  static char const *RFind(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    StrScanSIMD<MatchChar> const simd( mc );
+    char const *q = pEnd;
+    for ( ; q - p >= 16; )
+    {
+      q -= 16;
+      uint32_t mask = StrScanMask( simd( StrScanLoad( q ) ) );
+      if ( mask )
+        return q + ( 63 - BitsCountLeadingZeros( mask ) );
+    }
+    char const *it = Scalar::RFind( mc, p, q );
+    return it != q? it: pEnd;
+  }
+
+  static size_t Count(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd
+    )
+  {
+    StrScanSIMD<MatchChar> const simd( mc );
+    StrScanCounter counter;
+    for ( ; pEnd - p >= 16; p += 16 )
+      counter.add( simd( StrScanLoad( p ) ) );
+    return counter.flush() + Scalar::Count( mc, p, pEnd );
+  }
+
+  static char *Filter(
+    MatchChar const &mc,
+    char const *p,
+    char const *pEnd,
+    char *out
+    )
+  {
+    StrScanSIMD<MatchChar> const simd( mc );
+    for ( ; pEnd - p >= 16; p += 16 )
+    {
+      __m128i const chunk = StrScanLoad( p );
+      uint32_t const mask = StrScanMask( simd( chunk ) );
+      if ( mask == 0 )
+      {
+        _mm_storeu_si128( reinterpret_cast<__m128i *>( out ), chunk );
+        out += 16;
+      }
+      else if ( mask != 0xFFFF )
+      {
+        for ( uint32_t i = 0; i < 16; ++i )
+        {
+          *out = p[i];
+          out += ( ~mask >> i ) & 1;
+        }
+      }
+    }
+    return Scalar::Filter( mc, p, pEnd, out );
+  }
+};
+
+#endif
+
+template<typename MatchChar>
+inline char const *StrScanFind( char const *p, char const *pEnd )
+  { return StrScanImpl<MatchChar>::Find( MatchChar(), p, pEnd ); }
+
+template<typename MatchChar>
+inline char const *StrScanRFind( char const *p, char const *pEnd )
+  { return StrScanImpl<MatchChar>::RFind( MatchChar(), p, pEnd ); }
+
+template<typename MatchChar>
+inline size_t StrScanCount( char const *p, char const *pEnd )
+  { return StrScanImpl<MatchChar>::Count( MatchChar(), p, pEnd ); }
+
+// Copies the characters that do not match to out, which may be p (or
+// anywhere before it) to filter in place, and returns the end of the
+// copy
+template<typename MatchChar>
+inline char *StrScanFilter( char const *p, char const *pEnd, char *out )
+  { return StrScanImpl<MatchChar>::Filter( MatchChar(), p, pEnd, out ); }
+
+inline char const *StrScanFind( char const *p, char const *pEnd, char ch )
+{
+  if ( p == pEnd )
+    return pEnd;
+  void const *it = memchr( p, ch, size_t( pEnd - p ) );
+  return it? static_cast<char const *>( it ): pEnd;
+}
+
+inline char const *StrScanRFind( char const *p, char const *pEnd, char ch )
+{
+  return StrScanImpl<StrScanCharMatch>::RFind(
+    StrScanCharMatch( ch ), p, pEnd
+    );
+}
+
+inline size_t StrScanCount( char const *p, char const *pEnd, char ch )
+{
+  return StrScanImpl<StrScanCharMatch>::Count(
+    StrScanCharMatch( ch ), p, pEnd
+    );
+}
+
+// Finds the first occurrence of [n, nEnd), which is found at p if empty
+inline char const *StrScanFind(
+  char const *p,
+  char const *pEnd,
+  char const *n,
+  char const *nEnd
+  )
+{
+  size_t const size = size_t( nEnd - n );
+  if ( size == 0 )
+    return p;
+  if ( size_t( pEnd - p ) < size )
+    return pEnd;
+  if ( size == 1 )
+    return StrScanFind( p, pEnd, *n );
+
+  // The last position where the substring can start
+  char const *const pLast = pEnd - size;
+#if defined(FTL_SSE2)
+  __m128i const first = _mm_set1_epi8( n[0] );
+  __m128i const last = _mm_set1_epi8( n[size - 1] );
+  for ( ; pLast - p >= 15; p += 16 )
+  {
+    uint32_t mask = StrScanMask(
+      _mm_and_si128(
+        _mm_cmpeq_epi8( StrScanLoad( p ), first ),
+        _mm_cmpeq_epi8( StrScanLoad( p + size - 1 ), last )
+        )
+      );
+    while ( mask )
+    {
+      char const *candidate = p + BitsCountTrailingZeros( mask );
+      if ( memcmp( candidate + 1, n + 1, size - 2 ) == 0 )
+        return candidate;
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for ( ; p <= pLast; ++p )
+  {
+    p = StrScanFind( p, pLast + 1, n[0] );
+    if ( p > pLast )
+      break;
+    if ( memcmp( p + 1, n + 1, size - 1 ) == 0 )
+      return p;
+  }
+  return pEnd;
+}
+
+FTL_NAMESPACE_END
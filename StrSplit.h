@@ -8,6 +8,7 @@
 #include <FTL/MatchCharSingle.h>
 #include <FTL/StrRef.h>
 
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -20,8 +21,6 @@ void StrSplit(
   bool strict = false
   )
 {
-  MatchChar const mc;
-
   StrRef::IT itBegin = strRef.begin();
   StrRef::IT const itEnd = strRef.end();
   for (;;)
@@ -52,8 +51,6 @@ void StrSplit(
   bool strict = false
   )
 {
-  MatchChar const mc;
-
   StrRef::IT itBegin = strRef.begin();
   StrRef::IT const itEnd = strRef.end();
   for (;;)
@@ -77,4 +74,126 @@ void StrSplit(
   StrSplit< MatchCharSingle<CharToMatch> >( strRef, list, strict );
 }
 
+// The pieces of str between characters that match MatchChar, one at a
+// time as StrRefs into str, without allocating; the same pieces, in the
+// same (strict or not) way, as StrSplit.  For example, to go through the
+// lines of a (memory-mapped) file:
+//
+// typedef StrSplitRange< MatchCharSingle<'\n'> > Lines;
+// Lines lines( StrRef( data, size ) );
+// for ( Lines::const_iterator it = lines.begin(); it != lines.end(); ++it )
+//   ...( *it );
+//
+template<typename MatchChar>
+class StrSplitRange
+{
+public:
+
+  class const_iterator
+  {
+    friend class StrSplitRange;
+
+  public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef StrRef value_type;
+    typedef ptrdiff_t difference_type;
+    typedef StrRef const *pointer;
+    typedef StrRef const &reference;
+
+    const_iterator()
+      : m_next( 0 ), m_end( 0 ), m_strict( false ), m_done( true )
+      , m_more( false ) {}
+
+    StrRef const &operator*() const
+      { return m_piece; }
+
+    StrRef const *operator->() const
+      { return &m_piece; }
+
+    const_iterator &operator++()
+    {
+      advance();
+      return *this;
+    }
+
+    const_iterator operator++( int )
+    {
+      const_iterator result = *this;
+      advance();
+      return result;
+    }
+
+    bool operator==( const_iterator const &that ) const
+    {
+      if ( m_done || that.m_done )
+        return m_done == that.m_done;
+      return m_piece.begin() == that.m_piece.begin()
+        && m_next == that.m_next;
+    }
+
+    bool operator!=( const_iterator const &that ) const
+      { return !( *this == that ); }
+
+  private:
+
+    const_iterator( StrRef str, bool strict )
+      : m_next( str.begin() )
+      , m_end( str.end() )
+      , m_strict( strict )
+      , m_done( false )
+      , m_more( true )
+    {
+      advance();
+    }
+
+    void advance()
+    {
+      for (;;)
+      {
+        if ( !m_more )
+        {
+          m_done = true;
+          m_piece = StrRef();
+          return;
+        }
+        StrRef::IT it = StrScanFind<MatchChar>( m_next, m_end );
+        StrRef piece( m_next, it );
+        m_more = it != m_end;
+        m_next = m_more? it + 1: m_end;
+        if ( m_strict || !piece.empty() )
+        {
+          m_piece = piece;
+          return;
+        }
+      }
+    }
+
+    StrRef m_piece;
+    StrRef::IT m_next;
+    StrRef::IT m_end;
+    bool m_strict;
+    // No piece at all: this is the end iterator
+    bool m_done;
+    // Whether a delimiter followed m_piece, so another piece may follow
+    bool m_more;
+  };
+
+  typedef const_iterator iterator;
+
+  StrSplitRange( StrRef str, bool strict = false )
+    : m_str( str ), m_strict( strict ) {}
+
+  const_iterator begin() const
+    { return const_iterator( m_str, m_strict ); }
+
+  const_iterator end() const
+    { return const_iterator(); }
+
+private:
+
+  StrRef m_str;
+  bool m_strict;
+};
+
 FTL_NAMESPACE_END
@@ -15,4 +15,9 @@ inline void StrToLower( std::string &str )
   StrRemap<MapCharToLower>( str );
 }
 
+inline char *StrToLower( StrRef str, char *out )
+{
+  return StrRemap<MapCharToLower>( str, out );
+}
+
 FTL_NAMESPACE_END
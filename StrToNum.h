@@ -0,0 +1,438 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+
+#include <float.h>
+#include <limits>
+#include <locale.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(FTL_OS_DARWIN)
+# include <xlocale.h>
+#endif
+
+FTL_NAMESPACE_BEGIN
+
+// What StrToInt32, StrToInt64, StrToUInt64 and StrToFloat64 consumed, in
+// the manner of std::from_chars: end is one past the last character of
+// the number, or the beginning of the input when it does not start with
+// one (and the value is left unchanged).  overflow is set when the number
+// is out of the type's range; the value is then the nearest one in range
+// (for floating point, an infinity).
+struct StrToNumResult
+{
+  char const *end;
+  bool overflow;
+};
+
+// Accumulates the run of decimal digits at p into value, saturating (and
+// setting overflow) above UINT64_MAX; returns the end of the run
+inline char const *StrToNumDigits(
+  char const *p,
+  char const *pEnd,
+  uint64_t &value,
+  bool &overflow
+  )
+{
+  static uint64_t const MaxDiv10 = UINT64_C(1844674407370955161);
+  static uint32_t const MaxMod10 = 5;
+
+  char const *const digitsBegin = p;
+  uint64_t v = 0;
+
+#if defined(FTL_LITTLE_ENDIAN)
+  // Convert 8 digits at a time (SWAR) while the total stays within the 19
+  // digits that cannot overflow
+  while ( pEnd - p >= 8 && p - digitsBegin <= 11 )
+  {
+    uint64_t chunk;
+    memcpy( &chunk, p, 8 );
+    // Each byte is a digit when its high nibble is 3 and adding 6 to it
+    // does not carry out of the low nibble
+    if ( ( ( chunk & UINT64_C(0xF0F0F0F0F0F0F0F0) )
+      | ( ( ( chunk + UINT64_C(0x0606060606060606) )
+        & UINT64_C(0xF0F0F0F0F0F0F0F0) ) >> 4 ) )
+      != UINT64_C(0x3333333333333333) )
+      break;
+    chunk = ( ( chunk & UINT64_C(0x0F0F0F0F0F0F0F0F) ) * 2561 ) >> 8;
+    chunk = ( ( chunk & UINT64_C(0x00FF00FF00FF00FF) ) * 6553601 ) >> 16;
+    chunk = ( ( chunk & UINT64_C(0x0000FFFF0000FFFF) )
+      * UINT64_C(42949672960001) ) >> 32;
+    v = v * 100000000 + chunk;
+    p += 8;
+  }
+#endif
+
+  char const *const exactEnd =
+    size_t( pEnd - digitsBegin ) > 19? digitsBegin + 19: pEnd;
+  for ( ; p != exactEnd; ++p )
+  {
+    uint32_t digit = uint32_t( uint8_t( *p ) ) - uint32_t( '0' );
+    if ( digit > 9 )
+      break;
+    v = v * 10 + digit;
+  }
+  if ( p == exactEnd )
+  {
+    for ( ; p != pEnd; ++p )
+    {
+      uint32_t digit = uint32_t( uint8_t( *p ) ) - uint32_t( '0' );
+      if ( digit > 9 )
+        break;
+      if ( v > MaxDiv10 || ( v == MaxDiv10 && digit > MaxMod10 ) )
+      {
+        overflow = true;
+        v = std::numeric_limits<uint64_t>::max();
+      }
+      else
+        v = v * 10 + digit;
+    }
+  }
+
+  value = v;
+  return p;
+}
+
+// An optionally signed integer whose magnitude is at most maxPositive, or
+// maxPositive + 1 when negative
+template<typename SIntTy>
+inline StrToNumResult StrToNumSigned(
+  char const *p,
+  char const *pEnd,
+  uint64_t maxPositive,
+  SIntTy &value
+  )
+{
+  StrToNumResult result = { p, false };
+
+  bool negative = false;
+  char const *digitsBegin = p;
+  if ( digitsBegin != pEnd && ( *digitsBegin == '-' || *digitsBegin == '+' ) )
+  {
+    negative = *digitsBegin == '-';
+    ++digitsBegin;
+  }
+
+  uint64_t magnitude;
+  bool overflow = false;
+  char const *digitsEnd =
+    StrToNumDigits( digitsBegin, pEnd, magnitude, overflow );
+  if ( digitsEnd == digitsBegin )
+    return result;
+
+  uint64_t maxMagnitude = negative? maxPositive + 1: maxPositive;
+  if ( magnitude > maxMagnitude )
+  {
+    overflow = true;
+    magnitude = maxMagnitude;
+  }
+
+  // Two's complement negation in the unsigned type, as atoi() would
+  value = SIntTy( negative? uint64_t(0) - magnitude: magnitude );
+  result.end = digitsEnd;
+  result.overflow = overflow;
+  return result;
+}
+
+// Parses a decimal integer at the start of [p, pEnd): an optional '-' or
+// '+' followed by digits, with no whitespace skipped and no base prefix
+inline StrToNumResult StrToInt32(
+  char const *p,
+  char const *pEnd,
+  int32_t &value
+  )
+{
+  return StrToNumSigned(
+    p, pEnd, uint64_t( std::numeric_limits<int32_t>::max() ), value
+    );
+}
+
+inline StrToNumResult StrToInt64(
+  char const *p,
+  char const *pEnd,
+  int64_t &value
+  )
+{
+  return StrToNumSigned(
+    p, pEnd, uint64_t( std::numeric_limits<int64_t>::max() ), value
+    );
+}
+
+// As StrToInt64, but a '-' sign is not accepted
+inline StrToNumResult StrToUInt64(
+  char const *p,
+  char const *pEnd,
+  uint64_t &value
+  )
+{
+  StrToNumResult result = { p, false };
+
+  char const *digitsBegin = p;
+  if ( digitsBegin != pEnd && *digitsBegin == '+' )
+    ++digitsBegin;
+
+  uint64_t v;
+  bool overflow = false;
+  char const *digitsEnd = StrToNumDigits( digitsBegin, pEnd, v, overflow );
+  if ( digitsEnd == digitsBegin )
+    return result;
+
+  value = v;
+  result.end = digitsEnd;
+  result.overflow = overflow;
+  return result;
+}
+
+// Converts the well-formed number [p, pEnd) with the C library, in the
+// "C" locale whatever the process's locale is.  The locale is created
+// once and passed to strtod_l, so unlike setlocale() this is thread-safe.
+inline double StrToFloat64Slow( char const *p, char const *pEnd )
+{
+  static size_t const StackBufSize = 64;
+
+  size_t size = size_t( pEnd - p );
+  char stackBuf[StackBufSize];
+  char *buf = size < StackBufSize?
+    stackBuf: static_cast<char *>( malloc( size + 1 ) );
+  memcpy( buf, p, size );
+  buf[size] = '\0';
+
+#if defined(FTL_PLATFORM_WINDOWS)
+  static _locale_t const cLocale = _create_locale( LC_NUMERIC, "C" );
+  double result = _strtod_l( buf, 0, cLocale );
+#else
+  static locale_t const cLocale =
+    newlocale( LC_NUMERIC_MASK, "C", locale_t( 0 ) );
+  double result = strtod_l( buf, 0, cLocale );
+#endif
+
+  if ( buf != stackBuf )
+    free( buf );
+  return result;
+}
+
+// The value of the well-formed number [p, pEnd), given as mantissa *
+// 10^exponent.  mantissaDigits counts the significant digits; only when
+// there are at most 19 is mantissa exact.  Falls back to
+// StrToFloat64Slow when the result could be inexact.
+inline double StrToFloat64Decimal(
+  bool negative,
+  uint64_t mantissa,
+  uint32_t mantissaDigits,
+  int32_t exponent,
+  char const *p,
+  char const *pEnd
+  )
+{
+  if ( mantissa == 0 && mantissaDigits == 0 )
+    return negative? -0.0: 0.0;
+
+  // Fast path (Clinger): the mantissa and the power of ten are both
+  // exactly representable, so a single correctly-rounded multiply or
+  // divide gives the correctly-rounded result.
+#if ( defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0 ) \
+  || ( defined(__FLT_EVAL_METHOD__) && __FLT_EVAL_METHOD__ == 0 ) \
+  || defined(_M_X64)
+  static double const powersOf10[] =
+  {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  static uint64_t const maxExact = UINT64_C(1) << 53;
+  if ( mantissaDigits <= 19 && mantissa <= maxExact )
+  {
+    if ( exponent >= -22 && exponent <= 22 )
+    {
+      double value = double( mantissa );
+      if ( exponent < 0 )
+        value /= powersOf10[-exponent];
+      else
+        value *= powersOf10[exponent];
+      return negative? -value: value;
+    }
+
+    // Moving some of a large exponent into the mantissa keeps it exact,
+    // as in "12e30"
+    if ( exponent > 22 && exponent <= 22 + 15 )
+    {
+      static uint64_t const pow10[] =
+      {
+        UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+        UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+        UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+        UINT64_C(10000000000), UINT64_C(100000000000),
+        UINT64_C(1000000000000), UINT64_C(10000000000000),
+        UINT64_C(100000000000000), UINT64_C(1000000000000000)
+      };
+      uint64_t scale = pow10[exponent - 22];
+      if ( mantissa <= maxExact / scale )
+      {
+        double value = double( mantissa * scale ) * powersOf10[22];
+        return negative? -value: value;
+      }
+    }
+  }
+#endif
+
+  return StrToFloat64Slow( p, pEnd );
+}
+
+// Accumulates a run of decimal digits as JSONEnt::ConsumeDigits does:
+// the first 19 significant digits go into mantissa and mantissaDigits
+// keeps counting past them
+inline char const *StrToFloat64Digits(
+  char const *p,
+  char const *pEnd,
+  uint64_t &mantissa,
+  uint32_t &mantissaDigits
+  )
+{
+  for ( ; p != pEnd; ++p )
+  {
+    uint32_t digit = uint32_t( uint8_t( *p ) ) - uint32_t( '0' );
+    if ( digit > 9 )
+      break;
+    if ( mantissaDigits < 19 )
+    {
+      mantissa = mantissa * 10 + digit;
+      if ( mantissa != 0 )
+        ++mantissaDigits;
+    }
+    else ++mantissaDigits;
+  }
+  return p;
+}
+
+// The length of the longest case-insensitive prefix of [p, pEnd) that is
+// also a prefix of the lower-case word
+inline size_t StrToFloat64MatchWord(
+  char const *p,
+  char const *pEnd,
+  char const *word
+  )
+{
+  size_t length = 0;
+  for ( ; p != pEnd && word[length] != '\0'; ++p, ++length )
+    if ( ( *p | 0x20 ) != word[length] )
+      break;
+  return length;
+}
+
+// Parses a decimal floating point number at the start of [p, pEnd), as
+// strtod() does in the "C" locale but without skipping whitespace or
+// accepting hexadecimal: an optional sign, digits with an optional '.'
+// (at least one digit on either side) and an optional exponent; or
+// "inf", "infinity", "nan" or "nan(chars)" in any case.  The result is
+// correctly rounded.  Underflow to zero or a denormal is not reported.
+inline StrToNumResult StrToFloat64(
+  char const *p,
+  char const *pEnd,
+  double &value
+  )
+{
+  StrToNumResult result = { p, false };
+
+  bool negative = false;
+  char const *q = p;
+  if ( q != pEnd && ( *q == '-' || *q == '+' ) )
+  {
+    negative = *q == '-';
+    ++q;
+  }
+  if ( q == pEnd )
+    return result;
+
+  if ( ( *q | 0x20 ) == 'i' || ( *q | 0x20 ) == 'n' )
+  {
+    size_t length = StrToFloat64MatchWord( q, pEnd, "infinity" );
+    if ( length >= 3 )
+    {
+      double infinity = std::numeric_limits<double>::infinity();
+      value = negative? -infinity: infinity;
+      result.end = q + ( length == 8? 8: 3 );
+    }
+    else if ( StrToFloat64MatchWord( q, pEnd, "nan" ) == 3 )
+    {
+      double nan = std::numeric_limits<double>::quiet_NaN();
+      value = negative? -nan: nan;
+      result.end = q + 3;
+      // An optional "(chars)" suffix, which selects nothing here
+      char const *r = result.end;
+      if ( r != pEnd && *r == '(' )
+      {
+        for ( ++r; r != pEnd; ++r )
+        {
+          char lower = char( *r | 0x20 );
+          if ( !( ( *r >= '0' && *r <= '9' ) || *r == '_'
+            || ( lower >= 'a' && lower <= 'z' ) ) )
+            break;
+        }
+        if ( r != pEnd && *r == ')' )
+          result.end = r + 1;
+      }
+    }
+    return result;
+  }
+
+  uint64_t mantissa = 0;
+  uint32_t mantissaDigits = 0;
+  int32_t exponent = 0;
+
+  char const *intEnd = StrToFloat64Digits( q, pEnd, mantissa, mantissaDigits );
+  char const *numberEnd = intEnd;
+  if ( intEnd != pEnd && *intEnd == '.' )
+  {
+    char const *fracEnd =
+      StrToFloat64Digits( intEnd + 1, pEnd, mantissa, mantissaDigits );
+    size_t fracCount = size_t( fracEnd - ( intEnd + 1 ) );
+    if ( fracCount == 0 && intEnd == q )
+      return result;
+    // Past this the value is zero or the slow path's
+    exponent -= int32_t( fracCount < 99999? fracCount: 99999 );
+    numberEnd = fracEnd;
+  }
+  else if ( intEnd == q )
+    return result;
+
+  if ( numberEnd != pEnd && ( *numberEnd | 0x20 ) == 'e' )
+  {
+    char const *e = numberEnd + 1;
+    bool exponentNegative = false;
+    if ( e != pEnd && ( *e == '-' || *e == '+' ) )
+    {
+      exponentNegative = *e == '-';
+      ++e;
+    }
+    uint64_t explicitExponent;
+    bool exponentOverflow = false;
+    char const *exponentEnd =
+      StrToNumDigits( e, pEnd, explicitExponent, exponentOverflow );
+    // Without digits, the 'e' is not part of the number
+    if ( exponentEnd != e )
+    {
+      // Far outside the fast path's range either way
+      if ( explicitExponent > 99999 )
+        explicitExponent = 99999;
+      if ( exponentNegative )
+        exponent -= int32_t( explicitExponent );
+      else
+        exponent += int32_t( explicitExponent );
+      numberEnd = exponentEnd;
+    }
+  }
+
+  double v = StrToFloat64Decimal(
+    negative, mantissa, mantissaDigits, exponent, p, numberEnd
+    );
+  value = v;
+  result.end = numberEnd;
+  result.overflow = v > DBL_MAX || v < -DBL_MAX;
+  return result;
+}
+
+FTL_NAMESPACE_END
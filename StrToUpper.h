@@ -0,0 +1,23 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#pragma once
+
+#include <FTL/Config.h>
+#include <FTL/MapCharToUpper.h>
+#include <FTL/StrRemap.h>
+
+FTL_NAMESPACE_BEGIN
+
+inline void StrToUpper( std::string &str )
+{
+  StrRemap<MapCharToUpper>( str );
+}
+
+inline char *StrToUpper( StrRef str, char *out )
+{
+  return StrRemap<MapCharToUpper>( str, out );
+}
+
+FTL_NAMESPACE_END
@@ -0,0 +1,189 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#include <FTL/JSONValue.h>
+#include <FTL/StrRef.h>
+#include <FTL/Ticks.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Compares StrRef::hash against the DJB2 hash it replaced, for speed and
+// for how evenly keys spread over the buckets of a power-of-two table
+// (which uses the low bits of the hash, like MSVC's unordered_map).  Key
+// sets are synthetic, plus the object keys of any JSON files given on the
+// command line.
+//
+// hashBench [file.json ...]
+
+static size_t DJB2( FTL::StrRef str )
+{
+  size_t result = 5381;
+  for ( FTL::StrRef::IT it = str.begin(); it != str.end(); ++it )
+    result = ((result << 5) + result) + size_t(*it);
+  return result;
+}
+
+static size_t XXH64( FTL::StrRef str )
+{
+  return str.hash();
+}
+
+static void CollectKeys(
+  FTL::JSONValue const *value,
+  std::vector<std::string> &keys
+  )
+{
+  if ( FTL::JSONObject const *object = value->maybeCast<FTL::JSONObject>() )
+  {
+    for ( FTL::JSONObject::const_iterator it = object->begin();
+      it != object->end(); ++it )
+    {
+      keys.push_back( it->first );
+      CollectKeys( it->second, keys );
+    }
+  }
+  else if ( FTL::JSONArray const *array = value->maybeCast<FTL::JSONArray>() )
+  {
+    // Typed (numeric) arrays hold no keys, and are not worth boxing
+    if ( array->isTyped() )
+      return;
+    for ( FTL::JSONArray::const_iterator it = array->begin();
+      it != array->end(); ++it )
+      CollectKeys( *it, keys );
+  }
+}
+
+static void Bench(
+  char const *setName,
+  std::vector<std::string> const &keys,
+  char const *hashName,
+  size_t (*hash)( FTL::StrRef )
+  )
+{
+  size_t const count = keys.size();
+  if ( count == 0 )
+    return;
+
+  size_t bucketCount = 1;
+  while ( bucketCount < count )
+    bucketCount <<= 1;
+  std::vector<uint32_t> buckets( bucketCount, 0 );
+  for ( size_t i = 0; i < count; ++i )
+    ++buckets[hash( keys[i] ) & ( bucketCount - 1 )];
+  size_t collisions = 0;
+  uint32_t longest = 0;
+  for ( size_t i = 0; i < bucketCount; ++i )
+  {
+    if ( buckets[i] > 1 )
+      collisions += buckets[i] - 1;
+    if ( buckets[i] > longest )
+      longest = buckets[i];
+  }
+  // Keys that land in an occupied bucket, for a uniform hash
+  double const expected = double( count ) - double( bucketCount )
+    * ( 1.0 - pow( 1.0 - 1.0 / double( bucketCount ), double( count ) ) );
+
+  size_t const rounds = ( 20000000 + count - 1 ) / count;
+  size_t sink = 0;
+  uint64_t const begin = FTL::GetCurrentTicks();
+  for ( size_t round = 0; round < rounds; ++round )
+    for ( size_t i = 0; i < count; ++i )
+      sink += hash( keys[i] );
+  double const ns = FTL::GetSecondsBetweenTicks( begin, FTL::GetCurrentTicks() )
+    * 1e9 / double( rounds * count );
+
+  printf(
+    "%-16s %-6s %7.2f ns/key  collisions %8lu (uniform %8.0f)  longest %u%s\n",
+    setName, hashName, ns,
+    (unsigned long)collisions, expected, longest,
+    sink == 42? " ": ""
+    );
+}
+
+static void BenchBoth( char const *setName, std::vector<std::string> const &keys )
+{
+  Bench( setName, keys, "DJB2", &DJB2 );
+  Bench( setName, keys, "XXH64", &XXH64 );
+}
+
+int main( int argc, char **argv )
+{
+  std::vector<std::string> keys;
+  char buf[256];
+
+  for ( int i = 0; i < 100000; ++i )
+  {
+    snprintf( buf, sizeof( buf ), "key%d", i );
+    keys.push_back( buf );
+  }
+  BenchBoth( "sequential", keys );
+
+  keys.clear();
+  for ( int i = 0; i < 100000; ++i )
+  {
+    snprintf( buf, sizeof( buf ), "/usr/local/lib/pkg%03d/src/file%04d.h", i % 97, i );
+    keys.push_back( buf );
+  }
+  BenchBoth( "paths", keys );
+
+  keys.clear();
+  for ( int i = 0; i < 20000; ++i )
+  {
+    snprintf(
+      buf, sizeof( buf ),
+      "https://example.com/api/v2/projects/%d/assets/geometry/meshes/%d/attributes?format=json",
+      i % 113, i
+      );
+    keys.push_back( buf );
+  }
+  BenchBoth( "long", keys );
+
+  // Two-character blocks with equal DJB2 hashes ("Ez" and "FY"), so every
+  // combination collides under DJB2
+  keys.clear();
+  for ( int i = 0; i < 1 << 14; ++i )
+  {
+    std::string key;
+    for ( int bit = 0; bit < 14; ++bit )
+      key += ( i >> bit ) & 1? "Ez": "FY";
+    keys.push_back( key );
+  }
+  BenchBoth( "djb2-flood", keys );
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    FILE *fp = fopen( argv[i], "rb" );
+    if ( !fp )
+    {
+      perror( argv[i] );
+      continue;
+    }
+    std::string json;
+    size_t read;
+    while ( ( read = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+      json.append( buf, read );
+    fclose( fp );
+
+    keys.clear();
+    try
+    {
+      FTL::JSONStrWithLoc ds( json );
+      while ( FTL::JSONValue *value = FTL::JSONValue::Decode( ds ) )
+      {
+        CollectKeys( value, keys );
+        delete value;
+      }
+    }
+    catch ( FTL::JSONException e )
+    {
+      printf( "%s: %s\n", argv[i], std::string( e.getDesc() ).c_str() );
+    }
+    BenchBoth( argv[i], keys );
+  }
+
+  return 0;
+}
@@ -2,11 +2,228 @@
  *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
  */
 
+#include <FTL/CBORValue.h>
+#include <FTL/JSONEncSink.h>
+#include <FTL/JSONParallelEnc.h>
+#include <FTL/JSONReformat.h>
 #include <FTL/JSONValue.h>
 
 #include <iostream>
+#include <stdlib.h>
 #include <string>
 
+// Self-described CBOR input (see CBORIsSelfDescribed) is dumped as JSON.
+// With FTL_CATJSON_CBOR set, each value is converted to CBOR and back
+// before it is printed, which must not change the output.  With
+// FTL_CATJSON_INLINE_NUMBER_ARRAYS set, numeric arrays are printed on one
+// line.  With FTL_CATJSON_INDENT set to a number, values are printed
+// indented by that many spaces, assigned as the indentStr of a copy of
+// the pretty format.  With FTL_CATJSON_FLOAT64_PRECISION set to a number,
+// floating point numbers are printed with that many significant digits
+// (see JSONFormat::withFloat64Precision).
+// With FTL_CATJSON_REFORMAT set, JSON input is reformatted token
+// by token (see JSONReformatter) instead of being decoded to JSONValues.
+// With FTL_CATJSON_CANONICAL set, values are printed in canonical form,
+// each followed by its canonicalHash.
+// With FTL_CATJSON_PARALLEL set, each value is also encoded with
+// JSONParallelEnc, cut into the smallest chunks, in both the printed and
+// the packed format; any output that differs from serial encoding is
+// reported.  Every value is also measured with JSONEncodedSize and
+// encoded with JSONEncodeExact, in the printed, packed and inline
+// formats; any size or output that differs from encode() is reported.
+// Every value is also copied through the const generic accessors (get(),
+// operator[], begin() and end()), including typed arrays, and any copy
+// that encodes differently is reported.
+// With FTL_CATJSON_SINKS set, each value is also encoded
+// through each of the JSONEncSink sinks, with small blocks and a buffer
+// too small to hold it; any output that differs from encode() is
+// reported.
+
+static void checkParallelEnc(
+  FTL::JSONValue const *jsonValue,
+  FTL::JSONFormat const &format,
+  char const *formatName
+  )
+{
+  // Use a temporary format to catch a dangling reference to it
+  FTL::JSONParallelEnc parallelEnc(
+    jsonValue, FTL::JSONFormat( format ), 4, 1
+    );
+  std::string const expected = jsonValue->encode( format );
+  if ( parallelEnc.encode() != expected )
+    std::cout << "Parallel encoding differs (" << formatName << ")\n";
+  if ( parallelEnc.size() != expected.size() )
+    std::cout << "Parallel encoding size differs (" << formatName << ")\n";
+}
+
+static void checkExact(
+  FTL::JSONValue const *jsonValue,
+  FTL::JSONFormat const &format,
+  char const *formatName
+  )
+{
+  std::string const expected = jsonValue->encode( format );
+  FTL::JSONValueEncoder const encoder( jsonValue );
+  if ( FTL::JSONEncodedSize( encoder, format ) != expected.size() )
+    std::cout << "JSONEncodedSize differs (" << formatName << ")\n";
+  std::string const exact = FTL::JSONEncodeExact( encoder, format );
+  if ( exact.size() != expected.size() )
+    std::cout << "JSONEncodeExact size differs (" << formatName << ")\n";
+  if ( exact != expected )
+    std::cout << "JSONEncodeExact output differs (" << formatName << ")\n";
+}
+
+// A copy of jsonValue with only generic arrays, made through the const
+// generic accessors
+static FTL::JSONValue *copyGeneric( FTL::JSONValue const *jsonValue )
+{
+  switch ( jsonValue->getType() )
+  {
+    case FTL::JSONValue::Type_Null:
+      return new FTL::JSONNull;
+    case FTL::JSONValue::Type_Boolean:
+      return new FTL::JSONBoolean( jsonValue->getBooleanValue() );
+    case FTL::JSONValue::Type_SInt32:
+      return new FTL::JSONSInt32( jsonValue->getSInt32Value() );
+    case FTL::JSONValue::Type_Float64:
+      return new FTL::JSONFloat64( jsonValue->getFloat64Value() );
+    case FTL::JSONValue::Type_String:
+      return new FTL::JSONString( jsonValue->getStringValue() );
+    case FTL::JSONValue::Type_Array:
+    {
+      FTL::JSONArray const *jsonArray = jsonValue->cast<FTL::JSONArray>();
+      FTL::OwnedPtr<FTL::JSONArray> result( new FTL::JSONArray );
+      size_t index = 0;
+      for ( FTL::JSONArray::const_iterator it = jsonArray->begin();
+        it != jsonArray->end(); ++it, ++index )
+      {
+        if ( jsonArray->get( index ) != *it || (*jsonArray)[index] != *it )
+          std::cout << "Generic array access differs\n";
+        result->push_back( copyGeneric( *it ) );
+      }
+      if ( index != jsonArray->size() )
+        std::cout << "Generic array iteration size differs\n";
+      return result.take();
+    }
+    case FTL::JSONValue::Type_Object:
+    {
+      FTL::JSONObject const *jsonObject = jsonValue->cast<FTL::JSONObject>();
+      FTL::OwnedPtr<FTL::JSONObject> result( new FTL::JSONObject );
+      for ( FTL::JSONObject::const_iterator it = jsonObject->begin();
+        it != jsonObject->end(); ++it )
+        result->insert( it->first, copyGeneric( it->second ) );
+      return result.take();
+    }
+    default:
+      assert( false );
+      return 0;
+  }
+}
+
+static void checkGeneric( FTL::JSONValue const *jsonValue )
+{
+  FTL::OwnedPtr<FTL::JSONValue> const copy( copyGeneric( jsonValue ) );
+  if ( copy->encode() != jsonValue->encode() )
+    std::cout << "Generic copy differs\n";
+}
+
+static bool appendToString( void *userdata, char const *data, size_t size )
+{
+  static_cast<std::string *>( userdata )->append( data, size );
+  return true;
+}
+
+static std::string readBack( FILE *fp )
+{
+  std::string result;
+  rewind( fp );
+  char buf[4096];
+  size_t read;
+  while ( ( read = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+    result.append( buf, read );
+  return result;
+}
+
+template<typename SinkTy>
+static void encodeToSink(
+  FTL::JSONValue const *jsonValue,
+  FTL::JSONFormat const &format,
+  SinkTy &sink
+  )
+{
+  FTL::JSONEnc<SinkTy> enc( sink, format );
+  jsonValue->encodeTo( enc );
+}
+
+static void checkSinks(
+  FTL::JSONValue const *jsonValue,
+  FTL::JSONFormat const &format
+  )
+{
+  std::string const expected = jsonValue->encode( format );
+
+  // Block sizes of 0 (taken as 1) and 7 exercise flushing mid-string
+  for ( size_t blockSize = 0; blockSize <= 7; blockSize += 7 )
+  {
+    std::string output;
+    {
+      FTL::JSONEncCallbackSink sink( &appendToString, &output, blockSize );
+      encodeToSink( jsonValue, format, sink );
+      if ( sink.size() != expected.size() )
+        std::cout << "JSONEncCallbackSink size differs\n";
+      if ( !sink.flush() )
+        std::cout << "JSONEncCallbackSink failed\n";
+    }
+    if ( output != expected )
+      std::cout << "JSONEncCallbackSink output differs\n";
+  }
+
+  if ( FILE *fp = tmpfile() )
+  {
+    {
+      FTL::JSONEncFDSink sink( fileno( fp ), 7 );
+      encodeToSink( jsonValue, format, sink );
+      if ( !sink.flush() )
+        std::cout << "JSONEncFDSink failed\n";
+    }
+    if ( readBack( fp ) != expected )
+      std::cout << "JSONEncFDSink output differs\n";
+    fclose( fp );
+  }
+
+  if ( FILE *fp = tmpfile() )
+  {
+    {
+      FTL::JSONEncFILESink sink( fp, 7 );
+      encodeToSink( jsonValue, format, sink );
+      if ( !sink.flush() )
+        std::cout << "JSONEncFILESink failed\n";
+    }
+    if ( readBack( fp ) != expected )
+      std::cout << "JSONEncFILESink output differs\n";
+    fclose( fp );
+  }
+
+  // One buffer that fits exactly and one that overflows half way
+  std::vector<char> buffer( expected.size() + 1 );
+  for ( size_t capacity = expected.size(); ; capacity /= 2 )
+  {
+    FTL::JSONEncBufferSink sink( &buffer[0], capacity );
+    encodeToSink( jsonValue, format, sink );
+    if ( sink.size() != expected.size()
+      || sink.overflowed() != ( capacity < expected.size() )
+      || sink.str() != FTL::StrRef( expected ).substr( 0, capacity ) )
+      std::cout << "JSONEncBufferSink output differs\n";
+    if ( capacity < expected.size() )
+      break;
+  }
+
+  FTL::JSONEncCountSink countSink;
+  encodeToSink( jsonValue, format, countSink );
+  if ( countSink.size() != expected.size() )
+    std::cout << "JSONEncCountSink size differs\n";
+}
+
 void catJSON( FILE *fp )
 {
   static const size_t MaxRead = 16*1024;
@@ -29,19 +246,77 @@ void catJSON( FILE *fp )
     jsonInput.resize( oldSize + read );
   }
 
-  FTL::JSONStrWithLoc strWithLoc(
-    FTL::StrRef( jsonInput.empty()? 0: &jsonInput[0], jsonInput.size() )
+  FTL::StrRef input(
+    jsonInput.empty()? 0: &jsonInput[0], jsonInput.size()
+    );
+  bool const isCBOR = FTL::CBORIsSelfDescribed( input );
+  bool const viaCBOR = !!::getenv( "FTL_CATJSON_CBOR" );
+  FTL::JSONFormat format = FTL::JSONFormat::Pretty().withInlineNumberArrays(
+    !!::getenv( "FTL_CATJSON_INLINE_NUMBER_ARRAYS" )
     );
+  char const *indentEnv = ::getenv( "FTL_CATJSON_INDENT" );
+  std::string const indentStr( indentEnv? atoi( indentEnv ): 0, ' ' );
+  if ( indentEnv )
+    format.indentStr = indentStr;
+  if ( char const *precisionEnv = ::getenv( "FTL_CATJSON_FLOAT64_PRECISION" ) )
+    format = format.withFloat64Precision( atoi( precisionEnv ) );
+  bool const reformat = !isCBOR && !!::getenv( "FTL_CATJSON_REFORMAT" );
+  bool const parallel = !!::getenv( "FTL_CATJSON_PARALLEL" );
+  bool const sinks = !!::getenv( "FTL_CATJSON_SINKS" );
+  bool const canonical = !!::getenv( "FTL_CATJSON_CANONICAL" );
+  FTL::JSONStrWithLoc strWithLoc( input );
+  FTL::CBORStrWithLoc cborStrWithLoc( input );
+  FTL::JSONReformatter reformatter( strWithLoc );
   for (;;)
   {
     try
     {
+      if ( reformat )
+      {
+        std::string output;
+        FTL::JSONEnc<> enc(
+          output, canonical? FTL::JSONFormat::Canonical(): format
+          );
+        if ( !reformatter.reformatNext( enc ) )
+          break;
+        std::cout << output << '\n';
+        continue;
+      }
+
       FTL::OwnedPtr<FTL::JSONValue> jsonValue(
-        FTL::JSONValue::Decode( strWithLoc )
+        isCBOR?
+          FTL::CBORDecodeValue( cborStrWithLoc ):
+          FTL::JSONValue::Decode( strWithLoc )
         );
       if ( !jsonValue )
         break;
-      std::cout << jsonValue->encode() << '\n';
+      if ( viaCBOR )
+        jsonValue = FTL::CBORDecodeValue(
+          FTL::CBOREncodeValue( jsonValue.get(), true )
+          );
+      checkGeneric( jsonValue.get() );
+      checkExact( jsonValue.get(), FTL::JSONFormat::Pretty(), "Pretty" );
+      checkExact( jsonValue.get(), FTL::JSONFormat::Packed(), "Packed" );
+      checkExact(
+        jsonValue.get(),
+        FTL::JSONFormat::Pretty().withInlineNumberArrays(),
+        "Inline"
+        );
+      if ( parallel )
+      {
+        checkParallelEnc( jsonValue.get(), format, "Pretty" );
+        checkParallelEnc( jsonValue.get(), FTL::JSONFormat::Packed(), "Packed" );
+      }
+      if ( sinks )
+        checkSinks( jsonValue.get(), format );
+      if ( canonical )
+      {
+        std::string const output =
+          jsonValue->encode( FTL::JSONFormat::Canonical() );
+        std::cout << output << ' ' << jsonValue->canonicalHash() << '\n';
+        continue;
+      }
+      std::cout << jsonValue->encode( format ) << '\n';
     }
     catch ( FTL::JSONException e )
     {
@@ -49,6 +324,10 @@ void catJSON( FILE *fp )
         << "Caught exception: "
         << e.getDesc()
         << "\n";
+      // Binary input cannot be resynchronized after an error, nor can
+      // the reformatter once it has stopped part way through a value
+      if ( isCBOR || reformat )
+        break;
     }
   }
 }
@@ -0,0 +1,1249 @@
+/*
+ *  Copyright (c) 2010-2016, Fabric Software Inc. All rights reserved.
+ */
+
+#include <FTL/MapChar.h>
+#include <FTL/MatchCharAlways.h>
+#include <FTL/MatchCharAny.h>
+#include <FTL/MatchCharNever.h>
+#include <FTL/MatchCharRange.h>
+#include <FTL/MatchCharSingle.h>
+#include <FTL/MatchCharTable.h>
+#include <FTL/MatchCharWhitespace.h>
+#include <FTL/MatchPrefix.h>
+#include <FTL/MatchPrefixDFA.h>
+#include <FTL/StrCount.h>
+#include <FTL/StrFilter.h>
+#include <FTL/StrMultiFind.h>
+#include <FTL/StrPipe.h>
+#include <FTL/StrRef.h>
+#include <FTL/StrRemap.h>
+#include <FTL/StrSplit.h>
+#include <FTL/StrToNum.h>
+#include <FTL/StrTrim.h>
+
+#include <algorithm>
+#include <ctype.h>
+#include <errno.h>
+#include <float.h>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Randomized checks of the string searches, splits, transforms and
+// conversions against straightforward reference implementations.  Inputs
+// are drawn from small alphabets, so that matches are frequent, that
+// include characters from 0x80, and are tried at the lengths around the
+// 16-character blocks of the SSE2 paths and at every alignment.  Each
+// input is the end of its own heap block, so that a build with
+// AddressSanitizer catches reads past it.  Failures are printed and make
+// the exit status non-zero.  An optional argument sets the number of
+// random rounds.
+
+static uint32_t const MaxReportedFailures = 20;
+static uint32_t failureCount = 0;
+
+// xorshift64*, so that runs are reproducible on every platform
+class Random
+{
+public:
+
+  Random( uint64_t seed )
+    : m_state( seed ) {}
+
+  uint32_t next()
+  {
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return uint32_t( ( m_state * UINT64_C(2685821657736338717) ) >> 32 );
+  }
+
+  // Uniform in [0, n)
+  uint32_t below( uint32_t n )
+    { return next() % n; }
+
+private:
+
+  uint64_t m_state;
+};
+
+static std::string RandomStr(
+  Random &random,
+  size_t size,
+  FTL::StrRef alphabet
+  )
+{
+  std::string result( size, '\0' );
+  for ( size_t i = 0; i < size; ++i )
+    result[i] = alphabet[random.below( uint32_t( alphabet.size() ) )];
+  return result;
+}
+
+// The lengths that every check is tried at, besides random ones
+static size_t const BoundaryLengths[] =
+  { 0, 1, 2, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 100 };
+static size_t const BoundaryLengthCount =
+  sizeof( BoundaryLengths ) / sizeof( BoundaryLengths[0] );
+
+static size_t RoundLength( Random &random, uint32_t round )
+{
+  if ( round < BoundaryLengthCount )
+    return BoundaryLengths[round];
+  return random.below( 3 ) == 0? random.below( 300 ): random.below( 70 );
+}
+
+// A copy of a string that ends where its heap block does, starting at
+// offset bytes into the block
+class PlacedStr
+{
+  PlacedStr( PlacedStr const & );
+  PlacedStr &operator=( PlacedStr const & );
+
+public:
+
+  PlacedStr( FTL::StrRef str, size_t offset )
+    : m_block( new char[offset + str.size() + ( str.empty()? 1: 0 )] )
+  {
+    memcpy( m_block + offset, str.data(), str.size() );
+    m_str = FTL::StrRef( m_block + offset, str.size() );
+  }
+
+  ~PlacedStr()
+    { delete [] m_block; }
+
+  FTL::StrRef str() const
+    { return m_str; }
+
+  char *data()
+    { return m_block + ( m_str.data() - m_block ); }
+
+private:
+
+  char *m_block;
+  FTL::StrRef m_str;
+};
+
+static std::string Quote( FTL::StrRef str )
+{
+  std::string result( 1, '"' );
+  for ( size_t i = 0; i < str.size(); ++i )
+  {
+    uint8_t const ch = uint8_t( str[i] );
+    if ( ch < 0x20 || ch >= 0x7F || ch == '"' || ch == '\\' )
+    {
+      char buf[8];
+      sprintf( buf, "\\x%02X", ch );
+      result += buf;
+    }
+    else
+      result += char( ch );
+  }
+  result += '"';
+  return result;
+}
+
+static void Check(
+  bool ok,
+  char const *what,
+  FTL::StrRef input,
+  FTL::StrRef arg
+  )
+{
+  if ( ok )
+    return;
+  if ( ++failureCount <= MaxReportedFailures )
+    std::cout << "FAIL " << what << '(' << Quote( arg ) << ") on "
+      << Quote( input ) << '\n';
+}
+
+// StrRef find, rfind, count and contains (StrScan)
+
+static FTL::StrRef const FindAlphabet( "ab,\x80\xff", 5 );
+
+static void CheckFindChar( FTL::StrRef str, char ch )
+{
+  FTL::StrRef const arg( &ch, 1 );
+  FTL::StrRef::IT const found = std::find( str.begin(), str.end(), ch );
+  Check( str.find( ch ) == found, "find", str, arg );
+  Check( str.contains( ch ) == ( found != str.end() ), "contains", str, arg );
+  Check(
+    size_t( str.count( ch ) )
+      == size_t( std::count( str.begin(), str.end(), ch ) ),
+    "count", str, arg
+    );
+  Check(
+    str.rfind( ch ) == std::find( str.rbegin(), str.rend(), ch ),
+    "rfind", str, arg
+    );
+}
+
+static void CheckFindStr( FTL::StrRef str, FTL::StrRef needle )
+{
+  FTL::StrRef::IT const found =
+    std::search( str.begin(), str.end(), needle.begin(), needle.end() );
+  Check( str.find( needle ) == found, "find", str, needle );
+  Check(
+    str.contains( needle ) == ( found != str.end() || needle.empty() ),
+    "contains", str, needle
+    );
+}
+
+static void TestFind( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), FindAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    for ( size_t i = 0; i < FindAlphabet.size(); ++i )
+      CheckFindChar( str, FindAlphabet[i] );
+    CheckFindChar( str, 'z' );
+
+    // Needles cut from the input, so that they are found, and random
+    // ones, including ones longer than the input
+    for ( uint32_t i = 0; i < 4; ++i )
+    {
+      size_t const begin = random.below( uint32_t( str.size() + 1 ) );
+      size_t const maxSize = (std::min)( str.size() - begin, size_t( 20 ) );
+      size_t const size = random.below( uint32_t( maxSize + 1 ) );
+      CheckFindStr( str, FTL::StrRef( str.data() + begin, size ) );
+      std::string const needle =
+        RandomStr( random, 1 + random.below( 4 ), FindAlphabet );
+      CheckFindStr( str, PlacedStr( needle, 0 ).str() );
+    }
+    CheckFindStr( str, input + "a" );
+  }
+}
+
+// MatchChar classes, classified in bulk (StrScanSIMD) and by bitmap
+// (MatchCharTable); each is checked against a plain predicate
+
+static FTL::StrRef const MatchAlphabet( "a09 \t\r,\x80\x90\xE9\xFF", 11 );
+
+typedef FTL::MatchCharSingle<'a'> MatchA;
+typedef FTL::MatchCharSingle<'\xE9'> MatchE9;
+typedef FTL::MatchCharRange<'0', '9'> MatchDigit;
+// Two intervals of unsigned characters when char is signed
+typedef FTL::MatchCharRange<'\x90', '\x10'> MatchWrapped;
+typedef FTL::MatchCharAny<
+  FTL::MatchCharSingle<','>,
+  MatchDigit,
+  FTL::MatchCharSingle<'\xFF'>
+  > MatchAny3;
+// Enough alternatives to take the bitmap rather than comparisons
+typedef FTL::MatchCharAny<
+  FTL::MatchCharWhitespace,
+  MatchA,
+  FTL::MatchCharRange<'\x80', '\x90'>,
+  FTL::MatchCharSingle<','>,
+  MatchE9
+  > MatchAny5;
+
+// Has no bitmap or SIMD form, so it is tested one character at a time
+struct MatchHighBit
+{
+  bool operator()( char ch ) const
+    { return ( uint8_t( ch ) & 0x80 ) != 0; }
+};
+
+struct RefA
+  { bool operator()( uint8_t ch ) const { return ch == 'a'; } };
+struct RefE9
+  { bool operator()( uint8_t ch ) const { return ch == 0xE9; } };
+struct RefDigit
+  { bool operator()( uint8_t ch ) const { return ch >= '0' && ch <= '9'; } };
+struct RefWrapped
+{
+  bool operator()( uint8_t ch ) const
+    { return char( ch ) >= char( 0x90 ) && char( ch ) <= char( 0x10 ); }
+};
+struct RefWhitespace
+{
+  bool operator()( uint8_t ch ) const
+    { return ch == ' ' || ( ch >= '\t' && ch <= '\r' ); }
+};
+struct RefAny3
+{
+  bool operator()( uint8_t ch ) const
+    { return ch == ',' || RefDigit()( ch ) || ch == 0xFF; }
+};
+struct RefAny5
+{
+  bool operator()( uint8_t ch ) const
+  {
+    return RefWhitespace()( ch ) || ch == 'a' || ( ch >= 0x80 && ch <= 0x90 )
+      || ch == ',' || ch == 0xE9;
+  }
+};
+struct RefComma
+  { bool operator()( uint8_t ch ) const { return ch == ','; } };
+struct RefFF
+  { bool operator()( uint8_t ch ) const { return ch == 0xFF; } };
+struct RefHighBit
+  { bool operator()( uint8_t ch ) const { return ch >= 0x80; } };
+struct RefAlways
+  { bool operator()( uint8_t ) const { return true; } };
+struct RefNever
+  { bool operator()( uint8_t ) const { return false; } };
+
+template<typename MatchChar, typename Ref>
+static void CheckMatchCharTable( char const *name )
+{
+  if ( !FTL::MatchCharBits<MatchChar>::Enabled )
+    return;
+  Ref const ref;
+  for ( uint32_t c = 0; c < 256; ++c )
+  {
+    char const ch = char( c );
+    Check(
+      FTL::MatchCharTable<MatchChar>::Match( ch ) == ref( uint8_t( c ) ),
+      "MatchCharTable", FTL::StrRef( &ch, 1 ), name
+      );
+  }
+}
+
+template<typename MatchChar, typename Ref>
+static void CheckMatchChar( FTL::StrRef str, char const *name )
+{
+  Ref const ref;
+  FTL::StrRef::IT first = str.end();
+  FTL::StrRef::RIT last = str.rend();
+  size_t count = 0;
+  for ( FTL::StrRef::IT it = str.begin(); it != str.end(); ++it )
+  {
+    if ( !ref( uint8_t( *it ) ) )
+      continue;
+    if ( count++ == 0 )
+      first = it;
+    last = FTL::StrRef::RIT( it + 1 );
+  }
+  Check( str.find<MatchChar>() == first, "find", str, name );
+  Check( str.rfind<MatchChar>() == last, "rfind", str, name );
+  Check( str.count<MatchChar>() == count, "count", str, name );
+  Check( str.contains<MatchChar>() == ( count > 0 ), "contains", str, name );
+}
+
+static void TestMatchChar( Random &random, uint32_t rounds )
+{
+  CheckMatchCharTable<MatchA, RefA>( "MatchA" );
+  CheckMatchCharTable<MatchE9, RefE9>( "MatchE9" );
+  CheckMatchCharTable<MatchDigit, RefDigit>( "MatchDigit" );
+  CheckMatchCharTable<MatchWrapped, RefWrapped>( "MatchWrapped" );
+  CheckMatchCharTable<FTL::MatchCharWhitespace, RefWhitespace>(
+    "MatchCharWhitespace"
+    );
+  CheckMatchCharTable<MatchAny3, RefAny3>( "MatchAny3" );
+  CheckMatchCharTable<MatchAny5, RefAny5>( "MatchAny5" );
+  CheckMatchCharTable<FTL::MatchCharAlways, RefAlways>( "MatchCharAlways" );
+  CheckMatchCharTable<FTL::MatchCharNever, RefNever>( "MatchCharNever" );
+
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), MatchAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    CheckMatchChar<MatchA, RefA>( str, "MatchA" );
+    CheckMatchChar<MatchE9, RefE9>( str, "MatchE9" );
+    CheckMatchChar<MatchDigit, RefDigit>( str, "MatchDigit" );
+    CheckMatchChar<MatchWrapped, RefWrapped>( str, "MatchWrapped" );
+    CheckMatchChar<FTL::MatchCharWhitespace, RefWhitespace>(
+      str, "MatchCharWhitespace"
+      );
+    CheckMatchChar<MatchAny3, RefAny3>( str, "MatchAny3" );
+    CheckMatchChar<MatchAny5, RefAny5>( str, "MatchAny5" );
+    CheckMatchChar<MatchHighBit, RefHighBit>( str, "MatchHighBit" );
+    CheckMatchChar<FTL::MatchCharAlways, RefAlways>( str, "MatchCharAlways" );
+    CheckMatchChar<FTL::MatchCharNever, RefNever>( str, "MatchCharNever" );
+  }
+}
+
+// StrSplit and StrSplitRange, strict and not, against a plain split
+
+template<typename Ref>
+static std::vector<std::string> RefSplit( FTL::StrRef str, bool strict )
+{
+  Ref const ref;
+  std::vector<std::string> result;
+  std::string piece;
+  for ( size_t i = 0; i < str.size(); ++i )
+  {
+    if ( !ref( uint8_t( str[i] ) ) )
+      piece += str[i];
+    else
+    {
+      if ( strict || !piece.empty() )
+        result.push_back( piece );
+      piece.clear();
+    }
+  }
+  if ( strict || !piece.empty() )
+    result.push_back( piece );
+  return result;
+}
+
+template<typename MatchChar, typename Ref>
+static void CheckSplit( FTL::StrRef str, bool strict, char const *name )
+{
+  std::vector<std::string> const expected = RefSplit<Ref>( str, strict );
+
+  std::vector<std::string> strs;
+  FTL::StrSplit<MatchChar>( str, strs, strict );
+  Check( strs == expected, "StrSplit", str, name );
+
+  std::vector<FTL::StrRef> strRefs;
+  FTL::StrSplit<MatchChar>( str, strRefs, strict );
+  Check(
+    std::vector<std::string>( strRefs.begin(), strRefs.end() ) == expected,
+    "StrSplit to StrRefs", str, name
+    );
+
+  // Pre- and post-increment, and the pieces must point into str
+  typedef FTL::StrSplitRange<MatchChar> Range;
+  Range const range( str, strict );
+  std::vector<std::string> pieces;
+  bool inside = true;
+  for ( typename Range::const_iterator it = range.begin();
+    it != range.end(); ++it )
+  {
+    pieces.push_back( *it );
+    inside = inside && it->begin() >= str.begin() && it->end() <= str.end();
+  }
+  Check( pieces == expected, "StrSplitRange", str, name );
+  Check( inside, "StrSplitRange pieces", str, name );
+
+  size_t count = 0;
+  for ( typename Range::const_iterator it = range.begin();
+    it != range.end(); it++ )
+    ++count;
+  Check( count == expected.size(), "StrSplitRange it++", str, name );
+}
+
+static void TestSplit( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), FindAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    for ( uint32_t strict = 0; strict < 2; ++strict )
+    {
+      CheckSplit< FTL::MatchCharSingle<','>, RefComma >(
+        str, !!strict, "','"
+        );
+      CheckSplit< FTL::MatchCharSingle<'\xFF'>, RefFF >(
+        str, !!strict, "'\\xFF'"
+        );
+      CheckSplit<MatchAny3, RefAny3>( str, !!strict, "MatchAny3" );
+      CheckSplit<MatchHighBit, RefHighBit>( str, !!strict, "MatchHighBit" );
+    }
+  }
+}
+
+// StrCount, StrFilter and StrFilterInPlace against a per-char loop
+
+template<typename MatchChar, typename Ref>
+static void CheckCountFilter( FTL::StrRef str, char const *name )
+{
+  Ref const ref;
+  size_t count = 0;
+  std::string filtered;
+  for ( size_t i = 0; i < str.size(); ++i )
+  {
+    if ( ref( uint8_t( str[i] ) ) )
+      ++count;
+    else
+      filtered += str[i];
+  }
+
+  Check( FTL::StrCount<MatchChar>( str ) == count, "StrCount", str, name );
+  Check(
+    FTL::StrFilter<MatchChar>( str ) == filtered, "StrFilter", str, name
+    );
+
+  std::string inPlace( str.data(), str.size() );
+  FTL::StrFilterInPlace<MatchChar>( inPlace );
+  Check( inPlace == filtered, "StrFilterInPlace", str, name );
+}
+
+static void TestCountFilter( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), MatchAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    CheckCountFilter<MatchA, RefA>( str, "MatchA" );
+    CheckCountFilter<MatchE9, RefE9>( str, "MatchE9" );
+    CheckCountFilter<MatchDigit, RefDigit>( str, "MatchDigit" );
+    CheckCountFilter<MatchWrapped, RefWrapped>( str, "MatchWrapped" );
+    CheckCountFilter<FTL::MatchCharWhitespace, RefWhitespace>(
+      str, "MatchCharWhitespace"
+      );
+    CheckCountFilter<MatchAny5, RefAny5>( str, "MatchAny5" );
+    CheckCountFilter<MatchHighBit, RefHighBit>( str, "MatchHighBit" );
+    CheckCountFilter<FTL::MatchCharAlways, RefAlways>(
+      str, "MatchCharAlways"
+      );
+    CheckCountFilter<FTL::MatchCharNever, RefNever>( str, "MatchCharNever" );
+  }
+}
+
+// StrRemap, out of place and in place, against the MapChar applied per
+// char.  Every eighth length is around StrRemapImpl::TableMinSize.
+
+static FTL::StrRef const RemapAlphabet( "aAmMzZ@[`{,0\x80\xC0\xE9\xFF", 16 );
+
+typedef FTL::MapCharSingle<'\xE9', 'E'> MapE9;
+typedef FTL::MapCharSingle<',', '\xFF'> MapComma;
+
+// Has no MapCharShift, so is tabulated for long strings
+struct MapFlipHighBit
+{
+  MapFlipHighBit() {}
+  char operator()( char ch ) const
+    { return char( ch ^ 0x80 ); }
+};
+
+template<typename FnMap>
+static void CheckRemap( FTL::StrRef str, size_t offset, char const *name )
+{
+  FnMap const mf;
+  std::string expected( str.data(), str.size() );
+  for ( size_t i = 0; i < expected.size(); ++i )
+    expected[i] = mf( expected[i] );
+
+  PlacedStr out( str, offset );
+  char *const outEnd = FTL::StrRemap<FnMap>( str, out.data() );
+  Check(
+    outEnd == out.data() + str.size() && out.str() == expected,
+    "StrRemap", str, name
+    );
+
+  PlacedStr inPlace( str, offset );
+  FTL::StrRemap<FnMap>( inPlace.str(), inPlace.data() );
+  Check( inPlace.str() == expected, "StrRemap in place", str, name );
+
+  std::string copy( str.data(), str.size() );
+  FTL::StrRemap<FnMap>( copy );
+  Check( copy == expected, "StrRemap std::string", str, name );
+}
+
+static void TestRemap( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    size_t const size = round % 8 == 7?
+      FTL::StrRemapImpl<MapFlipHighBit>::TableMinSize - 16
+        + random.below( 40 ):
+      RoundLength( random, round );
+    std::string const input = RandomStr( random, size, RemapAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+    size_t const offset = random.below( 16 );
+
+    CheckRemap<FTL::MapCharToLower>( str, offset, "MapCharToLower" );
+    CheckRemap<FTL::MapCharToUpper>( str, offset, "MapCharToUpper" );
+    CheckRemap<MapE9>( str, offset, "MapE9" );
+    CheckRemap<MapComma>( str, offset, "MapComma" );
+    CheckRemap<MapFlipHighBit>( str, offset, "MapFlipHighBit" );
+  }
+}
+
+// StrPipe against StrTrim, StrFilterInPlace, StrRemap and StrSplit one
+// after another, for pipelines that run 16 characters at a time and one
+// that does not
+
+static FTL::StrRef const PipeAlphabet( " \t_,;aAzZ\x80\xFF", 11 );
+
+typedef FTL::StrPipe<
+  FTL::StrPipeTrim<FTL::MatchCharWhitespace>,
+  FTL::StrPipeFilter< FTL::MatchCharSingle<'_'> >,
+  FTL::StrPipeRemap<FTL::MapCharToLower>
+  > PipeNormalize;
+
+static std::string RefNormalize( FTL::StrRef str )
+{
+  std::string result( str.data(), str.size() );
+  FTL::StrTrim<FTL::MatchCharWhitespace>( result );
+  FTL::StrFilterInPlace< FTL::MatchCharSingle<'_'> >( result );
+  FTL::StrRemap<FTL::MapCharToLower>( result );
+  return result;
+}
+
+// The filter sees the remapped characters, and the last remap makes
+// delimiters
+typedef FTL::StrPipe<
+  FTL::StrPipeRemap<FTL::MapCharToUpper>,
+  FTL::StrPipeFilter< FTL::MatchCharSingle<'A'> >,
+  FTL::StrPipeRemap< FTL::MapCharSingle<'Z', ','> >
+  > PipeUpper;
+
+static std::string RefUpper( FTL::StrRef str )
+{
+  std::string result( str.data(), str.size() );
+  FTL::StrRemap<FTL::MapCharToUpper>( result );
+  FTL::StrFilterInPlace< FTL::MatchCharSingle<'A'> >( result );
+  FTL::StrRemap< FTL::MapCharSingle<'Z', ','> >( result );
+  return result;
+}
+
+// Has no MapCharShift
+struct MapSwapSeparators
+{
+  MapSwapSeparators() {}
+  char operator()( char ch ) const
+    { return ch == ','? ';': ch == ';'? ',': ch; }
+};
+
+// Neither MapSwapSeparators nor MatchHighBit has an SSE2 form
+typedef FTL::StrPipe<
+  FTL::StrPipeTrim< FTL::MatchCharSingle<'\xFF'> >,
+  FTL::StrPipeRemap<MapSwapSeparators>,
+  FTL::StrPipeFilter<MatchHighBit>
+  > PipeScalar;
+
+static std::string RefScalar( FTL::StrRef str )
+{
+  std::string result( str.data(), str.size() );
+  FTL::StrTrim< FTL::MatchCharSingle<'\xFF'> >( result );
+  FTL::StrRemap<MapSwapSeparators>( result );
+  FTL::StrFilterInPlace<MatchHighBit>( result );
+  return result;
+}
+
+template<typename Pipe>
+static void CheckPipe(
+  FTL::StrRef str,
+  std::string const &expected,
+  size_t offset,
+  char const *name
+  )
+{
+  std::string appended( "prefix" );
+  Pipe::AppendTo( str, appended );
+  Check( appended == "prefix" + expected, "StrPipe::AppendTo", str, name );
+
+  PlacedStr out( str, offset );
+  char *outEnd = Pipe::Write( str, out.data() );
+  Check(
+    std::string( out.data(), outEnd ) == expected,
+    "StrPipe::Write", str, name
+    );
+
+  PlacedStr inPlace( str, offset );
+  outEnd = Pipe::Write( inPlace.str(), inPlace.data() );
+  Check(
+    std::string( inPlace.data(), outEnd ) == expected,
+    "StrPipe::Write in place", str, name
+    );
+
+  for ( uint32_t strict = 0; strict < 2; ++strict )
+  {
+    std::vector<std::string> const pieces =
+      RefSplit<RefComma>( expected, !!strict );
+
+    std::vector<std::string> strs;
+    Pipe::template Split<','>( str, strs, !!strict );
+    Check( strs == pieces, "StrPipe::Split", str, name );
+
+    PlacedStr splitOut( str, offset );
+    std::vector<FTL::StrRef> strRefs;
+    Pipe::template Split<','>( str, splitOut.data(), strRefs, !!strict );
+    Check(
+      std::vector<std::string>( strRefs.begin(), strRefs.end() ) == pieces,
+      "StrPipe::Split to StrRefs", str, name
+      );
+
+    PlacedStr splitInPlace( str, offset );
+    strRefs.clear();
+    Pipe::template Split<','>(
+      splitInPlace.str(), splitInPlace.data(), strRefs, !!strict
+      );
+    Check(
+      std::vector<std::string>( strRefs.begin(), strRefs.end() ) == pieces,
+      "StrPipe::Split in place", str, name
+      );
+  }
+}
+
+static void TestPipe( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), PipeAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+    size_t const offset = random.below( 16 );
+
+    CheckPipe<PipeNormalize>(
+      str, RefNormalize( str ), offset, "PipeNormalize"
+      );
+    CheckPipe<PipeUpper>( str, RefUpper( str ), offset, "PipeUpper" );
+    CheckPipe<PipeScalar>( str, RefScalar( str ), offset, "PipeScalar" );
+  }
+}
+
+// MatchPrefixDFA against the MatchPrefix combinators, for patterns in
+// which they agree (see MatchPrefixDFA.h), alone and compiled together
+
+static FTL::StrRef const PrefixAlphabet( "ab,09\x80\xE9\xFF", 8 );
+
+typedef FTL::MatchPrefixChar<MatchA> PrefixA;
+typedef FTL::MatchPrefixChar< FTL::MatchCharSingle<'b'> > PrefixB;
+
+typedef FTL::MatchPrefixOneOrMore<
+  FTL::MatchPrefixChar<MatchDigit>
+  > PrefixDigits;
+typedef FTL::MatchPrefixOneOrMore<
+  FTL::MatchPrefixAny<
+    FTL::MatchPrefixSeq<PrefixA, PrefixB>,
+    FTL::MatchPrefixSeq<PrefixB, PrefixA>
+    >
+  > PrefixPairs;
+typedef FTL::MatchPrefixSeq<
+  FTL::MatchPrefixChar<MatchE9>,
+  FTL::MatchPrefixOneOrMore< FTL::MatchPrefixChar<MatchHighBit> >
+  > PrefixHigh;
+typedef FTL::MatchPrefixChar< FTL::MatchCharSingle<','> > PrefixComma;
+// Ties with PrefixPairs on "ab", which was added before it
+typedef FTL::MatchPrefixSeq<PrefixA, PrefixB> PrefixAB;
+
+// The length of the prefix that MatchPrefix matches, if any
+template<typename MatchPrefix>
+static size_t PrefixLength( FTL::StrRef str )
+{
+  MatchPrefix const mp;
+  FTL::StrRef::IT it = str.begin();
+  if ( !mp( it, str.end() ) )
+    return FTL::MatchPrefixNoLength;
+  return size_t( it - str.begin() );
+}
+
+template<typename MatchPrefix>
+static FTL::MatchPrefixDFA SingleDFA()
+{
+  FTL::MatchPrefixNFA nfa;
+  nfa.add<MatchPrefix>();
+  return FTL::MatchPrefixDFA( nfa );
+}
+
+// Checks match(), operator() and matchAll() of dfa on str, given the
+// length of the prefix each of its patterns matches
+static void CheckDFA(
+  FTL::MatchPrefixDFA const &dfa,
+  FTL::StrRef str,
+  std::vector<size_t> const &expectedLengths,
+  char const *name
+  )
+{
+  // The longest, and the first added among those as long
+  uint32_t expectedPattern = FTL::MatchPrefixNoPattern;
+  for ( uint32_t i = 0; i < expectedLengths.size(); ++i )
+  {
+    if ( expectedLengths[i] != FTL::MatchPrefixNoLength
+      && ( expectedPattern == FTL::MatchPrefixNoPattern
+        || expectedLengths[i] > expectedLengths[expectedPattern] ) )
+      expectedPattern = i;
+  }
+  size_t const expectedLength =
+    expectedPattern == FTL::MatchPrefixNoPattern?
+      0: expectedLengths[expectedPattern];
+
+  FTL::StrRef::IT it = str.begin();
+  uint32_t const pattern = dfa.match( it, str.end() );
+  Check(
+    pattern == expectedPattern
+      && size_t( it - str.begin() ) == expectedLength,
+    "MatchPrefixDFA::match", str, name
+    );
+
+  it = str.begin();
+  bool const matched = dfa( it, str.end() );
+  Check(
+    matched == ( expectedPattern != FTL::MatchPrefixNoPattern )
+      && size_t( it - str.begin() ) == expectedLength,
+    "MatchPrefixDFA()", str, name
+    );
+
+  std::vector<size_t> lengths;
+  dfa.matchAll( str, lengths );
+  Check( lengths == expectedLengths, "MatchPrefixDFA::matchAll", str, name );
+}
+
+template<typename MatchPrefix>
+static void CheckSingleDFA(
+  FTL::MatchPrefixDFA const &dfa,
+  FTL::StrRef str,
+  char const *name
+  )
+{
+  CheckDFA(
+    dfa, str, std::vector<size_t>( 1, PrefixLength<MatchPrefix>( str ) ), name
+    );
+}
+
+static void TestMatchPrefixDFA( Random &random, uint32_t rounds )
+{
+  // Where the DFA matches more than the combinators, as documented
+  {
+    typedef FTL::MatchPrefixAny<
+      PrefixA,
+      FTL::MatchPrefixSeq<PrefixA, PrefixB>
+      > AnyAAB;
+    FTL::StrRef const ab( "ab" );
+    FTL::StrRef::IT it = ab.begin();
+    Check(
+      SingleDFA<AnyAAB>().match( it, ab.end() ) == 0 && it == ab.end(),
+      "MatchPrefixDFA::match", ab, "Any<A, Seq<A, B>>"
+      );
+
+    typedef FTL::MatchPrefixSeq<
+      FTL::MatchPrefixOneOrMore<PrefixA>,
+      PrefixA
+      > SeqAsA;
+    FTL::StrRef const aa( "aa" );
+    it = aa.begin();
+    Check(
+      SingleDFA<SeqAsA>().match( it, aa.end() ) == 0 && it == aa.end(),
+      "MatchPrefixDFA::match", aa, "Seq<OneOrMore<A>, A>"
+      );
+  }
+
+  FTL::MatchPrefixDFA const digits = SingleDFA<PrefixDigits>();
+  FTL::MatchPrefixDFA const pairs = SingleDFA<PrefixPairs>();
+  FTL::MatchPrefixDFA const high = SingleDFA<PrefixHigh>();
+  FTL::MatchPrefixDFA const empty = SingleDFA<FTL::MatchPrefixEmpty>();
+  FTL::MatchPrefixDFA const never = SingleDFA<FTL::MatchPrefixNever>();
+
+  FTL::MatchPrefixNFA nfa;
+  nfa.add<PrefixDigits>();
+  nfa.add<PrefixPairs>();
+  nfa.add<PrefixHigh>();
+  nfa.add<PrefixComma>();
+  nfa.add<PrefixAB>();
+  nfa.add<FTL::MatchPrefixNever>();
+  FTL::MatchPrefixDFA const all( nfa );
+
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string const input =
+      RandomStr( random, RoundLength( random, round ), PrefixAlphabet );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    CheckSingleDFA<PrefixDigits>( digits, str, "PrefixDigits" );
+    CheckSingleDFA<PrefixPairs>( pairs, str, "PrefixPairs" );
+    CheckSingleDFA<PrefixHigh>( high, str, "PrefixHigh" );
+    CheckSingleDFA<FTL::MatchPrefixEmpty>( empty, str, "MatchPrefixEmpty" );
+    CheckSingleDFA<FTL::MatchPrefixNever>( never, str, "MatchPrefixNever" );
+
+    std::vector<size_t> lengths;
+    lengths.push_back( PrefixLength<PrefixDigits>( str ) );
+    lengths.push_back( PrefixLength<PrefixPairs>( str ) );
+    lengths.push_back( PrefixLength<PrefixHigh>( str ) );
+    lengths.push_back( PrefixLength<PrefixComma>( str ) );
+    lengths.push_back( PrefixLength<PrefixAB>( str ) );
+    lengths.push_back( FTL::MatchPrefixNoLength );
+    CheckDFA( all, str, lengths, "all" );
+  }
+}
+
+// StrMultiFind's findAll, containsAny and StrMultiFindRange against
+// trying every pattern at every position, for a fixed set of patterns
+// that overlap each other, one that uses every character, and random
+// sets
+
+static FTL::StrRef const MultiFindPatternAlphabet( "ab\x80\xff", 4 );
+// With characters that start no pattern, to be skipped
+static FTL::StrRef const MultiFindAlphabet( "ab\x80\xff,,,,cccc", 12 );
+
+typedef std::vector< std::pair<uint32_t, size_t> > Occurrences;
+
+// By where they end, then longest first, then by pattern
+static Occurrences RefMultiFind(
+  std::vector<FTL::StrRef> const &patterns,
+  FTL::StrRef str
+  )
+{
+  size_t maxSize = 0;
+  for ( size_t i = 0; i < patterns.size(); ++i )
+    maxSize = std::max( maxSize, patterns[i].size() );
+
+  Occurrences result;
+  for ( size_t end = 1; end <= str.size(); ++end )
+  {
+    for ( size_t size = std::min( maxSize, end ); size > 0; --size )
+    {
+      for ( uint32_t i = 0; i < patterns.size(); ++i )
+      {
+        if ( patterns[i].size() == size
+          && memcmp( str.data() + end - size, patterns[i].data(), size ) == 0 )
+          result.push_back( std::make_pair( i, end - size ) );
+      }
+    }
+  }
+  return result;
+}
+
+// Collects occurrences, stopping after limit
+struct CollectOccurrences
+{
+  Occurrences &m_occurrences;
+  size_t const m_limit;
+
+  CollectOccurrences( Occurrences &occurrences, size_t limit )
+    : m_occurrences( occurrences ), m_limit( limit ) {}
+
+  bool operator()( uint32_t pattern, size_t offset )
+  {
+    m_occurrences.push_back( std::make_pair( pattern, offset ) );
+    return m_occurrences.size() < m_limit;
+  }
+
+private:
+
+  CollectOccurrences &operator=( CollectOccurrences const & );
+};
+
+static void CheckMultiFind(
+  std::vector<FTL::StrRef> const &patterns,
+  FTL::StrMultiFind const &finder,
+  Random &random,
+  FTL::StrRef str,
+  char const *name
+  )
+{
+  Occurrences const expected = RefMultiFind( patterns, str );
+
+  Occurrences all;
+  CollectOccurrences collectAll( all, ~size_t( 0 ) );
+  bool const completed = finder.findAll( str, collectAll );
+  Check( completed && all == expected, "StrMultiFind::findAll", str, name );
+
+  if ( !expected.empty() )
+  {
+    size_t const limit = 1 + random.below( uint32_t( expected.size() ) );
+    Occurrences some;
+    CollectOccurrences collectSome( some, limit );
+    bool const stopped = !finder.findAll( str, collectSome );
+    Check(
+      stopped && some == Occurrences( expected.begin(),
+        expected.begin() + limit ),
+      "StrMultiFind::findAll stopping", str, name
+      );
+  }
+
+  Check(
+    finder.containsAny( str ) == !expected.empty(),
+    "StrMultiFind::containsAny", str, name
+    );
+
+  FTL::StrMultiFindRange const range( finder, str );
+  Occurrences ranged;
+  for ( FTL::StrMultiFindRange::const_iterator it = range.begin();
+    it != range.end(); ++it )
+    ranged.push_back( std::make_pair( it->pattern, it->offset ) );
+  Check( ranged == expected, "StrMultiFindRange", str, name );
+
+  size_t count = 0;
+  for ( FTL::StrMultiFindRange::const_iterator it = range.begin();
+    it != range.end(); it++ )
+    ++count;
+  Check( count == expected.size(), "StrMultiFindRange it++", str, name );
+}
+
+static std::vector<FTL::StrRef> StrRefs(
+  std::vector<std::string> const &strs
+  )
+{
+  return std::vector<FTL::StrRef>( strs.begin(), strs.end() );
+}
+
+static void TestMultiFind( Random &random, uint32_t rounds )
+{
+  std::vector<std::string> overlapping;
+  overlapping.push_back( "a" );
+  overlapping.push_back( "aa" );
+  overlapping.push_back( "aaa" );
+  overlapping.push_back( "ab" );
+  overlapping.push_back( "ba" );
+  overlapping.push_back( "" );
+  overlapping.push_back( "\x80\xff\x80" );
+  overlapping.push_back( "\xff" );
+  std::vector<FTL::StrRef> const overlappingRefs = StrRefs( overlapping );
+  FTL::StrMultiFind const overlappingFinder( overlappingRefs );
+
+  // Leaves no character for the class of those in no pattern
+  std::string everyChar( 256, '\0' );
+  for ( uint32_t c = 0; c < 256; ++c )
+    everyChar[c] = char( c );
+  std::vector<std::string> everyCharSet;
+  everyCharSet.push_back( everyChar );
+  everyCharSet.push_back( "a" );
+  everyCharSet.push_back( "ab" );
+  std::vector<FTL::StrRef> const everyCharRefs = StrRefs( everyCharSet );
+  FTL::StrMultiFind const everyCharFinder( everyCharRefs );
+
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    std::string input =
+      RandomStr( random, RoundLength( random, round ), MultiFindAlphabet );
+    if ( random.below( 8 ) == 0 )
+      input.insert( random.below( uint32_t( input.size() + 1 ) ), everyChar );
+    PlacedStr const placed( input, random.below( 16 ) );
+    FTL::StrRef const str = placed.str();
+
+    CheckMultiFind(
+      overlappingRefs, overlappingFinder, random, str, "overlapping"
+      );
+    CheckMultiFind( everyCharRefs, everyCharFinder, random, str, "everyChar" );
+
+    // Up to eight distinct patterns, of which one may be empty
+    std::vector<std::string> randomSet;
+    for ( uint32_t i = 1 + random.below( 8 ); i > 0; --i )
+    {
+      std::string const pattern = RandomStr(
+        random, random.below( 5 ), MultiFindPatternAlphabet
+        );
+      if ( std::find( randomSet.begin(), randomSet.end(), pattern )
+        == randomSet.end() )
+        randomSet.push_back( pattern );
+    }
+    std::vector<FTL::StrRef> const randomRefs = StrRefs( randomSet );
+    FTL::StrMultiFind const randomFinder( randomRefs );
+    CheckMultiFind( randomRefs, randomFinder, random, str, "random" );
+  }
+}
+
+// StrToInt32, StrToInt64, StrToUInt64 and StrToFloat64 against strtoll,
+// strtoull and strtod on a NUL-terminated copy, allowing for what they do
+// differently: no whitespace is skipped, StrToUInt64 rejects '-', and
+// StrToInt32 clamps to its range.  Inputs never hold an 'x', which would
+// make strtod read hexadecimal.  Failures show what the C library read.
+
+static char const *const IntBoundaries[] =
+{
+  "2147483647", "2147483648", "-2147483648", "-2147483649",
+  "9223372036854775807", "9223372036854775808",
+  "-9223372036854775808", "-9223372036854775809",
+  "18446744073709551615", "18446744073709551616", "-1",
+  "00000000000000000000000000018446744073709551615",
+  "99999999999999999999999999999999", "-", "+", "+-1", "0", "-0",
+};
+static size_t const IntBoundaryCount =
+  sizeof( IntBoundaries ) / sizeof( IntBoundaries[0] );
+
+static char const *const FloatSpecials[] =
+{
+  "inf", "-INF", "+Inf", "infinity", "-Infinity", "infini", "in", "i",
+  "nan", "-NaN", "nan(abc_1)", "NAN(", "nan()", "nan(a b)", "nan(\xE9)",
+  "n", "1e308", "1.7976931348623157e308", "1.7976931348623159e308",
+  "-1.8e308", "1e309", "2.2250738585072014e-308", "4.9e-324",
+  "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+  "9007199254740993", "9007199254740993.0000000000000000000001",
+  "179769313486231580793728971405301e276", "0.", ".0", ".", "-.", "-0",
+  "-0.0e5", "1e", "1e+", "1E-", "1e99999999999999999999", "1e-99999999999",
+};
+static size_t const FloatSpecialCount =
+  sizeof( FloatSpecials ) / sizeof( FloatSpecials[0] );
+
+static FTL::StrRef const DecimalDigits( "0123456789", 10 );
+static FTL::StrRef const NumberSigns( "+-", 2 );
+// What may follow a number
+static FTL::StrRef const NumberTail( " .eE+-a(\x80", 9 );
+
+static std::string RandomSign( Random &random )
+{
+  return random.below( 2 ) == 0?
+    std::string(): RandomStr( random, 1, NumberSigns );
+}
+
+// Mostly short, sometimes past what fits in 64 bits or the fast paths
+static std::string RandomDigits( Random &random )
+{
+  uint32_t const kind = random.below( 16 );
+  size_t const size = kind == 0? 20 + random.below( 800 ):
+    kind < 4? random.below( 40 ): random.below( 8 );
+  return RandomStr( random, size, DecimalDigits );
+}
+
+static std::string WithTail( Random &random, std::string const &number )
+{
+  std::string result = random.below( 32 ) == 0? " " + number: number;
+  if ( random.below( 4 ) == 0 )
+    result += RandomStr( random, 1 + random.below( 3 ), NumberTail );
+  return result;
+}
+
+static std::string RandomIntStr( Random &random )
+{
+  if ( random.below( 4 ) == 0 )
+    return WithTail(
+      random, IntBoundaries[random.below( uint32_t( IntBoundaryCount ) )]
+      );
+  return WithTail( random, RandomSign( random ) + RandomDigits( random ) );
+}
+
+static std::string RandomFloatStr( Random &random )
+{
+  if ( random.below( 4 ) == 0 )
+    return WithTail(
+      random, FloatSpecials[random.below( uint32_t( FloatSpecialCount ) )]
+      );
+  std::string result = RandomSign( random ) + RandomDigits( random );
+  if ( random.below( 2 ) == 0 )
+    result += '.' + RandomDigits( random );
+  if ( random.below( 3 ) == 0 )
+  {
+    result += random.below( 2 ) == 0? 'e': 'E';
+    result += RandomSign( random );
+    result += RandomStr( random, random.below( 5 ), DecimalDigits );
+  }
+  return WithTail( random, result );
+}
+
+// Where strtoll and co. would start, or 0 if they would skip whitespace
+static char const *RefNumberStart( std::string const &copy )
+{
+  return !copy.empty() && isspace( uint8_t( copy[0] ) )? 0: copy.c_str();
+}
+
+static void CheckStrToInt( FTL::StrRef str )
+{
+  std::string const copy( str.data(), str.size() );
+  char const *const start = RefNumberStart( copy );
+  char *refEnd = 0;
+
+  {
+    errno = 0;
+    long long const ref = start? strtoll( start, &refEnd, 10 ): 0;
+    bool const refOverflow = errno == ERANGE;
+    size_t const refSize = start? size_t( refEnd - start ): 0;
+
+    int64_t value = 12345;
+    FTL::StrToNumResult const result =
+      FTL::StrToInt64( str.begin(), str.end(), value );
+    Check(
+      size_t( result.end - str.begin() ) == refSize
+        && ( refSize == 0?
+          value == 12345 && !result.overflow:
+          value == ref && result.overflow == refOverflow ),
+      "StrToInt64", str, FTL::StrRef( str.data(), refSize )
+      );
+
+    long long const clamped = std::min(
+      std::max( ref, -2147483647LL - 1 ), 2147483647LL
+      );
+    int32_t value32 = 12345;
+    FTL::StrToNumResult const result32 =
+      FTL::StrToInt32( str.begin(), str.end(), value32 );
+    Check(
+      size_t( result32.end - str.begin() ) == refSize
+        && ( refSize == 0?
+          value32 == 12345 && !result32.overflow:
+          value32 == clamped
+            && result32.overflow == ( refOverflow || clamped != ref ) ),
+      "StrToInt32", str, FTL::StrRef( str.data(), refSize )
+      );
+  }
+
+  {
+    bool const negative = !copy.empty() && copy[0] == '-';
+    errno = 0;
+    unsigned long long const ref =
+      start && !negative? strtoull( start, &refEnd, 10 ): 0;
+    bool const refOverflow = errno == ERANGE;
+    size_t const refSize = start && !negative? size_t( refEnd - start ): 0;
+
+    uint64_t value = 12345;
+    FTL::StrToNumResult const result =
+      FTL::StrToUInt64( str.begin(), str.end(), value );
+    Check(
+      size_t( result.end - str.begin() ) == refSize
+        && ( refSize == 0?
+          value == 12345 && !result.overflow:
+          value == ref && result.overflow == refOverflow ),
+      "StrToUInt64", str, FTL::StrRef( str.data(), refSize )
+      );
+  }
+}
+
+static void CheckStrToFloat64( FTL::StrRef str )
+{
+  std::string const copy( str.data(), str.size() );
+  char const *const start = RefNumberStart( copy );
+  char *refEnd = 0;
+
+  errno = 0;
+  double const ref = start? strtod( start, &refEnd ): 0.0;
+  // strtod also sets ERANGE on underflow, which is not reported here
+  bool const refOverflow =
+    errno == ERANGE && ( ref > DBL_MAX || ref < -DBL_MAX );
+  size_t const refSize = start? size_t( refEnd - start ): 0;
+
+  double value = 12345.0;
+  FTL::StrToNumResult const result =
+    FTL::StrToFloat64( str.begin(), str.end(), value );
+  // Bit for bit, so that the sign of zero counts, except that any NaN
+  // equals any other
+  bool const same = ( value != value && ref != ref )
+    || memcmp( &value, &ref, sizeof( value ) ) == 0;
+  Check(
+    size_t( result.end - str.begin() ) == refSize
+      && ( refSize == 0?
+        value == 12345.0 && !result.overflow:
+        same && result.overflow == refOverflow ),
+    "StrToFloat64", str, FTL::StrRef( str.data(), refSize )
+    );
+}
+
+static void TestStrToNum( Random &random, uint32_t rounds )
+{
+  for ( uint32_t round = 0; round < rounds; ++round )
+  {
+    {
+      PlacedStr const placed( RandomIntStr( random ), random.below( 16 ) );
+      CheckStrToInt( placed.str() );
+    }
+    {
+      PlacedStr const placed( RandomFloatStr( random ), random.below( 16 ) );
+      CheckStrToFloat64( placed.str() );
+    }
+  }
+}
+
+int main( int argc, char **argv )
+{
+  uint32_t const rounds = argc > 1? uint32_t( atoi( argv[1] ) ): 2000;
+  Random random( 1 );
+
+  TestFind( random, rounds );
+  TestMatchChar( random, rounds );
+  TestSplit( random, rounds );
+  TestCountFilter( random, rounds );
+  TestRemap( random, rounds );
+  TestPipe( random, rounds );
+  TestMatchPrefixDFA( random, rounds );
+  TestMultiFind( random, rounds );
+  TestStrToNum( random, rounds );
+
+  if ( failureCount > 0 )
+  {
+    std::cout << failureCount << " failures\n";
+    return 1;
+  }
+  return 0;
+}